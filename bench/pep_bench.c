@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2008.
+ * See http://www.eu-egee.org/partners for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $Id$
+ */
+
+/*
+ * PEP client load generator: N threads send pep_authorize() requests to the PEP daemon
+ * endpoints (usually the mock PEP daemon, see test/mock/mock_pepd.c), and the throughput
+ * and the latency percentiles are reported.
+ *
+ * Closed loop (default): each thread sends its next request when the previous one is
+ * answered, the throughput is the one the PEP daemon and the client sustain.
+ * Open loop (-R rate): the requests are sent at a fixed total rate, whatever the response
+ * times. The latency of a request is measured from its scheduled time, and includes the
+ * time it waited for the previous requests of its thread (no coordinated omission).
+ *
+ * The latencies are recorded in a log-linear histogram (HdrHistogram style): 64 linear
+ * sub-buckets per power of two, the percentiles are within 1.6% of the measured values.
+ *
+ * usage: ./pep_bench [-u url]... [-t threads] [-n requests | -d seconds] [-R rate] [-w warmup]
+ *                    [-s subjects] [-S] [-b] [-k] [-c cafile] [-P] [-v]
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+#include <argus/pep.h>
+
+#define URLS_MAX 8
+
+/* histogram: values below 128 us are exact, above 64 sub-buckets per power of two up to 2^40 us */
+#define HIST_EXACT 128
+#define HIST_SUB_BITS 6
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_EXPONENTS 34
+#define HIST_SIZE (HIST_EXACT + HIST_EXPONENTS * HIST_SUB)
+
+/* number of pep_error_t codes counted */
+#define ERROR_CODES (PEP_ERR_CURL + CURL_LAST)
+
+typedef struct histogram {
+    uint64_t counts[HIST_SIZE];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+} histogram_t;
+
+typedef struct worker {
+    int id;
+    PEP * pep;
+    pthread_t thread;
+    histogram_t histogram;
+    uint64_t requests;
+    uint64_t errors;
+    uint64_t error_codes[ERROR_CODES];
+} worker_t;
+
+/* options */
+static const char * urls[URLS_MAX];
+static int urls_l= 0;
+static int threads= 4;
+static long requests= 1000; /* per thread, closed loop without duration */
+static int duration= 0; /* seconds, 0 to send requests per thread */
+static double rate= 0; /* total requests per second, 0 for closed loop */
+static int warmup= 10; /* requests per thread */
+static int subjects= 1;
+static int shared= 0; /* one PEP handle shared by the threads */
+static int binary= 0;
+static int insecure= 0;
+static const char * cafile= NULL;
+static int phases= 0;
+static int verbose= 0;
+
+static PEP * shared_pep= NULL;
+static pthread_barrier_t barrier;
+static uint64_t start_ns; /* start of the measure, set between the barriers */
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until_ns(uint64_t deadline) {
+    uint64_t now= now_ns();
+    struct timespec delay;
+    if (deadline <= now) return;
+    delay.tv_sec= (time_t)((deadline - now) / 1000000000ULL);
+    delay.tv_nsec= (long)((deadline - now) % 1000000000ULL);
+    nanosleep(&delay,NULL);
+}
+
+/*
+ * Returns the histogram index of the value.
+ */
+static int histogram_index(uint64_t value) {
+    int exponent= 0;
+    uint64_t v;
+    if (value < HIST_EXACT) return (int)value;
+    for (v= value; v > 1; v >>= 1) exponent++;
+    if (exponent >= 7 + HIST_EXPONENTS) return HIST_SIZE - 1;
+    /* exponent >= 7: the top 7 bits of the value, the highest being 1 */
+    return HIST_EXACT + (exponent - 7) * HIST_SUB + (int)((value >> (exponent - HIST_SUB_BITS)) - HIST_SUB);
+}
+
+/*
+ * Returns the highest value of the histogram index.
+ */
+static uint64_t histogram_value(int index) {
+    int exponent;
+    uint64_t sub;
+    if (index < HIST_EXACT) return (uint64_t)index;
+    exponent= 7 + (index - HIST_EXACT) / HIST_SUB;
+    sub= HIST_SUB + (uint64_t)((index - HIST_EXACT) % HIST_SUB);
+    return ((sub + 1) << (exponent - HIST_SUB_BITS)) - 1;
+}
+
+static void histogram_record(histogram_t * histogram, uint64_t value) {
+    histogram->counts[histogram_index(value)]++;
+    if (histogram->total == 0 || value < histogram->min) histogram->min= value;
+    if (value > histogram->max) histogram->max= value;
+    histogram->total++;
+    histogram->sum += (double)value;
+}
+
+static void histogram_merge(histogram_t * histogram, const histogram_t * other) {
+    int i;
+    if (other->total == 0) return;
+    for (i= 0; i < HIST_SIZE; i++) {
+        histogram->counts[i] += other->counts[i];
+    }
+    if (histogram->total == 0 || other->min < histogram->min) histogram->min= other->min;
+    if (other->max > histogram->max) histogram->max= other->max;
+    histogram->total += other->total;
+    histogram->sum += other->sum;
+}
+
+/*
+ * Returns the value at the percentile, at most the maximum value recorded.
+ */
+static uint64_t histogram_percentile(const histogram_t * histogram, double percentile) {
+    uint64_t rank, count= 0, value;
+    int i;
+    if (histogram->total == 0) return 0;
+    rank= (uint64_t)(percentile / 100.0 * (double)histogram->total + 0.5);
+    if (rank < 1) rank= 1;
+    for (i= 0; i < HIST_SIZE; i++) {
+        count += histogram->counts[i];
+        if (count >= rank) {
+            value= histogram_value(i);
+            return (value < histogram->max) ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static xacml_request_t * create_request(const char * subject) {
+    xacml_request_t * request= xacml_request_create();
+    xacml_subject_t * xacml_subject= xacml_subject_create();
+    xacml_resource_t * resource= xacml_resource_create();
+    xacml_action_t * action= xacml_action_create();
+    xacml_attribute_t * attribute;
+    attribute= xacml_attribute_create(XACML_SUBJECT_ID);
+    xacml_attribute_addvalue(attribute,subject);
+    xacml_subject_addattribute(xacml_subject,attribute);
+    xacml_request_addsubject(request,xacml_subject);
+    attribute= xacml_attribute_create(XACML_RESOURCE_ID);
+    xacml_attribute_addvalue(attribute,"http://authz-interop.org/xacml/resource/bench");
+    xacml_resource_addattribute(resource,attribute);
+    xacml_request_addresource(request,resource);
+    attribute= xacml_attribute_create(XACML_ACTION_ID);
+    xacml_attribute_addvalue(attribute,"http://authz-interop.org/xacml/action/bench");
+    xacml_action_addattribute(action,attribute);
+    xacml_request_setaction(request,action);
+    return request;
+}
+
+static PEP * create_pep(int pool_size) {
+    int i;
+    PEP * pep= pep_initialize();
+    if (pep == NULL) return NULL;
+    pep_setoption(pep,PEP_OPTION_LOG_LEVEL,verbose ? PEP_LOGLEVEL_WARN : PEP_LOGLEVEL_NONE);
+    for (i= 0; i < urls_l; i++) {
+        if (pep_setoption(pep,PEP_OPTION_ENDPOINT_URL,urls[i]) != PEP_OK) {
+            fprintf(stderr,"pep_bench: invalid endpoint url: %s\n",urls[i]);
+            pep_destroy(pep);
+            return NULL;
+        }
+    }
+    if (pool_size > 0) pep_setoption(pep,PEP_OPTION_SESSION_POOL_SIZE,pool_size);
+    if (binary) pep_setoption(pep,PEP_OPTION_WIRE_ENCODING,PEP_WIRE_ENCODING_BINARY);
+    if (insecure) pep_setoption(pep,PEP_OPTION_ENDPOINT_SSL_VALIDATION,0);
+    if (cafile != NULL) pep_setoption(pep,PEP_OPTION_ENDPOINT_SERVER_CERT,cafile);
+    return pep;
+}
+
+/*
+ * Sends one authorization, returns its result.
+ */
+static pep_error_t authorize(PEP * pep, long n) {
+    char subject[64];
+    xacml_request_t * request;
+    xacml_response_t * response= NULL;
+    pep_error_t rc;
+    snprintf(subject,sizeof(subject),"CN=bench-%ld",n % subjects);
+    request= create_request(subject);
+    rc= pep_authorize(pep,&request,&response);
+    xacml_request_delete(request);
+    xacml_response_delete(response);
+    return rc;
+}
+
+static void * worker_thread(void * arg) {
+    worker_t * worker= (worker_t *)arg;
+    uint64_t scheduled, interval_ns= 0, end_ns= 0, sent, done;
+    long n;
+    pep_error_t rc;
+
+    for (n= 0; n < warmup; n++) {
+        authorize(worker->pep,n);
+    }
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+
+    if (duration > 0) {
+        end_ns= start_ns + (uint64_t)duration * 1000000000ULL;
+    }
+    if (rate > 0) {
+        /* the threads share the rate, their schedules are interleaved */
+        interval_ns= (uint64_t)((double)threads * 1e9 / rate);
+        scheduled= start_ns + (uint64_t)worker->id * interval_ns / (uint64_t)threads;
+    }
+    else {
+        scheduled= start_ns;
+    }
+    for (n= 0; duration > 0 || n < requests; n++) {
+        if (rate > 0) {
+            sleep_until_ns(scheduled);
+            sent= scheduled;
+            scheduled += interval_ns;
+        }
+        else {
+            sent= now_ns();
+        }
+        /* an overloaded open loop doesn't send its backlog after the end */
+        if (end_ns > 0 && (sent >= end_ns || now_ns() >= end_ns)) break;
+        rc= authorize(worker->pep,(long)worker->id * 1000003L + n);
+        done= now_ns();
+        histogram_record(&(worker->histogram),(done - sent) / 1000);
+        worker->requests++;
+        if (rc != PEP_OK) {
+            worker->errors++;
+            if (rc < ERROR_CODES) worker->error_codes[rc]++;
+        }
+    }
+    return NULL;
+}
+
+static void print_phases(worker_t * workers) {
+    static const char * names[PEP_PHASE_COUNT]= {
+        "pip", "marshal", "encode", "dns", "connect", "tls", "server", "download", "decode", "unmarshal", "oh"
+    };
+    pep_stats_t stats, total;
+    int i, p;
+    memset(&total,0,sizeof(total));
+    for (i= 0; i < (shared ? 1 : threads); i++) {
+        pep_getstats(shared ? shared_pep : workers[i].pep,&stats);
+        total.transfers += stats.transfers;
+        total.connections += stats.connections;
+        total.connections_reused += stats.connections_reused;
+        for (p= 0; p < PEP_PHASE_COUNT; p++) {
+            total.phases[p].count += stats.phases[p].count;
+            total.phases[p].total_us += stats.phases[p].total_us;
+        }
+    }
+    fprintf(stdout,"  phases (us, warmup included): %lu transfers, %lu connections, %lu reused\n",
+            (unsigned long)total.transfers,(unsigned long)total.connections,(unsigned long)total.connections_reused);
+    for (p= 0; p < PEP_PHASE_COUNT; p++) {
+        if (total.phases[p].count == 0) continue;
+        fprintf(stdout,"    %-10s count %8lu  mean %10.1f\n",names[p],(unsigned long)total.phases[p].count,
+                (double)total.phases[p].total_us / (double)total.phases[p].count);
+    }
+}
+
+static void usage(const char * name) {
+    fprintf(stderr,"usage: %s [-u url]... [-t threads] [-n requests | -d seconds] [-R rate] [-w warmup]\n",name);
+    fprintf(stderr,"          [-s subjects] [-S] [-b] [-k] [-c cafile] [-P] [-v]\n");
+    fprintf(stderr,"  -u url       PEP daemon endpoint url, repeated for failover (default http://127.0.0.1:8154/authz)\n");
+    fprintf(stderr,"  -t threads   number of threads (default 4)\n");
+    fprintf(stderr,"  -n requests  requests per thread (default 1000)\n");
+    fprintf(stderr,"  -d seconds   duration of the run, instead of a number of requests\n");
+    fprintf(stderr,"  -R rate      open loop: total requests per second (default closed loop)\n");
+    fprintf(stderr,"  -w warmup    requests per thread before the measure (default 10)\n");
+    fprintf(stderr,"  -s subjects  number of distinct subjects of the requests (default 1)\n");
+    fprintf(stderr,"  -S           one PEP handle shared by the threads (default one handle per thread)\n");
+    fprintf(stderr,"  -b           binary wire encoding (PEP_WIRE_ENCODING_BINARY)\n");
+    fprintf(stderr,"  -k           no SSL validation of the endpoint\n");
+    fprintf(stderr,"  -c cafile    CA certificate PEM file of the endpoint\n");
+    fprintf(stderr,"  -P           report the mean time of the authorization phases\n");
+    fprintf(stderr,"  -v           log the PEP client warnings and errors\n");
+}
+
+/*
+ * MAIN
+ */
+int main(int argc, char **argv) {
+    worker_t * workers;
+    histogram_t * histogram;
+    uint64_t errors= 0, elapsed_ns;
+    double seconds;
+    int opt, i, code;
+    static const double percentiles[]= { 50.0, 90.0, 99.0, 99.9, 99.99 };
+
+    while ((opt= getopt(argc,argv,"u:t:n:d:R:w:s:SbkPc:vh")) != -1) {
+        switch (opt) {
+        case 'u':
+            if (urls_l < URLS_MAX) urls[urls_l++]= optarg;
+            break;
+        case 't': threads= atoi(optarg); break;
+        case 'n': requests= atol(optarg); break;
+        case 'd': duration= atoi(optarg); break;
+        case 'R': rate= atof(optarg); break;
+        case 'w': warmup= atoi(optarg); break;
+        case 's': subjects= atoi(optarg); break;
+        case 'S': shared= 1; break;
+        case 'b': binary= 1; break;
+        case 'k': insecure= 1; break;
+        case 'c': cafile= optarg; break;
+        case 'P': phases= 1; break;
+        case 'v': verbose= 1; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (threads < 1 || subjects < 1 || rate < 0 || (duration <= 0 && requests < 1)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (urls_l == 0) {
+        urls[urls_l++]= "http://127.0.0.1:8154/authz";
+    }
+
+    if (pep_global_init() != PEP_OK) {
+        fprintf(stderr,"pep_bench: pep_global_init() failed\n");
+        return 1;
+    }
+    workers= calloc(threads,sizeof(worker_t));
+    histogram= calloc(1,sizeof(histogram_t));
+    if (workers == NULL || histogram == NULL) {
+        fprintf(stderr,"pep_bench: can't allocate %d workers\n",threads);
+        return 1;
+    }
+    if (shared && (shared_pep= create_pep(threads)) == NULL) {
+        return 1;
+    }
+    for (i= 0; i < threads; i++) {
+        workers[i].id= i;
+        workers[i].pep= shared ? shared_pep : create_pep(0);
+        if (workers[i].pep == NULL) return 1;
+    }
+
+    pthread_barrier_init(&barrier,NULL,threads + 1);
+    for (i= 0; i < threads; i++) {
+        if (pthread_create(&(workers[i].thread),NULL,worker_thread,&(workers[i])) != 0) {
+            fprintf(stderr,"pep_bench: can't create thread %d\n",i);
+            return 1;
+        }
+    }
+    /* all the threads warmed up */
+    pthread_barrier_wait(&barrier);
+    start_ns= now_ns();
+    pthread_barrier_wait(&barrier);
+    for (i= 0; i < threads; i++) {
+        pthread_join(workers[i].thread,NULL);
+    }
+    elapsed_ns= now_ns() - start_ns;
+    pthread_barrier_destroy(&barrier);
+
+    for (i= 0; i < threads; i++) {
+        histogram_merge(histogram,&(workers[i].histogram));
+        errors += workers[i].errors;
+    }
+    seconds= (double)elapsed_ns / 1e9;
+    fprintf(stdout,"pep_bench: %d threads (%s), %s loop",threads,shared ? "shared handle" : "handle per thread",(rate > 0) ? "open" : "closed");
+    if (rate > 0) fprintf(stdout," at %.1f req/s",rate);
+    fprintf(stdout,", %lu requests in %.3f s\n",(unsigned long)histogram->total,seconds);
+    fprintf(stdout,"  throughput: %.1f req/s\n",(double)histogram->total / seconds);
+    fprintf(stdout,"  errors:     %lu (%.2f%%)\n",(unsigned long)errors,
+            histogram->total > 0 ? 100.0 * (double)errors / (double)histogram->total : 0.0);
+    for (code= 1; code < ERROR_CODES; code++) {
+        uint64_t count= 0;
+        for (i= 0; i < threads; i++) count += workers[i].error_codes[code];
+        if (count > 0) fprintf(stdout,"    %8lu  %s (%d)\n",(unsigned long)count,pep_strerror((pep_error_t)code),code);
+    }
+    fprintf(stdout,"  latency (us):\n");
+    fprintf(stdout,"    min     %10lu\n",(unsigned long)histogram->min);
+    fprintf(stdout,"    mean    %10.1f\n",histogram->total > 0 ? histogram->sum / (double)histogram->total : 0.0);
+    for (i= 0; i < (int)(sizeof(percentiles) / sizeof(percentiles[0])); i++) {
+        char label[16];
+        snprintf(label,sizeof(label),"p%g",percentiles[i]);
+        fprintf(stdout,"    %-7s %10lu\n",label,(unsigned long)histogram_percentile(histogram,percentiles[i]));
+    }
+    fprintf(stdout,"    max     %10lu\n",(unsigned long)histogram->max);
+    if (phases) print_phases(workers);
+
+    for (i= 0; i < threads; i++) {
+        if (!shared) pep_destroy(workers[i].pep);
+    }
+    if (shared) pep_destroy(shared_pep);
+    pep_global_cleanup();
+    free(workers);
+    free(histogram);
+    return 0;
+}
@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+/* select with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <sys/select.h>
+#include <curl/curl.h>
+
+/* from ../util */
+#include "buffer.h"
+#include "log.h"
+
+#include "async.h"
+
+/** maximum number of completed transfers kept for reuse */
+#define ASYNC_MAX_RECYCLED 32
+
+/** doubly linked list of transfers */
+typedef struct pep_async_list {
+    pep_async_transfer_t * head;
+    pep_async_transfer_t * tail;
+} pep_async_list_t;
+
+struct pep_async {
+    CURLM * multi;
+    pep_async_list_t running; /* transfers added to the multi handle */
+    pep_async_list_t ready; /* completed transfers, in completion order */
+    pep_async_transfer_t * recycled; /* released transfers, linked by next */
+    int recycled_l;
+    size_t length; /* running and ready transfers */
+    size_t ready_l; /* ready transfers */
+};
+
+static void list_append(pep_async_list_t * list, pep_async_transfer_t * transfer) {
+    transfer->next= NULL;
+    transfer->prev= list->tail;
+    if (list->tail != NULL) {
+        list->tail->next= transfer;
+    }
+    else {
+        list->head= transfer;
+    }
+    list->tail= transfer;
+}
+
+static void list_unlink(pep_async_list_t * list, pep_async_transfer_t * transfer) {
+    if (transfer->prev != NULL) {
+        transfer->prev->next= transfer->next;
+    }
+    else {
+        list->head= transfer->next;
+    }
+    if (transfer->next != NULL) {
+        transfer->next->prev= transfer->prev;
+    }
+    else {
+        list->tail= transfer->prev;
+    }
+    transfer->prev= NULL;
+    transfer->next= NULL;
+}
+
+static int list_contains(const pep_async_list_t * list, const pep_async_transfer_t * transfer) {
+    const pep_async_transfer_t * current;
+    for (current= list->head; current != NULL; current= current->next) {
+        if (current == transfer) return 1;
+    }
+    return 0;
+}
+
+pep_async_t * pep_async_create(void) {
+    pep_async_t * async= calloc(1,sizeof(struct pep_async));
+    if (async == NULL) {
+        pep_log_error("pep_async_create: can't allocate pep_async_t.");
+        return NULL;
+    }
+    async->multi= curl_multi_init();
+    if (async->multi == NULL) {
+        pep_log_error("pep_async_create: can't create CURL multi handle.");
+        free(async);
+        return NULL;
+    }
+#ifdef CURLPIPE_MULTIPLEX
+    /* multiplex the transfers over HTTP/2 connections (libcurl >= 7.62 default) */
+    curl_multi_setopt(async->multi,CURLMOPT_PIPELINING,CURLPIPE_MULTIPLEX);
+#endif
+    return async;
+}
+
+pep_async_transfer_t * pep_async_transfer_create(pep_async_t * async, CURL * template, unsigned long generation) {
+    pep_async_transfer_t * transfer;
+    CURLcode curl_rc;
+    if (async == NULL || template == NULL) {
+        pep_log_error("pep_async_transfer_create: NULL async or template pointer.");
+        return NULL;
+    }
+    if (async->recycled != NULL) {
+        transfer= async->recycled;
+        async->recycled= transfer->next;
+        async->recycled_l--;
+    }
+    else {
+        transfer= calloc(1,sizeof(pep_async_transfer_t));
+        if (transfer == NULL) {
+            pep_log_error("pep_async_transfer_create: can't allocate pep_async_transfer_t.");
+            return NULL;
+        }
+        transfer->session.owned= TRUE;
+    }
+    transfer->prev= NULL;
+    transfer->next= NULL;
+    /* (re)create the easy handle if needed */
+    if (transfer->session.curl == NULL || transfer->session.generation != generation) {
+        if (transfer->session.curl != NULL) {
+            curl_easy_cleanup(transfer->session.curl);
+        }
+        transfer->session.curl= pep_session_duphandle(template);
+        transfer->session.generation= generation;
+        transfer->session.configured= FALSE;
+        transfer->session.credentials_generation= 0;
+        if (transfer->session.curl == NULL) {
+            pep_log_error("pep_async_transfer_create: can't duplicate CURL session handle.");
+            pep_session_deletebuffers(&(transfer->session));
+            free(transfer);
+            return NULL;
+        }
+    }
+    curl_rc= curl_easy_setopt(transfer->session.curl,CURLOPT_PRIVATE,(char *)transfer);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_async_transfer_create: curl_easy_setopt(curl,CURLOPT_PRIVATE,transfer) failed: %s.",curl_easy_strerror(curl_rc));
+        pep_session_deletebuffers(&(transfer->session));
+        curl_easy_cleanup(transfer->session.curl);
+        free(transfer);
+        return NULL;
+    }
+    return transfer;
+}
+
+void pep_async_transfer_release(pep_async_t * async, pep_async_transfer_t * transfer) {
+    if (async == NULL || transfer == NULL) return;
+    pep_session_releasebuffers(&(transfer->session));
+    transfer->request= NULL;
+    transfer->submitted= NULL;
+    transfer->callback= NULL;
+    transfer->userdata= NULL;
+    if (async->recycled_l < ASYNC_MAX_RECYCLED) {
+        transfer->prev= NULL;
+        transfer->next= async->recycled;
+        async->recycled= transfer;
+        async->recycled_l++;
+    }
+    else {
+        pep_session_deletebuffers(&(transfer->session));
+        curl_easy_cleanup(transfer->session.curl);
+        free(transfer);
+    }
+}
+
+int pep_async_start(pep_async_t * async, pep_async_transfer_t * transfer) {
+    CURLMcode curlm_rc;
+    if (async == NULL || transfer == NULL) return -1;
+    curlm_rc= curl_multi_add_handle(async->multi,transfer->session.curl);
+    if (curlm_rc != CURLM_OK) {
+        pep_log_error("pep_async_start: curl_multi_add_handle(multi,curl) failed: %s.",curl_multi_strerror(curlm_rc));
+        return -1;
+    }
+    list_append(&(async->running),transfer);
+    async->length++;
+    return 0;
+}
+
+void pep_async_ready(pep_async_t * async, pep_async_transfer_t * transfer) {
+    if (async == NULL || transfer == NULL) return;
+    list_append(&(async->ready),transfer);
+    async->ready_l++;
+    async->length++;
+}
+
+int pep_async_wait(CURLM * multi, int timeout_ms) {
+    CURLMcode curlm_rc;
+#if LIBCURL_VERSION_NUM >= 0x071c00
+    curlm_rc= curl_multi_wait(multi,NULL,0,timeout_ms,NULL);
+    if (curlm_rc != CURLM_OK) {
+        pep_log_error("pep_async_wait: curl_multi_wait(multi,%d) failed: %s.",timeout_ms,curl_multi_strerror(curlm_rc));
+        return -1;
+    }
+#else
+    /* libcurl < 7.28: select on the multi handle file descriptors */
+    fd_set fdread, fdwrite, fdexcep;
+    int maxfd= -1;
+    long curl_timeout= -1;
+    struct timeval timeout;
+    FD_ZERO(&fdread);
+    FD_ZERO(&fdwrite);
+    FD_ZERO(&fdexcep);
+    curl_multi_timeout(multi,&curl_timeout);
+    if (curl_timeout >= 0 && curl_timeout < timeout_ms) {
+        timeout_ms= (int)curl_timeout;
+    }
+    curlm_rc= curl_multi_fdset(multi,&fdread,&fdwrite,&fdexcep,&maxfd);
+    if (curlm_rc != CURLM_OK) {
+        pep_log_error("pep_async_wait: curl_multi_fdset(multi) failed: %s.",curl_multi_strerror(curlm_rc));
+        return -1;
+    }
+    timeout.tv_sec= timeout_ms / 1000;
+    timeout.tv_usec= (timeout_ms % 1000) * 1000;
+    if (maxfd >= 0) {
+        select(maxfd + 1,&fdread,&fdwrite,&fdexcep,&timeout);
+    }
+#endif
+    return 0;
+}
+
+int pep_async_perform(pep_async_t * async, int timeout_ms) {
+    CURLMcode curlm_rc;
+    CURLMsg * msg;
+    int running_handles= 0, msgs_l= 0;
+    if (async == NULL) return -1;
+    if (async->ready.head != NULL || timeout_ms < 0) {
+        timeout_ms= 0;
+    }
+    if (async->running.head == NULL) {
+        return 0;
+    }
+    /* wait for activity */
+    if (pep_async_wait(async->multi,timeout_ms) != 0) {
+        return -1;
+    }
+    /* perform the transfers */
+    do {
+        curlm_rc= curl_multi_perform(async->multi,&running_handles);
+    } while (curlm_rc == CURLM_CALL_MULTI_PERFORM);
+    if (curlm_rc != CURLM_OK) {
+        pep_log_error("pep_async_perform: curl_multi_perform(multi) failed: %s.",curl_multi_strerror(curlm_rc));
+        return -1;
+    }
+    /* move the completed transfers to the ready list */
+    while ((msg= curl_multi_info_read(async->multi,&msgs_l)) != NULL) {
+        if (msg->msg == CURLMSG_DONE) {
+            char * private_data= NULL;
+            pep_async_transfer_t * transfer;
+            CURL * curl= msg->easy_handle;
+            CURLcode curl_rc= msg->data.result;
+            curl_easy_getinfo(curl,CURLINFO_PRIVATE,&private_data);
+            transfer= (pep_async_transfer_t *)private_data;
+            curl_multi_remove_handle(async->multi,curl);
+            if (transfer == NULL) continue;
+            transfer->rc= (curl_rc == CURLE_OK) ? PEP_OK : PEP_ERR_CURL + curl_rc;
+            list_unlink(&(async->running),transfer);
+            list_append(&(async->ready),transfer);
+            async->ready_l++;
+        }
+    }
+    return 0;
+}
+
+pep_async_transfer_t * pep_async_next(pep_async_t * async) {
+    pep_async_transfer_t * transfer;
+    if (async == NULL || async->ready.head == NULL) return NULL;
+    transfer= async->ready.head;
+    list_unlink(&(async->ready),transfer);
+    async->ready_l--;
+    async->length--;
+    return transfer;
+}
+
+pep_async_transfer_t * pep_async_find(pep_async_t * async, const xacml_request_t * request) {
+    pep_async_transfer_t * transfer;
+    if (async == NULL || request == NULL) return NULL;
+    for (transfer= async->running.head; transfer != NULL; transfer= transfer->next) {
+        if (transfer->submitted == request || transfer->request == request) return transfer;
+    }
+    for (transfer= async->ready.head; transfer != NULL; transfer= transfer->next) {
+        if (transfer->submitted == request || transfer->request == request) return transfer;
+    }
+    return NULL;
+}
+
+pep_async_transfer_t * pep_async_first(pep_async_t * async) {
+    if (async == NULL) return NULL;
+    if (async->running.head != NULL) return async->running.head;
+    return async->ready.head;
+}
+
+void pep_async_remove(pep_async_t * async, pep_async_transfer_t * transfer) {
+    if (async == NULL || transfer == NULL) return;
+    if (list_contains(&(async->ready),transfer)) {
+        list_unlink(&(async->ready),transfer);
+        async->ready_l--;
+    }
+    else {
+        curl_multi_remove_handle(async->multi,transfer->session.curl);
+        list_unlink(&(async->running),transfer);
+    }
+    async->length--;
+}
+
+size_t pep_async_length(const pep_async_t * async) {
+    if (async == NULL) return 0;
+    return async->length;
+}
+
+size_t pep_async_readylength(const pep_async_t * async) {
+    if (async == NULL) return 0;
+    return async->ready_l;
+}
+
+void pep_async_delete(pep_async_t * async) {
+    pep_async_transfer_t * transfer;
+    if (async == NULL) return;
+    while ((transfer= async->recycled) != NULL) {
+        async->recycled= transfer->next;
+        pep_session_deletebuffers(&(transfer->session));
+        curl_easy_cleanup(transfer->session.curl);
+        free(transfer);
+    }
+    curl_multi_cleanup(async->multi);
+    free(async);
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: asynchronous authorization transfers
+ *
+ * $Id$
+ */
+#ifndef _PEP_ASYNC_H_
+#define _PEP_ASYNC_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* size_t */
+#include <curl/curl.h>
+
+#include "pep.h"
+#include "session.h"
+
+/**
+ * Asynchronous authorization transfer. The session must be the first member.
+ */
+typedef struct pep_async_transfer {
+    pep_session_t session;
+    xacml_request_t * request; /* request being authorized */
+    const xacml_request_t * submitted; /* request pointer submitted by the caller */
+    pep_authorize_callback * callback;
+    void * userdata;
+    int cacheable;
+    int cache_rc;
+    pep_error_t rc; /* transfer result code */
+    struct pep_async_transfer * prev;
+    struct pep_async_transfer * next;
+} pep_async_transfer_t;
+
+/**
+ * ADT asynchronous transfers context type, wraps a CURL multi handle.
+ *
+ * A transfer is either running (added to the multi handle) or ready (its response
+ * is already available, or it failed before being sent). The context is not
+ * thread-safe.
+ */
+typedef struct pep_async pep_async_t;
+
+/**
+ * Creates an asynchronous transfers context.
+ *
+ * @return a pointer to the new context or NULL if an error occurs.
+ */
+pep_async_t * pep_async_create(void);
+
+/**
+ * Returns a new transfer, recycled if possible. The transfer easy handle is
+ * (re)duplicated from template if its generation is older than the given one.
+ *
+ * @return the transfer or NULL if an error occurs.
+ */
+pep_async_transfer_t * pep_async_transfer_create(pep_async_t * async, CURL * template, unsigned long generation);
+
+/**
+ * Releases a transfer, which is neither running nor ready, for later reuse.
+ */
+void pep_async_transfer_release(pep_async_t * async, pep_async_transfer_t * transfer);
+
+/**
+ * Starts the transfer of a configured transfer.
+ *
+ * @return 0 on success or -1 if the transfer can't be started.
+ */
+int pep_async_start(pep_async_t * async, pep_async_transfer_t * transfer);
+
+/**
+ * Queues a transfer which doesn't need to be sent as ready.
+ */
+void pep_async_ready(pep_async_t * async, pep_async_transfer_t * transfer);
+
+/**
+ * Waits at most timeout_ms milliseconds for activity on the transfers of a CURL
+ * multi handle.
+ *
+ * @return 0 on success or -1 if an error occurs.
+ */
+int pep_async_wait(CURLM * multi, int timeout_ms);
+
+/**
+ * Waits at most timeout_ms milliseconds for activity on the running transfers
+ * (no wait if a transfer is ready), and performs them.
+ *
+ * @return 0 on success or -1 if an error occurs.
+ */
+int pep_async_perform(pep_async_t * async, int timeout_ms);
+
+/**
+ * Removes and returns the next completed transfer, with its result code set.
+ *
+ * @return the completed transfer or NULL if none.
+ */
+pep_async_transfer_t * pep_async_next(pep_async_t * async);
+
+/**
+ * Looks up a running or ready transfer by its submitted or current request.
+ *
+ * @return the transfer or NULL if not found.
+ */
+pep_async_transfer_t * pep_async_find(pep_async_t * async, const xacml_request_t * request);
+
+/**
+ * Returns the first running or ready transfer, without removing it.
+ *
+ * @return the transfer or NULL if none.
+ */
+pep_async_transfer_t * pep_async_first(pep_async_t * async);
+
+/**
+ * Removes a running or ready transfer.
+ */
+void pep_async_remove(pep_async_t * async, pep_async_transfer_t * transfer);
+
+/**
+ * Returns the number of running and ready transfers.
+ */
+size_t pep_async_length(const pep_async_t * async);
+
+/**
+ * Returns the number of ready transfers.
+ */
+size_t pep_async_readylength(const pep_async_t * async);
+
+/**
+ * Deletes the context and its recycled transfers. Running and ready transfers
+ * must have been removed.
+ */
+void pep_async_delete(pep_async_t * async);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+/* clock_gettime and pthread with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+/* from ../util */
+#include "buffer.h"
+#include "log.h"
+
+#include "cache.h"
+
+/*
+ * number of lock-striped shards, must be a power of 2
+ */
+#ifndef CACHE_SHARDS
+#define CACHE_SHARDS 16
+#endif
+
+/*
+ * initial number of hash buckets per shard, must be a power of 2
+ */
+#ifndef CACHE_SHARD_BUCKETS
+#define CACHE_SHARD_BUCKETS 64
+#endif
+
+/*
+ * number of slots of the per shard admission doorkeeper, must be a power of 2
+ */
+#ifndef CACHE_DOORKEEPER_SIZE
+#define CACHE_DOORKEEPER_SIZE 1024
+#endif
+
+/* cache entry */
+typedef struct pep_cache_entry {
+    uint64_t hash;
+    unsigned char * key;
+    size_t key_l;
+    unsigned char * value;
+    size_t value_l;
+    time_t expires; /* monotonic time */
+    struct pep_cache_entry * chain; /* hash bucket chain */
+    struct pep_cache_entry * prev; /* LRU list, toward most recently used */
+    struct pep_cache_entry * next; /* LRU list, toward least recently used */
+} pep_cache_entry_t;
+
+/* cache shard, all fields protected by the shard lock */
+typedef struct pep_cache_shard {
+    pthread_mutex_t lock;
+    pep_cache_entry_t ** buckets;
+    size_t buckets_l;
+    pep_cache_entry_t * mru; /* LRU list head */
+    pep_cache_entry_t * lru; /* LRU list tail */
+    size_t entries;
+    size_t size; /* bytes */
+    uint64_t doorkeeper[CACHE_DOORKEEPER_SIZE];
+    pep_cache_stats_t stats;
+} pep_cache_shard_t;
+
+struct pep_cache {
+    long ttl;
+    size_t max_size;
+    pep_cache_admission_t admission;
+    pep_cache_shard_t shards[CACHE_SHARDS];
+};
+
+/* internal prototypes */
+static time_t cache_now(void);
+static size_t cache_entry_size(const pep_cache_entry_t * entry);
+static void cache_entry_delete(pep_cache_entry_t * entry);
+static pep_cache_entry_t * cache_shard_find(pep_cache_shard_t * shard, uint64_t hash, const void * key, size_t key_l);
+static void cache_shard_unlink(pep_cache_shard_t * shard, pep_cache_entry_t * entry);
+static void cache_shard_link(pep_cache_shard_t * shard, pep_cache_entry_t * entry);
+static void cache_shard_touch(pep_cache_shard_t * shard, pep_cache_entry_t * entry);
+static void cache_shard_grow(pep_cache_shard_t * shard);
+
+pep_cache_t * pep_cache_create(long ttl, size_t max_size, pep_cache_admission_t admission) {
+    int i;
+    pep_cache_t * cache= calloc(1,sizeof(struct pep_cache));
+    if (cache == NULL) {
+        pep_log_error("pep_cache_create: can't allocate pep_cache_t.");
+        return NULL;
+    }
+    cache->ttl= ttl;
+    cache->max_size= max_size;
+    cache->admission= admission;
+    for (i= 0; i < CACHE_SHARDS; i++) {
+        pep_cache_shard_t * shard= &(cache->shards[i]);
+        shard->buckets= calloc(CACHE_SHARD_BUCKETS,sizeof(pep_cache_entry_t *));
+        if (shard->buckets == NULL) {
+            pep_log_error("pep_cache_create: can't allocate %d buckets for shard %d.",CACHE_SHARD_BUCKETS,i);
+            while (--i >= 0) {
+                pthread_mutex_destroy(&(cache->shards[i].lock));
+                free(cache->shards[i].buckets);
+            }
+            free(cache);
+            return NULL;
+        }
+        shard->buckets_l= CACHE_SHARD_BUCKETS;
+        pthread_mutex_init(&(shard->lock),NULL);
+    }
+    return cache;
+}
+
+void pep_cache_setttl(pep_cache_t * cache, long ttl) {
+    if (cache == NULL) return;
+    cache->ttl= ttl;
+}
+
+void pep_cache_setmaxsize(pep_cache_t * cache, size_t max_size) {
+    if (cache == NULL) return;
+    cache->max_size= max_size;
+}
+
+void pep_cache_setadmission(pep_cache_t * cache, pep_cache_admission_t admission) {
+    if (cache == NULL) return;
+    cache->admission= admission;
+}
+
+/* FNV-1a 64-bit */
+uint64_t pep_cache_hash(const void * key, size_t key_l) {
+    const unsigned char * p= key;
+    uint64_t hash= 0xcbf29ce484222325ULL;
+    size_t i;
+    for (i= 0; i < key_l; i++) {
+        hash ^= (uint64_t)p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+int pep_cache_lookup(pep_cache_t * cache, const void * key, size_t key_l, pep_buffer_t * value) {
+    uint64_t hash;
+    pep_cache_shard_t * shard;
+    pep_cache_entry_t * entry;
+    int rc= PEP_CACHE_MISS;
+    if (cache == NULL || key == NULL || value == NULL) {
+        pep_log_error("pep_cache_lookup: NULL cache, key or value pointer.");
+        return PEP_CACHE_ERROR;
+    }
+    hash= pep_cache_hash(key,key_l);
+    shard= &(cache->shards[hash & (CACHE_SHARDS - 1)]);
+    pthread_mutex_lock(&(shard->lock));
+    entry= cache_shard_find(shard,hash,key,key_l);
+    if (entry != NULL && entry->expires <= cache_now()) {
+        /* expired */
+        cache_shard_unlink(shard,entry);
+        cache_entry_delete(entry);
+        shard->stats.expirations++;
+        entry= NULL;
+    }
+    if (entry != NULL) {
+        if (pep_buffer_write(entry->value,1,entry->value_l,value) != entry->value_l) {
+            pep_log_error("pep_cache_lookup: can't copy %d bytes cached value.",(int)entry->value_l);
+            rc= PEP_CACHE_ERROR;
+        }
+        else {
+            cache_shard_touch(shard,entry);
+            shard->stats.hits++;
+            rc= PEP_CACHE_HIT;
+        }
+    }
+    else {
+        shard->stats.misses++;
+    }
+    pthread_mutex_unlock(&(shard->lock));
+    return rc;
+}
+
+int pep_cache_store(pep_cache_t * cache, const void * key, size_t key_l, const void * value, size_t value_l) {
+    uint64_t hash;
+    pep_cache_shard_t * shard;
+    pep_cache_entry_t * entry, * old;
+    size_t shard_max_size;
+    if (cache == NULL || key == NULL || value == NULL) {
+        pep_log_error("pep_cache_store: NULL cache, key or value pointer.");
+        return PEP_CACHE_ERROR;
+    }
+    hash= pep_cache_hash(key,key_l);
+    shard= &(cache->shards[hash & (CACHE_SHARDS - 1)]);
+    shard_max_size= cache->max_size / CACHE_SHARDS;
+
+    /* allocate the entry outside of the lock */
+    entry= calloc(1,sizeof(pep_cache_entry_t));
+    if (entry == NULL) {
+        pep_log_error("pep_cache_store: can't allocate cache entry.");
+        return PEP_CACHE_ERROR;
+    }
+    entry->hash= hash;
+    entry->key_l= key_l;
+    entry->value_l= value_l;
+    entry->key= malloc(key_l > 0 ? key_l : 1);
+    entry->value= malloc(value_l > 0 ? value_l : 1);
+    if (entry->key == NULL || entry->value == NULL) {
+        pep_log_error("pep_cache_store: can't allocate cache entry key (%d bytes) and value (%d bytes).",(int)key_l,(int)value_l);
+        cache_entry_delete(entry);
+        return PEP_CACHE_ERROR;
+    }
+    memcpy(entry->key,key,key_l);
+    memcpy(entry->value,value,value_l);
+    entry->expires= cache_now() + cache->ttl;
+
+    pthread_mutex_lock(&(shard->lock));
+    if (cache_entry_size(entry) > shard_max_size) {
+        pep_log_debug("pep_cache_store: entry of %d bytes exceeds shard size %d bytes.",(int)cache_entry_size(entry),(int)shard_max_size);
+        shard->stats.rejections++;
+        pthread_mutex_unlock(&(shard->lock));
+        cache_entry_delete(entry);
+        return PEP_CACHE_OK;
+    }
+    old= cache_shard_find(shard,hash,key,key_l);
+    if (old != NULL) {
+        /* replace existing entry */
+        cache_shard_unlink(shard,old);
+        cache_entry_delete(old);
+    }
+    else if (cache->admission == PEP_CACHE_ADMISSION_SECOND_HIT) {
+        /* doorkeeper: only admit keys already seen once */
+        uint64_t * seen= &(shard->doorkeeper[(hash >> 32) & (CACHE_DOORKEEPER_SIZE - 1)]);
+        if (*seen != hash) {
+            *seen= hash;
+            shard->stats.rejections++;
+            pthread_mutex_unlock(&(shard->lock));
+            cache_entry_delete(entry);
+            return PEP_CACHE_OK;
+        }
+        *seen= 0;
+    }
+    /* evict least recently used entries until the new one fits */
+    while (shard->lru != NULL && shard->size + cache_entry_size(entry) > shard_max_size) {
+        pep_cache_entry_t * victim= shard->lru;
+        cache_shard_unlink(shard,victim);
+        cache_entry_delete(victim);
+        shard->stats.evictions++;
+    }
+    if (shard->entries >= shard->buckets_l) {
+        cache_shard_grow(shard);
+    }
+    cache_shard_link(shard,entry);
+    shard->stats.insertions++;
+    pthread_mutex_unlock(&(shard->lock));
+    return PEP_CACHE_OK;
+}
+
+void pep_cache_getstats(pep_cache_t * cache, pep_cache_stats_t * stats) {
+    int i;
+    if (cache == NULL || stats == NULL) return;
+    memset(stats,0,sizeof(pep_cache_stats_t));
+    for (i= 0; i < CACHE_SHARDS; i++) {
+        pep_cache_shard_t * shard= &(cache->shards[i]);
+        pthread_mutex_lock(&(shard->lock));
+        stats->hits += shard->stats.hits;
+        stats->misses += shard->stats.misses;
+        stats->insertions += shard->stats.insertions;
+        stats->evictions += shard->stats.evictions;
+        stats->expirations += shard->stats.expirations;
+        stats->rejections += shard->stats.rejections;
+        stats->entries += shard->entries;
+        stats->size += shard->size;
+        pthread_mutex_unlock(&(shard->lock));
+    }
+}
+
+void pep_cache_delete(pep_cache_t * cache) {
+    int i;
+    if (cache == NULL) return;
+    for (i= 0; i < CACHE_SHARDS; i++) {
+        pep_cache_shard_t * shard= &(cache->shards[i]);
+        pep_cache_entry_t * entry= shard->mru;
+        while (entry != NULL) {
+            pep_cache_entry_t * next= entry->next;
+            cache_entry_delete(entry);
+            entry= next;
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&(shard->lock));
+    }
+    free(cache);
+}
+
+/**************************/
+/*** INTERNAL FUNCTIONS ***/
+/**************************/
+
+/** monotonic time in second */
+static time_t cache_now(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC,&ts) != 0) {
+        return time(NULL);
+    }
+    return ts.tv_sec;
+}
+
+/** memory accounted for an entry */
+static size_t cache_entry_size(const pep_cache_entry_t * entry) {
+    return sizeof(pep_cache_entry_t) + entry->key_l + entry->value_l;
+}
+
+static void cache_entry_delete(pep_cache_entry_t * entry) {
+    if (entry == NULL) return;
+    if (entry->key != NULL) free(entry->key);
+    if (entry->value != NULL) free(entry->value);
+    free(entry);
+}
+
+/** returns the entry matching key or NULL, shard must be locked */
+static pep_cache_entry_t * cache_shard_find(pep_cache_shard_t * shard, uint64_t hash, const void * key, size_t key_l) {
+    pep_cache_entry_t * entry= shard->buckets[(hash >> 4) & (shard->buckets_l - 1)];
+    while (entry != NULL) {
+        if (entry->hash == hash && entry->key_l == key_l && memcmp(entry->key,key,key_l) == 0) {
+            return entry;
+        }
+        entry= entry->chain;
+    }
+    return NULL;
+}
+
+/** removes the entry from its bucket chain and from the LRU list, shard must be locked */
+static void cache_shard_unlink(pep_cache_shard_t * shard, pep_cache_entry_t * entry) {
+    pep_cache_entry_t ** p= &(shard->buckets[(entry->hash >> 4) & (shard->buckets_l - 1)]);
+    while (*p != NULL && *p != entry) {
+        p= &((*p)->chain);
+    }
+    if (*p == entry) {
+        *p= entry->chain;
+    }
+    if (entry->prev != NULL) entry->prev->next= entry->next;
+    else shard->mru= entry->next;
+    if (entry->next != NULL) entry->next->prev= entry->prev;
+    else shard->lru= entry->prev;
+    entry->chain= entry->prev= entry->next= NULL;
+    shard->entries--;
+    shard->size -= cache_entry_size(entry);
+}
+
+/** inserts the entry in its bucket chain and at the LRU list head, shard must be locked */
+static void cache_shard_link(pep_cache_shard_t * shard, pep_cache_entry_t * entry) {
+    pep_cache_entry_t ** bucket= &(shard->buckets[(entry->hash >> 4) & (shard->buckets_l - 1)]);
+    entry->chain= *bucket;
+    *bucket= entry;
+    entry->prev= NULL;
+    entry->next= shard->mru;
+    if (shard->mru != NULL) shard->mru->prev= entry;
+    shard->mru= entry;
+    if (shard->lru == NULL) shard->lru= entry;
+    shard->entries++;
+    shard->size += cache_entry_size(entry);
+}
+
+/** moves the entry at the LRU list head, shard must be locked */
+static void cache_shard_touch(pep_cache_shard_t * shard, pep_cache_entry_t * entry) {
+    if (shard->mru == entry) return;
+    entry->prev->next= entry->next;
+    if (entry->next != NULL) entry->next->prev= entry->prev;
+    else shard->lru= entry->prev;
+    entry->prev= NULL;
+    entry->next= shard->mru;
+    shard->mru->prev= entry;
+    shard->mru= entry;
+}
+
+/** doubles the number of buckets, keeps the current ones on allocation failure */
+static void cache_shard_grow(pep_cache_shard_t * shard) {
+    size_t i, buckets_l= shard->buckets_l * 2;
+    pep_cache_entry_t ** buckets= calloc(buckets_l,sizeof(pep_cache_entry_t *));
+    if (buckets == NULL) {
+        pep_log_warn("cache_shard_grow: can't allocate %d buckets.",(int)buckets_l);
+        return;
+    }
+    for (i= 0; i < shard->buckets_l; i++) {
+        pep_cache_entry_t * entry= shard->buckets[i];
+        while (entry != NULL) {
+            pep_cache_entry_t * chain= entry->chain;
+            pep_cache_entry_t ** bucket= &(buckets[(entry->hash >> 4) & (buckets_l - 1)]);
+            entry->chain= *bucket;
+            *bucket= entry;
+            entry= chain;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets= buckets;
+    shard->buckets_l= buckets_l;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: in-process decision cache
+ *
+ * $Id$
+ */
+#ifndef _PEP_CACHE_H_
+#define _PEP_CACHE_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+#include "pep.h"
+#include "buffer.h" /* ../util/buffer.h */
+
+/** cache return codes */
+#define PEP_CACHE_OK      0
+#define PEP_CACHE_ERROR  -1
+#define PEP_CACHE_HIT     1
+#define PEP_CACHE_MISS    2
+
+/**
+ * ADT decision cache type.
+ *
+ * The cache maps the serialized Hessian request (key) to the serialized Hessian
+ * response (value) received from the PEP daemon. The entries are distributed
+ * over lock-striped shards, each shard is bounded in memory and evicts its
+ * least recently used entries first.
+ */
+typedef struct pep_cache pep_cache_t;
+
+/**
+ * Creates a decision cache.
+ *
+ * @param ttl entries time-to-live in second.
+ * @param max_size the memory bound of the cache in bytes.
+ * @param admission the admission policy.
+ *
+ * @return a pointer to the new cache or NULL if an error occurs.
+ */
+pep_cache_t * pep_cache_create(long ttl, size_t max_size, pep_cache_admission_t admission);
+
+/**
+ * Sets the time-to-live of the new entries.
+ */
+void pep_cache_setttl(pep_cache_t * cache, long ttl);
+
+/**
+ * Sets the memory bound of the cache. Exceeding entries are evicted on the next insertion.
+ */
+void pep_cache_setmaxsize(pep_cache_t * cache, size_t max_size);
+
+/**
+ * Sets the admission policy.
+ */
+void pep_cache_setadmission(pep_cache_t * cache, pep_cache_admission_t admission);
+
+/**
+ * Computes the 64-bit FNV-1a hash of the key bytes.
+ */
+uint64_t pep_cache_hash(const void * key, size_t key_l);
+
+/**
+ * Looks up the key and, on hit, writes a copy of the cached value into the
+ * value buffer.
+ *
+ * @param cache pointer to the cache.
+ * @param key pointer to the key bytes.
+ * @param key_l the length of the key.
+ * @param value the buffer to write the cached value to.
+ *
+ * @return PEP_CACHE_HIT, PEP_CACHE_MISS or PEP_CACHE_ERROR if an error occurs.
+ */
+int pep_cache_lookup(pep_cache_t * cache, const void * key, size_t key_l, pep_buffer_t * value);
+
+/**
+ * Stores a copy of the key and value bytes in the cache, subject to the admission
+ * policy and the memory bound.
+ *
+ * @return PEP_CACHE_OK or PEP_CACHE_ERROR if an error occurs.
+ */
+int pep_cache_store(pep_cache_t * cache, const void * key, size_t key_l, const void * value, size_t value_l);
+
+/**
+ * Sums up the statistics of all shards.
+ */
+void pep_cache_getstats(pep_cache_t * cache, pep_cache_stats_t * stats);
+
+/**
+ * Releases all the entries and deletes the cache.
+ */
+void pep_cache_delete(pep_cache_t * cache);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
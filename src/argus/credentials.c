@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+/* pthread, dirent and struct stat with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+
+/* from ../util */
+#include "buffer.h"
+#include "clock.h"
+#include "log.h"
+
+#include "credentials.h"
+
+/* in-memory certificates and keys (CURLOPT_*_BLOB) require libcurl >= 7.77 */
+#if LIBCURL_VERSION_NUM >= 0x074D00
+#define CREDENTIALS_BLOB 1
+#endif
+
+/** credential files: client certificate, client key, CA file and CA directory */
+enum { CREDENTIALS_CERT= 0, CREDENTIALS_KEY, CREDENTIALS_CAFILE, CREDENTIALS_CAPATH, CREDENTIALS_FILES };
+
+/** file read chunk */
+#define CREDENTIALS_CHUNK_SIZE 4096
+
+/** identifies a version of a credential file, or of the CA directory content */
+typedef struct credentials_stamp {
+    time_t mtime;
+    off_t size;
+    ino_t ino;
+} credentials_stamp_t;
+
+struct pep_credentials {
+    pthread_mutex_t lock;
+    char * paths[CREDENTIALS_FILES]; /* NULL if not set */
+    char * keypassword;
+    credentials_stamp_t stamps[CREDENTIALS_FILES]; /* of the loaded files */
+    pep_buffer_t * cert; /* client certificate, or NULL */
+    pep_buffer_t * key; /* client key, or NULL */
+    pep_buffer_t * ca; /* CA file and CA directory certificates, or NULL */
+    unsigned long generation; /* incremented at each reload, never 0 */
+    int reload_interval; /* seconds, 0 to never check the files */
+    uint64_t next_check; /* time (ms) of the next check */
+    int handles; /* number of PEP handles using the credentials */
+};
+
+static char * credentials_strdup(const char * str) {
+    char * copy;
+    if (str == NULL) return NULL;
+    copy= calloc(strlen(str) + 1,sizeof(char));
+    if (copy != NULL) {
+        strcpy(copy,str);
+    }
+    return copy;
+}
+
+static int credentials_stat(const char * path, credentials_stamp_t * stamp) {
+    struct stat st;
+    memset(stamp,0,sizeof(credentials_stamp_t));
+    if (path == NULL) return 0;
+    if (stat(path,&st) != 0) {
+        return -1;
+    }
+    stamp->mtime= st.st_mtime;
+    stamp->size= st.st_size;
+    stamp->ino= st.st_ino;
+    return 0;
+}
+
+/* appends the file content to buffer */
+static int credentials_readfile(const char * path, pep_buffer_t * buffer) {
+    unsigned char chunk[CREDENTIALS_CHUNK_SIZE];
+    size_t n;
+    int rc= 0;
+    FILE * file= fopen(path,"rb");
+    if (file == NULL) {
+        pep_log_error("pep_credentials: can't open %s: %s.",path,strerror(errno));
+        return -1;
+    }
+    while ((n= fread(chunk,1,sizeof(chunk),file)) > 0) {
+        if (pep_buffer_write(chunk,1,n,buffer) != n) {
+            rc= -1;
+            break;
+        }
+    }
+    if (ferror(file)) {
+        pep_log_error("pep_credentials: can't read %s.",path);
+        rc= -1;
+    }
+    fclose(file);
+    return rc;
+}
+
+/* hashed CA certificate filenames: 8 hex digits, a dot and a number (the CRLs have .r<n>) */
+static int credentials_hashedname(const char * name) {
+    int i;
+    for (i= 0; i < 8; i++) {
+        if (strchr("0123456789abcdef",name[i]) == NULL || name[i] == '\0') return 0;
+    }
+    if (name[8] != '.' || name[9] == '\0') return 0;
+    for (i= 9; name[i] != '\0'; i++) {
+        if (name[i] < '0' || name[i] > '9') return 0;
+    }
+    return 1;
+}
+
+/* appends the hashed CA certificates of the directory to buffer */
+static int credentials_readdir(const char * path, pep_buffer_t * buffer) {
+    struct dirent * entry;
+    char * filename;
+    size_t path_l= strlen(path);
+    int count= 0, rc= 0;
+    DIR * dir= opendir(path);
+    if (dir == NULL) {
+        pep_log_error("pep_credentials: can't open CA directory %s: %s.",path,strerror(errno));
+        return -1;
+    }
+    while (rc == 0 && (entry= readdir(dir)) != NULL) {
+        if (!credentials_hashedname(entry->d_name)) continue;
+        filename= calloc(path_l + strlen(entry->d_name) + 2,sizeof(char));
+        if (filename == NULL) {
+            rc= -1;
+            break;
+        }
+        sprintf(filename,"%s/%s",path,entry->d_name);
+        rc= credentials_readfile(filename,buffer);
+        free(filename);
+        /* PEM files may miss the last newline */
+        if (rc == 0 && pep_buffer_putc('\n',buffer) == BUFFER_ERROR) {
+            rc= -1;
+        }
+        count++;
+    }
+    closedir(dir);
+    if (rc == 0) {
+        pep_log_debug("pep_credentials: %d CA certificates loaded from %s.",count,path);
+    }
+    return rc;
+}
+
+/* doesn't leave the private key in freed memory */
+static void credentials_deletekey(pep_buffer_t * key) {
+    if (key == NULL) return;
+    memset((void *)pep_buffer_data(key),'\0',pep_buffer_length(key));
+    pep_buffer_delete(key);
+}
+
+/* loads the file into a new buffer, or the CA file and directory into one */
+static pep_buffer_t * credentials_load(const char * path, const char * capath) {
+    pep_buffer_t * buffer;
+    if (path == NULL && capath == NULL) return NULL;
+    buffer= pep_buffer_create(CREDENTIALS_CHUNK_SIZE);
+    if (buffer == NULL) {
+        pep_log_error("pep_credentials: can't allocate buffer.");
+        return NULL;
+    }
+    if ((path != NULL && credentials_readfile(path,buffer) != 0)
+        || (path != NULL && capath != NULL && pep_buffer_putc('\n',buffer) == BUFFER_ERROR)
+        || (capath != NULL && credentials_readdir(capath,buffer) != 0)) {
+        pep_buffer_delete(buffer);
+        return NULL;
+    }
+    if (pep_buffer_length(buffer) == 0) {
+        pep_log_error("pep_credentials: no credentials in %s.",(path != NULL) ? path : capath);
+        pep_buffer_delete(buffer);
+        return NULL;
+    }
+    return buffer;
+}
+
+/*
+ * Loads all the credential files, and replaces the credentials only if all of them
+ * are loaded. Called with the lock held, except at creation.
+ */
+static int credentials_reload(pep_credentials_t * credentials) {
+    credentials_stamp_t stamps[CREDENTIALS_FILES];
+    pep_buffer_t * cert= NULL, * key= NULL, * ca= NULL;
+    int i;
+    for (i= 0; i < CREDENTIALS_FILES; i++) {
+        if (credentials_stat(credentials->paths[i],&(stamps[i])) != 0) {
+            pep_log_error("pep_credentials: can't stat %s: %s.",credentials->paths[i],strerror(errno));
+            return -1;
+        }
+    }
+    if (credentials->paths[CREDENTIALS_CERT] != NULL) {
+        cert= credentials_load(credentials->paths[CREDENTIALS_CERT],NULL);
+    }
+    if (credentials->paths[CREDENTIALS_KEY] != NULL) {
+        key= credentials_load(credentials->paths[CREDENTIALS_KEY],NULL);
+    }
+    if (credentials->paths[CREDENTIALS_CAFILE] != NULL || credentials->paths[CREDENTIALS_CAPATH] != NULL) {
+        ca= credentials_load(credentials->paths[CREDENTIALS_CAFILE],credentials->paths[CREDENTIALS_CAPATH]);
+    }
+    if ((credentials->paths[CREDENTIALS_CERT] != NULL && cert == NULL)
+        || (credentials->paths[CREDENTIALS_KEY] != NULL && key == NULL)
+        || ((credentials->paths[CREDENTIALS_CAFILE] != NULL || credentials->paths[CREDENTIALS_CAPATH] != NULL) && ca == NULL)) {
+        if (cert != NULL) pep_buffer_delete(cert);
+        credentials_deletekey(key);
+        if (ca != NULL) pep_buffer_delete(ca);
+        return -1;
+    }
+    if (credentials->cert != NULL) pep_buffer_delete(credentials->cert);
+    credentials_deletekey(credentials->key);
+    if (credentials->ca != NULL) pep_buffer_delete(credentials->ca);
+    credentials->cert= cert;
+    credentials->key= key;
+    credentials->ca= ca;
+    memcpy(credentials->stamps,stamps,sizeof(stamps));
+    credentials->generation++;
+    return 0;
+}
+
+/* TRUE if a credential file changed, or a file was added to or removed from the CA directory */
+static int credentials_changed(const pep_credentials_t * credentials) {
+    credentials_stamp_t stamp;
+    int i;
+    for (i= 0; i < CREDENTIALS_FILES; i++) {
+        if (credentials->paths[i] == NULL) continue;
+        if (credentials_stat(credentials->paths[i],&stamp) != 0) {
+            /* being replaced, check again later */
+            return 0;
+        }
+        if (memcmp(&stamp,&(credentials->stamps[i]),sizeof(stamp)) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+pep_credentials_t * pep_credentials_create(const char * client_cert, const char * client_key, const char * client_keypassword, const char * server_cert, const char * server_capath, int reload_interval) {
+    pep_credentials_t * credentials;
+#ifndef CREDENTIALS_BLOB
+    pep_log_error("pep_credentials_create: in-memory credentials require libcurl >= 7.77 (%s).",LIBCURL_VERSION);
+    return NULL;
+#endif
+    if (client_cert == NULL && client_key == NULL && server_cert == NULL && server_capath == NULL) {
+        pep_log_error("pep_credentials_create: no credential file.");
+        return NULL;
+    }
+    credentials= calloc(1,sizeof(struct pep_credentials));
+    if (credentials == NULL) {
+        pep_log_error("pep_credentials_create: can't allocate pep_credentials_t.");
+        return NULL;
+    }
+    credentials->paths[CREDENTIALS_CERT]= credentials_strdup(client_cert);
+    credentials->paths[CREDENTIALS_KEY]= credentials_strdup(client_key);
+    credentials->paths[CREDENTIALS_CAFILE]= credentials_strdup(server_cert);
+    credentials->paths[CREDENTIALS_CAPATH]= credentials_strdup(server_capath);
+    credentials->keypassword= credentials_strdup(client_keypassword);
+    credentials->reload_interval= (reload_interval > 0) ? reload_interval : 0;
+    pthread_mutex_init(&(credentials->lock),NULL);
+    if ((client_cert != NULL && credentials->paths[CREDENTIALS_CERT] == NULL)
+        || (client_key != NULL && credentials->paths[CREDENTIALS_KEY] == NULL)
+        || (server_cert != NULL && credentials->paths[CREDENTIALS_CAFILE] == NULL)
+        || (server_capath != NULL && credentials->paths[CREDENTIALS_CAPATH] == NULL)
+        || (client_keypassword != NULL && credentials->keypassword == NULL)) {
+        pep_log_error("pep_credentials_create: can't allocate credential file names.");
+        pep_credentials_destroy(credentials);
+        return NULL;
+    }
+    if (credentials_reload(credentials) != 0) {
+        pep_credentials_destroy(credentials);
+        return NULL;
+    }
+    credentials->next_check= pep_clock_ms() + (uint64_t)credentials->reload_interval * 1000;
+    return credentials;
+}
+
+pep_error_t pep_credentials_reload(pep_credentials_t * credentials) {
+    int rc;
+    if (credentials == NULL) {
+        pep_log_error("pep_credentials_reload: NULL credentials.");
+        return PEP_ERR_NULL_POINTER;
+    }
+    pthread_mutex_lock(&(credentials->lock));
+    rc= credentials_changed(credentials) ? credentials_reload(credentials) : 0;
+    pthread_mutex_unlock(&(credentials->lock));
+    return (rc == 0) ? PEP_OK : PEP_ERR_OPTION_INVALID;
+}
+
+#ifdef CREDENTIALS_BLOB
+static CURLcode credentials_setblob(CURL * curl, CURLoption option, pep_buffer_t * buffer) {
+    struct curl_blob blob;
+    blob.data= (void *)pep_buffer_data(buffer);
+    blob.len= pep_buffer_length(buffer);
+    /* the handles keep their copy across a reload */
+    blob.flags= CURL_BLOB_COPY;
+    return curl_easy_setopt(curl,option,&blob);
+}
+#endif
+
+int pep_credentials_apply(pep_credentials_t * credentials, CURL * curl, unsigned long * generation) {
+    CURLcode curl_rc= CURLE_OK;
+    uint64_t now;
+    if (credentials == NULL || curl == NULL) return -1;
+    pthread_mutex_lock(&(credentials->lock));
+    if (credentials->reload_interval > 0) {
+        now= pep_clock_ms();
+        if (now >= credentials->next_check) {
+            credentials->next_check= now + (uint64_t)credentials->reload_interval * 1000;
+            if (credentials_changed(credentials)) {
+                pep_log_info("pep_credentials: credential files changed, reloading.");
+                /* on error the loaded credentials are kept */
+                credentials_reload(credentials);
+            }
+        }
+    }
+    if (*generation == credentials->generation) {
+        pthread_mutex_unlock(&(credentials->lock));
+        return 0;
+    }
+#ifdef CREDENTIALS_BLOB
+    if (curl_rc == CURLE_OK && credentials->cert != NULL) {
+        curl_rc= credentials_setblob(curl,CURLOPT_SSLCERT_BLOB,credentials->cert);
+    }
+    if (curl_rc == CURLE_OK && credentials->key != NULL) {
+        curl_rc= credentials_setblob(curl,CURLOPT_SSLKEY_BLOB,credentials->key);
+    }
+    if (curl_rc == CURLE_OK && credentials->keypassword != NULL) {
+        curl_rc= curl_easy_setopt(curl,CURLOPT_KEYPASSWD,credentials->keypassword);
+    }
+    if (curl_rc == CURLE_OK && credentials->ca != NULL) {
+        curl_rc= credentials_setblob(curl,CURLOPT_CAINFO_BLOB,credentials->ca);
+        /* no more CA file or directory to read for each connection */
+        if (curl_rc == CURLE_OK) curl_rc= curl_easy_setopt(curl,CURLOPT_CAINFO,NULL);
+        if (curl_rc == CURLE_OK) curl_rc= curl_easy_setopt(curl,CURLOPT_CAPATH,NULL);
+    }
+#else
+    curl_rc= CURLE_NOT_BUILT_IN;
+#endif
+    if (curl_rc == CURLE_OK) {
+        *generation= credentials->generation;
+    }
+    pthread_mutex_unlock(&(credentials->lock));
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_credentials: can't set the credentials on the curl handle: %s.",curl_easy_strerror(curl_rc));
+        return -1;
+    }
+    return 0;
+}
+
+void pep_credentials_unapply(CURL * curl) {
+#ifdef CREDENTIALS_BLOB
+    char * cainfo= NULL;
+    curl_easy_setopt(curl,CURLOPT_SSLCERT_BLOB,NULL);
+    curl_easy_setopt(curl,CURLOPT_SSLKEY_BLOB,NULL);
+    curl_easy_setopt(curl,CURLOPT_KEYPASSWD,NULL);
+    curl_easy_setopt(curl,CURLOPT_CAINFO_BLOB,NULL);
+#if LIBCURL_VERSION_NUM >= 0x075400
+    /* restore the built-in CA bundle */
+    if (curl_easy_getinfo(curl,CURLINFO_CAINFO,&cainfo) == CURLE_OK && cainfo != NULL) {
+        curl_easy_setopt(curl,CURLOPT_CAINFO,cainfo);
+    }
+#endif
+#endif
+}
+
+void pep_credentials_attach(pep_credentials_t * credentials, int delta) {
+    if (credentials == NULL) return;
+    pthread_mutex_lock(&(credentials->lock));
+    credentials->handles += delta;
+    pthread_mutex_unlock(&(credentials->lock));
+}
+
+void pep_credentials_destroy(pep_credentials_t * credentials) {
+    int i, handles;
+    if (credentials == NULL) return;
+    pthread_mutex_lock(&(credentials->lock));
+    handles= credentials->handles;
+    pthread_mutex_unlock(&(credentials->lock));
+    if (handles > 0) {
+        /* still used by a PEP handle */
+        pep_log_error("pep_credentials_destroy: credentials still used by %d PEP handles.",handles);
+        return;
+    }
+    for (i= 0; i < CREDENTIALS_FILES; i++) {
+        if (credentials->paths[i] != NULL) free(credentials->paths[i]);
+    }
+    if (credentials->keypassword != NULL) {
+        memset(credentials->keypassword,'\0',strlen(credentials->keypassword));
+        free(credentials->keypassword);
+    }
+    if (credentials->cert != NULL) pep_buffer_delete(credentials->cert);
+    credentials_deletekey(credentials->key);
+    if (credentials->ca != NULL) pep_buffer_delete(credentials->ca);
+    pthread_mutex_destroy(&(credentials->lock));
+    free(credentials);
+}
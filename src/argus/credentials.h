@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: TLS credentials loaded in memory, shared among PEP handles
+ *
+ * $Id$
+ */
+#ifndef _PEP_CREDENTIALS_H_
+#define _PEP_CREDENTIALS_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <curl/curl.h>
+
+#include "pep.h"
+
+/**
+ * Sets the in-memory credentials on the easy handle, if the handle doesn't have their
+ * current generation yet. The credential files are checked for changes, and reloaded,
+ * when the reload interval elapsed.
+ *
+ * @param generation the credentials generation of the easy handle, 0 for a new handle.
+ *        Updated on success.
+ *
+ * @return 0 on success or -1 if the credentials can't be set.
+ */
+int pep_credentials_apply(pep_credentials_t * credentials, CURL * curl, unsigned long * generation);
+
+/**
+ * Removes the in-memory credentials from the easy handle.
+ */
+void pep_credentials_unapply(CURL * curl);
+
+/**
+ * Counts a PEP handle using the credentials, or no more using them (delta -1).
+ */
+void pep_credentials_attach(pep_credentials_t * credentials, int delta);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
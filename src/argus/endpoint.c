@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+/* pthread with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* from ../util */
+#include "clock.h"
+#include "log.h"
+
+#include "endpoint.h"
+
+/** weight of the last sample in the moving averages */
+#define ENDPOINT_EWMA_WEIGHT 0.2
+/** delay before retrying a failed endpoint, doubled for each consecutive failure */
+#define ENDPOINT_RETRY_DELAY_MS 1000
+#define ENDPOINT_RETRY_DELAY_MAX_MS 30000
+/** number of latency samples kept for the percentile */
+#define ENDPOINT_SAMPLES 64
+/** minimum number of samples for a meaningful percentile */
+#define ENDPOINT_SAMPLES_MIN 16
+/** maximum number of probe requests in flight to a half-open endpoint */
+#define ENDPOINT_CIRCUIT_PROBES 2
+
+/** circuit breaker states */
+typedef enum {
+    CIRCUIT_CLOSED= 0, /* requests are sent */
+    CIRCUIT_OPEN, /* requests are not sent */
+    CIRCUIT_HALF_OPEN /* a few probe requests are sent */
+} circuit_state_t;
+
+typedef struct pep_endpoint {
+    char * url;
+    char * target; /* url requested, see pep_endpoint_parseurl */
+    char * socket; /* Unix domain socket path, or NULL */
+    double latency; /* moving average latency in ms, 0 if unknown */
+    double errors; /* moving average error rate [0..1] */
+    int failures; /* consecutive failures */
+    uint64_t retry_time; /* time (ms) before which the endpoint is not selected */
+    unsigned long samples[ENDPOINT_SAMPLES]; /* ring of the last latencies (us) */
+    int samples_l; /* number of samples, at most ENDPOINT_SAMPLES */
+    int samples_pos; /* next sample position */
+    circuit_state_t circuit;
+    uint64_t circuit_time; /* time (ms) the circuit opened, or the last probe was sent */
+    int probes; /* probe requests in flight */
+} pep_endpoint_t;
+
+struct pep_endpoints {
+    pthread_mutex_t lock;
+    int length;
+    int circuit_threshold; /* consecutive failures opening a circuit, 0 if disabled */
+    uint64_t circuit_open_ms;
+    pep_endpoint_t endpoints[PEP_ENDPOINTS_MAX];
+};
+
+pep_endpoints_t * pep_endpoints_create(void) {
+    pep_endpoints_t * endpoints= calloc(1,sizeof(struct pep_endpoints));
+    if (endpoints == NULL) {
+        pep_log_error("pep_endpoints_create: can't allocate pep_endpoints_t.");
+        return NULL;
+    }
+    pthread_mutex_init(&(endpoints->lock),NULL);
+    return endpoints;
+}
+
+char * pep_endpoint_parseurl(const char * url, char ** socket) {
+    const char * path;
+    char * target;
+    size_t socket_l;
+    *socket= NULL;
+    if (url == NULL) return NULL;
+    if (strncmp(url,PEP_ENDPOINT_UNIX_SCHEME,strlen(PEP_ENDPOINT_UNIX_SCHEME)) != 0) {
+        target= calloc(strlen(url) + 1,sizeof(char));
+        if (target != NULL) strcpy(target,url);
+        return target;
+    }
+    /* unix://<socket path>[:<http path>] */
+    url += strlen(PEP_ENDPOINT_UNIX_SCHEME);
+    path= strstr(url,":/");
+    socket_l= (path != NULL) ? (size_t)(path - url) : strlen(url);
+    path= (path != NULL) ? path + 1 : PEP_ENDPOINT_UNIX_PATH;
+    if (socket_l == 0) {
+        pep_log_error("pep_endpoint_parseurl: no socket path in url: %s%s.",PEP_ENDPOINT_UNIX_SCHEME,url);
+        return NULL;
+    }
+    *socket= calloc(socket_l + 1,sizeof(char));
+    target= calloc(strlen("http://localhost") + strlen(path) + 1,sizeof(char));
+    if (*socket == NULL || target == NULL) {
+        free(*socket);
+        *socket= NULL;
+        free(target);
+        return NULL;
+    }
+    strncpy(*socket,url,socket_l);
+    strcpy(target,"http://localhost");
+    strcat(target,path);
+    return target;
+}
+
+int pep_endpoints_add(pep_endpoints_t * endpoints, const char * url) {
+    char * url_copy, * target, * socket;
+    size_t url_l;
+    int i, rc;
+    if (endpoints == NULL || url == NULL) {
+        pep_log_error("pep_endpoints_add: NULL endpoints or url pointer.");
+        return PEP_ENDPOINT_ERROR;
+    }
+    url_l= strlen(url);
+    url_copy= calloc(url_l + 1,sizeof(char));
+    if (url_copy == NULL) {
+        pep_log_error("pep_endpoints_add: can't allocate url: %s.",url);
+        return PEP_ENDPOINT_ERROR;
+    }
+    memcpy(url_copy,url,url_l + 1);
+    target= pep_endpoint_parseurl(url,&socket);
+    if (target == NULL) {
+        pep_log_error("pep_endpoints_add: invalid url: %s.",url);
+        free(url_copy);
+        return PEP_ENDPOINT_ERROR;
+    }
+    pthread_mutex_lock(&(endpoints->lock));
+    for (i= 0; i < endpoints->length; i++) {
+        if (strcmp(endpoints->endpoints[i].url,url) == 0) {
+            break;
+        }
+    }
+    if (i < endpoints->length || endpoints->length >= PEP_ENDPOINTS_MAX) {
+        rc= (i < endpoints->length) ? PEP_ENDPOINT_OK : PEP_ENDPOINT_ERROR;
+        pthread_mutex_unlock(&(endpoints->lock));
+        if (rc == PEP_ENDPOINT_OK) {
+            pep_log_debug("pep_endpoints_add: endpoint %s already present.",url);
+        }
+        else {
+            pep_log_error("pep_endpoints_add: maximum number of endpoints (%d) reached, can't add %s.",PEP_ENDPOINTS_MAX,url);
+        }
+        free(url_copy);
+        free(target);
+        free(socket);
+        return rc;
+    }
+    memset(&(endpoints->endpoints[endpoints->length]),0,sizeof(pep_endpoint_t));
+    endpoints->endpoints[endpoints->length].url= url_copy;
+    endpoints->endpoints[endpoints->length].target= target;
+    endpoints->endpoints[endpoints->length].socket= socket;
+    endpoints->length++;
+    pthread_mutex_unlock(&(endpoints->lock));
+    return PEP_ENDPOINT_OK;
+}
+
+size_t pep_endpoints_length(const pep_endpoints_t * endpoints) {
+    if (endpoints == NULL) return 0;
+    return (size_t)endpoints->length;
+}
+
+const char * pep_endpoints_geturl(const pep_endpoints_t * endpoints, int i) {
+    if (endpoints == NULL || i < 0 || i >= endpoints->length) return NULL;
+    return endpoints->endpoints[i].url;
+}
+
+const char * pep_endpoints_gettarget(const pep_endpoints_t * endpoints, int i, const char ** socket) {
+    *socket= NULL;
+    if (endpoints == NULL || i < 0 || i >= endpoints->length) return NULL;
+    *socket= endpoints->endpoints[i].socket;
+    return endpoints->endpoints[i].target;
+}
+
+void pep_endpoints_setcircuit(pep_endpoints_t * endpoints, int threshold, unsigned long open_ms) {
+    int i;
+    if (endpoints == NULL) return;
+    pthread_mutex_lock(&(endpoints->lock));
+    endpoints->circuit_threshold= (threshold > 0) ? threshold : 0;
+    endpoints->circuit_open_ms= (uint64_t)open_ms;
+    if (endpoints->circuit_threshold == 0) {
+        for (i= 0; i < endpoints->length; i++) {
+            endpoints->endpoints[i].circuit= CIRCUIT_CLOSED;
+            endpoints->endpoints[i].probes= 0;
+        }
+    }
+    pthread_mutex_unlock(&(endpoints->lock));
+}
+
+/*
+ * Returns the circuit state of the endpoint, after the open time an open circuit
+ * becomes half-open. Probes not answered within the open time (e.g. cancelled
+ * transfers) are forgotten. Called with the lock held.
+ */
+static circuit_state_t endpoint_circuit(const pep_endpoints_t * endpoints, pep_endpoint_t * endpoint, uint64_t now) {
+    int elapsed= now >= endpoint->circuit_time + endpoints->circuit_open_ms;
+    if (endpoint->circuit == CIRCUIT_OPEN && elapsed) {
+        endpoint->circuit= CIRCUIT_HALF_OPEN;
+        endpoint->probes= 0;
+    }
+    else if (endpoint->circuit == CIRCUIT_HALF_OPEN && endpoint->probes >= ENDPOINT_CIRCUIT_PROBES && elapsed) {
+        endpoint->probes= 0;
+    }
+    return endpoint->circuit;
+}
+
+/*
+ * The score is the moving average latency, increased by the moving average error
+ * rate. An unknown latency scores 0, so new endpoints are probed first.
+ */
+static double endpoint_score(const pep_endpoint_t * endpoint) {
+    return endpoint->latency * (1.0 + 4.0 * endpoint->errors);
+}
+
+int pep_endpoints_select(pep_endpoints_t * endpoints, unsigned long tried) {
+    int i, selected= -1, selected_retrying= 0, probe= -1, open= 0;
+    double selected_score= 0.0;
+    uint64_t now;
+    if (endpoints == NULL) return -1;
+    now= pep_clock_ms();
+    pthread_mutex_lock(&(endpoints->lock));
+    for (i= 0; i < endpoints->length; i++) {
+        pep_endpoint_t * endpoint= &(endpoints->endpoints[i]);
+        int retrying= endpoint->retry_time > now;
+        double score= endpoint_score(endpoint);
+        circuit_state_t circuit;
+        if (tried & (1UL << i)) continue;
+        circuit= endpoint_circuit(endpoints,endpoint,now);
+        if (circuit == CIRCUIT_OPEN || (circuit == CIRCUIT_HALF_OPEN && endpoint->probes >= ENDPOINT_CIRCUIT_PROBES)) {
+            open++;
+            continue;
+        }
+        /* probe a half-open endpoint first, it would never recover otherwise */
+        if (circuit == CIRCUIT_HALF_OPEN && probe == -1) {
+            probe= i;
+        }
+        /* a failed endpoint is only selected if all others failed too */
+        if (selected == -1
+            || (selected_retrying && !retrying)
+            || (selected_retrying == retrying && score < selected_score)) {
+            selected= i;
+            selected_score= score;
+            selected_retrying= retrying;
+        }
+    }
+    if (probe != -1) {
+        selected= probe;
+        endpoints->endpoints[probe].probes++;
+        endpoints->endpoints[probe].circuit_time= now;
+    }
+    pthread_mutex_unlock(&(endpoints->lock));
+    if (probe != -1) {
+        pep_log_info("pep_endpoints_select: endpoint %s circuit half-open, sending probe request.",endpoints->endpoints[probe].url);
+    }
+    if (selected == -1 && open > 0) {
+        return PEP_ENDPOINT_CIRCUIT_OPEN;
+    }
+    return selected;
+}
+
+void pep_endpoints_success(pep_endpoints_t * endpoints, int i, unsigned long latency_us) {
+    pep_endpoint_t * endpoint;
+    double latency= (double)latency_us / 1000.0;
+    int closed;
+    if (endpoints == NULL || i < 0 || i >= endpoints->length) return;
+    pthread_mutex_lock(&(endpoints->lock));
+    endpoint= &(endpoints->endpoints[i]);
+    if (endpoint->latency == 0.0) {
+        endpoint->latency= latency;
+    }
+    else {
+        endpoint->latency += ENDPOINT_EWMA_WEIGHT * (latency - endpoint->latency);
+    }
+    endpoint->samples[endpoint->samples_pos]= latency_us;
+    endpoint->samples_pos= (endpoint->samples_pos + 1) % ENDPOINT_SAMPLES;
+    if (endpoint->samples_l < ENDPOINT_SAMPLES) {
+        endpoint->samples_l++;
+    }
+    endpoint->errors -= ENDPOINT_EWMA_WEIGHT * endpoint->errors;
+    endpoint->failures= 0;
+    endpoint->retry_time= 0;
+    closed= endpoint->circuit != CIRCUIT_CLOSED;
+    endpoint->circuit= CIRCUIT_CLOSED;
+    endpoint->probes= 0;
+    pthread_mutex_unlock(&(endpoints->lock));
+    if (closed) {
+        pep_log_info("pep_endpoints_success: endpoint %s recovered, circuit closed.",endpoint->url);
+    }
+}
+
+unsigned long pep_endpoints_p95(pep_endpoints_t * endpoints, int i) {
+    unsigned long sorted[ENDPOINT_SAMPLES];
+    int j, k, samples_l;
+    if (endpoints == NULL || i < 0 || i >= endpoints->length) return 0;
+    pthread_mutex_lock(&(endpoints->lock));
+    samples_l= endpoints->endpoints[i].samples_l;
+    memcpy(sorted,endpoints->endpoints[i].samples,samples_l * sizeof(unsigned long));
+    pthread_mutex_unlock(&(endpoints->lock));
+    if (samples_l < ENDPOINT_SAMPLES_MIN) return 0;
+    /* insertion sort, the ring is small */
+    for (j= 1; j < samples_l; j++) {
+        unsigned long sample= sorted[j];
+        for (k= j; k > 0 && sorted[k - 1] > sample; k--) {
+            sorted[k]= sorted[k - 1];
+        }
+        sorted[k]= sample;
+    }
+    return sorted[(samples_l * 95 - 1) / 100];
+}
+
+void pep_endpoints_failure(pep_endpoints_t * endpoints, int i) {
+    pep_endpoint_t * endpoint;
+    uint64_t delay= ENDPOINT_RETRY_DELAY_MS, now;
+    int j, failures, opened= 0;
+    if (endpoints == NULL || i < 0 || i >= endpoints->length) return;
+    pthread_mutex_lock(&(endpoints->lock));
+    endpoint= &(endpoints->endpoints[i]);
+    endpoint->errors += ENDPOINT_EWMA_WEIGHT * (1.0 - endpoint->errors);
+    endpoint->failures++;
+    for (j= 1; j < endpoint->failures && delay < ENDPOINT_RETRY_DELAY_MAX_MS; j++) {
+        delay *= 2;
+    }
+    if (delay > ENDPOINT_RETRY_DELAY_MAX_MS) {
+        delay= ENDPOINT_RETRY_DELAY_MAX_MS;
+    }
+    now= pep_clock_ms();
+    endpoint->retry_time= now + delay;
+    failures= endpoint->failures;
+    /* a failed probe, or too many failures, opens the circuit */
+    if (endpoint->circuit == CIRCUIT_HALF_OPEN
+        || (endpoint->circuit == CIRCUIT_CLOSED && endpoints->circuit_threshold > 0 && failures >= endpoints->circuit_threshold)) {
+        endpoint->circuit= CIRCUIT_OPEN;
+        endpoint->circuit_time= now;
+        endpoint->probes= 0;
+        opened= 1;
+    }
+    pthread_mutex_unlock(&(endpoints->lock));
+    pep_log_warn("pep_endpoints_failure: endpoint %s failed %d times, retry in %d ms.",endpoint->url,failures,(int)delay);
+    if (opened) {
+        pep_log_warn("pep_endpoints_failure: endpoint %s circuit open for %d ms.",endpoint->url,(int)(endpoints->circuit_open_ms));
+    }
+}
+
+void pep_endpoints_delete(pep_endpoints_t * endpoints) {
+    int i;
+    if (endpoints == NULL) return;
+    for (i= 0; i < endpoints->length; i++) {
+        free(endpoints->endpoints[i].url);
+        free(endpoints->endpoints[i].target);
+        free(endpoints->endpoints[i].socket);
+    }
+    pthread_mutex_destroy(&(endpoints->lock));
+    free(endpoints);
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: PEP daemon endpoints and their health
+ *
+ * $Id$
+ */
+#ifndef _PEP_ENDPOINT_H_
+#define _PEP_ENDPOINT_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* size_t */
+
+/** maximum number of endpoints */
+#define PEP_ENDPOINTS_MAX 32
+
+/** endpoint return codes */
+#define PEP_ENDPOINT_OK      0
+#define PEP_ENDPOINT_ERROR  -1
+
+/** scheme of the endpoints reached over a Unix domain socket, and their default HTTP path */
+#define PEP_ENDPOINT_UNIX_SCHEME "unix://"
+#define PEP_ENDPOINT_UNIX_PATH "/authz"
+
+/** pep_endpoints_select return code: the endpoints not yet tried have their circuit open */
+#define PEP_ENDPOINT_CIRCUIT_OPEN -2
+
+/**
+ * ADT endpoints type.
+ *
+ * Each endpoint keeps a running health score: the exponentially weighted moving
+ * averages of its latency and of its error rate. An endpoint which just failed is
+ * only selected again after a retry delay, unless all others are failing too.
+ *
+ * With the circuit breaker enabled, the circuit of an endpoint opens after a number
+ * of consecutive failures: the endpoint is not selected at all. After the open time,
+ * the circuit is half-open: a few probe requests are let through, the first success
+ * closes the circuit and a failure opens it again.
+ * The functions are thread-safe.
+ */
+typedef struct pep_endpoints pep_endpoints_t;
+
+/**
+ * Creates an empty endpoints list.
+ *
+ * @return a pointer to the new list or NULL if an error occurs.
+ */
+pep_endpoints_t * pep_endpoints_create(void);
+
+/**
+ * Parses an endpoint url. An url unix://<socket path>[:<http path>] is requested as
+ * http://localhost<http path> (default PEP_ENDPOINT_UNIX_PATH) over the Unix domain
+ * socket, other urls are requested as is.
+ *
+ * @param url the endpoint url.
+ * @param socket set to the allocated socket path, or NULL if not a unix:// url.
+ *
+ * @return the allocated url to request, or NULL if the url is invalid or an error occurs.
+ */
+char * pep_endpoint_parseurl(const char * url, char ** socket);
+
+/**
+ * Adds a copy of the url to the endpoints, if not already present.
+ *
+ * @return PEP_ENDPOINT_OK or PEP_ENDPOINT_ERROR if the url can't be added.
+ */
+int pep_endpoints_add(pep_endpoints_t * endpoints, const char * url);
+
+/**
+ * Returns the number of endpoints.
+ */
+size_t pep_endpoints_length(const pep_endpoints_t * endpoints);
+
+/**
+ * Returns the url of the i-th endpoint or NULL.
+ */
+const char * pep_endpoints_geturl(const pep_endpoints_t * endpoints, int i);
+
+/**
+ * Returns the url to request for the i-th endpoint (see pep_endpoint_parseurl) or NULL,
+ * and sets socket to its Unix domain socket path or NULL.
+ */
+const char * pep_endpoints_gettarget(const pep_endpoints_t * endpoints, int i, const char ** socket);
+
+/**
+ * Enables the circuit breaker.
+ *
+ * @param endpoints pointer to the endpoints.
+ * @param threshold number of consecutive failures opening the circuit of an endpoint, 0 to disable.
+ * @param open_ms time in milliseconds the circuit stays open before probing the endpoint.
+ */
+void pep_endpoints_setcircuit(pep_endpoints_t * endpoints, int threshold, unsigned long open_ms);
+
+/**
+ * Selects the healthiest endpoint not yet tried. An endpoint with its circuit open is
+ * skipped, and an endpoint with its circuit half-open is selected for a probe request.
+ *
+ * @param endpoints pointer to the endpoints.
+ * @param tried bitmask of the endpoints already tried (bit i for the i-th endpoint).
+ *
+ * @return the index of the selected endpoint, -1 if all were tried, or
+ *         PEP_ENDPOINT_CIRCUIT_OPEN if the endpoints not yet tried have their circuit open.
+ */
+int pep_endpoints_select(pep_endpoints_t * endpoints, unsigned long tried);
+
+/**
+ * Records a successful request to the i-th endpoint and its latency in microseconds.
+ */
+void pep_endpoints_success(pep_endpoints_t * endpoints, int i, unsigned long latency_us);
+
+/**
+ * Returns the 95th percentile of the last successful request latencies of the
+ * i-th endpoint, in microseconds.
+ *
+ * @return the latency percentile or 0 if not enough requests were recorded.
+ */
+unsigned long pep_endpoints_p95(pep_endpoints_t * endpoints, int i);
+
+/**
+ * Records a failed request to the i-th endpoint.
+ */
+void pep_endpoints_failure(pep_endpoints_t * endpoints, int i);
+
+/**
+ * Deletes the endpoints.
+ */
+void pep_endpoints_delete(pep_endpoints_t * endpoints);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
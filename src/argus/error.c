@@ -38,6 +38,10 @@ typedef enum {
     PEP_ERR_MARSHALLING_IO,
     PEP_ERR_UNMARSHALLING_HESSIAN,
     PEP_ERR_UNMARSHALLING_IO,
+    PEP_ERR_CANCELLED,
+    PEP_ERR_TIMEOUT,
+    PEP_ERR_CIRCUIT_OPEN,
+    PEP_ERR_SIDECAR,
     PEP_ERR_CURL                    = 1024,
 } pep_error_t;
 */
@@ -86,6 +90,18 @@ const char * pep_strerror(pep_error_t pep_errno) {
     case PEP_ERR_UNMARSHALLING_IO:
         return "Unmarshalling IO error";
         
+    case PEP_ERR_CANCELLED:
+        return "Authorization cancelled";
+        
+    case PEP_ERR_TIMEOUT:
+        return "Authorization deadline exceeded";
+        
+    case PEP_ERR_CIRCUIT_OPEN:
+        return "Endpoints circuit breaker open";
+        
+    case PEP_ERR_SIDECAR:
+        return "Sidecar daemon communication failed";
+        
     default:
         /* should be PEP_ERR_CURL. curl_easy_strerror returns "Unkown error" if no match */
         return curl_easy_strerror(pep_errno - PEP_ERR_CURL);
@@ -71,6 +71,10 @@ typedef enum {
     PEP_ERR_MARSHALLING_IO, /**< IO error in pep_authorize(pep_request_t **,pep_response_t **) */
     PEP_ERR_UNMARSHALLING_HESSIAN, /**< Hessian unmarshalling error in pep_authorize(pep_request_t **,pep_response_t **) */
     PEP_ERR_UNMARSHALLING_IO, /**< IO error in pep_authorize(pep_request_t **,pep_response_t **) */
+    PEP_ERR_CANCELLED, /**< Asynchronous authorization cancelled by pep_async_cancel(PEP *,const xacml_request_t *) or pep_async_drain(PEP *,int) */
+    PEP_ERR_TIMEOUT, /**< Authorization deadline exceeded in pep_authorize_ex(PEP *,xacml_request_t **,xacml_response_t **,int) */
+    PEP_ERR_CIRCUIT_OPEN, /**< Request not sent, the circuit breaker of all the endpoints is open in pep_authorize(pep_request_t **,pep_response_t **) */
+    PEP_ERR_SIDECAR, /**< Sidecar daemon unreachable or invalid sidecar response in pep_authorize(pep_request_t **,pep_response_t **) */
     PEP_ERR_CURL = 1024 /**< Any CURL error (MUST BE LAST OF ENUM)*/
 } pep_error_t;
 
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+/* pthread and clock_gettime with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+/* from ../util */
+#include "buffer.h"
+#include "log.h"
+
+#include "cache.h" /* pep_cache_hash */
+#include "flight.h"
+
+struct pep_flight {
+    uint64_t hash;
+    void * key;
+    size_t key_l;
+    int refs; /* leader and followers */
+    int landed;
+    pep_error_t rc;
+    void * response; /* response copy for the followers */
+    size_t response_l;
+    pthread_cond_t landing;
+    struct pep_flight * next;
+};
+
+/*
+ * The flights are in a list: there are at most as many flights as
+ * concurrent pep_authorize() calls, bounded by the session pool size.
+ */
+struct pep_flights {
+    pthread_mutex_t lock;
+    pep_flight_t * head;
+};
+
+static void flight_delete(pep_flight_t * flight) {
+    pthread_cond_destroy(&(flight->landing));
+    free(flight->key);
+    free(flight->response);
+    free(flight);
+}
+
+pep_flights_t * pep_flights_create(void) {
+    pep_flights_t * flights= calloc(1,sizeof(struct pep_flights));
+    if (flights == NULL) {
+        pep_log_error("pep_flights_create: can't allocate pep_flights_t.");
+        return NULL;
+    }
+    pthread_mutex_init(&(flights->lock),NULL);
+    return flights;
+}
+
+int pep_flights_join(pep_flights_t * flights, const void * key, size_t key_l, pep_flight_t ** flight) {
+    pep_flight_t * current, * created;
+    uint64_t hash;
+    if (flights == NULL || key == NULL || flight == NULL) {
+        pep_log_error("pep_flights_join: NULL flights, key or flight pointer.");
+        return PEP_FLIGHT_ERROR;
+    }
+    hash= pep_cache_hash(key,key_l);
+    /* allocated before the lookup: the lookup and the insertion are atomic */
+    created= calloc(1,sizeof(pep_flight_t));
+    if (created == NULL) {
+        pep_log_error("pep_flights_join: can't allocate pep_flight_t.");
+        return PEP_FLIGHT_ERROR;
+    }
+    created->key= malloc(key_l);
+    if (created->key == NULL) {
+        pep_log_error("pep_flights_join: can't allocate %d bytes key.",(int)key_l);
+        free(created);
+        return PEP_FLIGHT_ERROR;
+    }
+    memcpy(created->key,key,key_l);
+    created->key_l= key_l;
+    created->hash= hash;
+    created->refs= 1;
+    pthread_mutex_lock(&(flights->lock));
+    for (current= flights->head; current != NULL; current= current->next) {
+        if (current->hash == hash && current->key_l == key_l && memcmp(current->key,key,key_l) == 0) {
+            current->refs++;
+            pthread_mutex_unlock(&(flights->lock));
+            free(created->key);
+            free(created);
+            *flight= current;
+            return PEP_FLIGHT_FOLLOWER;
+        }
+    }
+    /* start a new flight */
+    pthread_cond_init(&(created->landing),NULL);
+    created->next= flights->head;
+    flights->head= created;
+    pthread_mutex_unlock(&(flights->lock));
+    *flight= created;
+    return PEP_FLIGHT_LEADER;
+}
+
+void pep_flights_land(pep_flights_t * flights, pep_flight_t * flight, pep_error_t rc, const void * response, size_t response_l) {
+    pep_flight_t ** prev;
+    void * copy= NULL;
+    int followers;
+    if (flights == NULL || flight == NULL) return;
+    /* unlinked, the flight can't be joined anymore */
+    pthread_mutex_lock(&(flights->lock));
+    for (prev= &(flights->head); *prev != NULL; prev= &((*prev)->next)) {
+        if (*prev == flight) {
+            *prev= flight->next;
+            break;
+        }
+    }
+    followers= flight->refs - 1;
+    pthread_mutex_unlock(&(flights->lock));
+    /* copy the response outside the lock */
+    if (followers > 0 && rc == PEP_OK) {
+        copy= malloc(response_l > 0 ? response_l : 1);
+        if (copy == NULL) {
+            pep_log_error("pep_flights_land: can't allocate %d bytes response copy.",(int)response_l);
+            rc= PEP_ERR_MEMORY;
+        }
+        else {
+            memcpy(copy,response,response_l);
+        }
+    }
+    pthread_mutex_lock(&(flights->lock));
+    flight->rc= rc;
+    flight->response= copy;
+    flight->response_l= response_l;
+    flight->landed= 1;
+    flight->refs--;
+    followers= flight->refs;
+    pthread_cond_broadcast(&(flight->landing));
+    pthread_mutex_unlock(&(flights->lock));
+    if (followers == 0) {
+        flight_delete(flight);
+    }
+}
+
+pep_error_t pep_flights_wait(pep_flights_t * flights, pep_flight_t * flight, pep_buffer_t * response, long timeout_ms) {
+    struct timespec deadline;
+    pep_error_t rc= PEP_ERR_TIMEOUT;
+    int refs;
+    if (flights == NULL || flight == NULL || response == NULL) {
+        pep_log_error("pep_flights_wait: NULL flights, flight or response pointer.");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_REALTIME,&deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    pthread_mutex_lock(&(flights->lock));
+    while (!flight->landed) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&(flight->landing),&(flights->lock));
+        }
+        else if (pthread_cond_timedwait(&(flight->landing),&(flights->lock),&deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (flight->landed) {
+        rc= flight->rc;
+        if (rc == PEP_OK && pep_buffer_write(flight->response,sizeof(char),flight->response_l,response) != flight->response_l) {
+            pep_log_error("pep_flights_wait: can't copy %d bytes response.",(int)flight->response_l);
+            rc= PEP_ERR_MEMORY;
+        }
+    }
+    flight->refs--;
+    refs= flight->refs;
+    pthread_mutex_unlock(&(flights->lock));
+    /* the last follower of a landed flight deletes it */
+    if (refs == 0) {
+        flight_delete(flight);
+    }
+    return rc;
+}
+
+void pep_flights_delete(pep_flights_t * flights) {
+    if (flights == NULL) return;
+    pthread_mutex_destroy(&(flights->lock));
+    free(flights);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: single-flight of identical concurrent requests
+ *
+ * $Id$
+ */
+#ifndef _PEP_FLIGHT_H_
+#define _PEP_FLIGHT_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* size_t */
+
+#include "pep.h"
+#include "buffer.h" /* ../util/buffer.h */
+
+/** pep_flights_join return codes */
+#define PEP_FLIGHT_ERROR    -1
+#define PEP_FLIGHT_LEADER    1
+#define PEP_FLIGHT_FOLLOWER  2
+
+/**
+ * ADT in flight requests type.
+ *
+ * The first caller with a given serialized Hessian request (key) leads the flight:
+ * it sends the request and lands the flight with the serialized Hessian response.
+ * The callers joining the flight meanwhile follow it: they wait for a copy of the
+ * response instead of sending the same request. The functions are thread-safe.
+ */
+typedef struct pep_flights pep_flights_t;
+
+/**
+ * ADT request in flight type.
+ */
+typedef struct pep_flight pep_flight_t;
+
+/**
+ * Creates an empty in flight requests table.
+ *
+ * @return a pointer to the new table or NULL if an error occurs.
+ */
+pep_flights_t * pep_flights_create(void);
+
+/**
+ * Joins the flight of the key, or starts a new one.
+ *
+ * @param flights pointer to the table.
+ * @param key the serialized request.
+ * @param key_l the key length.
+ * @param flight set to the joined or started flight.
+ *
+ * @return PEP_FLIGHT_LEADER if the flight was started and must be landed with
+ *         pep_flights_land(), PEP_FLIGHT_FOLLOWER if a flight was joined and must be
+ *         waited for with pep_flights_wait(), or PEP_FLIGHT_ERROR.
+ */
+int pep_flights_join(pep_flights_t * flights, const void * key, size_t key_l, pep_flight_t ** flight);
+
+/**
+ * Lands a started flight: its followers get a copy of the response, or the error code.
+ * The flight must not be used afterward.
+ *
+ * @param flights pointer to the table.
+ * @param flight the flight started by the caller.
+ * @param rc PEP_OK or the error code of the request.
+ * @param response the serialized response, if rc is PEP_OK.
+ * @param response_l the response length.
+ */
+void pep_flights_land(pep_flights_t * flights, pep_flight_t * flight, pep_error_t rc, const void * response, size_t response_l);
+
+/**
+ * Waits for a joined flight to land, and writes the response copy into the buffer.
+ * The flight must not be used afterward.
+ *
+ * @param flights pointer to the table.
+ * @param flight the flight joined by the caller.
+ * @param response the buffer receiving the response copy.
+ * @param timeout_ms maximum wait in milliseconds, negative to wait without limit.
+ *
+ * @return PEP_OK, PEP_ERR_TIMEOUT if the flight did not land in time, or the
+ *         error code of the flight.
+ */
+pep_error_t pep_flights_wait(pep_flights_t * flights, pep_flight_t * flight, pep_buffer_t * response, long timeout_ms);
+
+/**
+ * Deletes the table, no flight must be in progress.
+ */
+void pep_flights_delete(pep_flights_t * flights);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
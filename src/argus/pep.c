@@ -18,6 +18,7 @@
 /* $Id$ */
 
 #include <stdarg.h>  /* va_list, va_arg, ... */
+#include <stdio.h>   /* SEEK_SET */
 #include <string.h>
 #include <stdlib.h>
 #include <curl/curl.h>
@@ -26,11 +27,23 @@
 #include "linkedlist.h"
 #include "buffer.h"
 #include "base64.h"
+#include "gzip.h"
 #include "log.h"
+#include "clock.h"
 
 #include "pep.h"
 #include "io.h"
 #include "error.h"
+#include "cache.h"
+#include "session.h"
+#include "async.h"
+#include "endpoint.h"
+#include "flight.h"
+#include "shmcache.h"
+#include "sidecar.h"
+#include "share.h"
+#include "credentials.h"
+#include "stats.h"
 
 
 #ifdef HAVE_CONFIG_H
@@ -50,6 +63,28 @@ static const int    DEFAULT_LOG_LEVEL= PEP_LOGLEVEL_NONE;
 static const FILE * DEFAULT_LOG_FILE= NULL;
 static const int    DEFAULT_PIPS_ENABLED= TRUE;
 static const int    DEFAULT_OHS_ENABLED= TRUE;
+static const int    DEFAULT_CACHE_ENABLED= FALSE;
+static const long   DEFAULT_CACHE_TTL= 60L;
+static const size_t DEFAULT_CACHE_MAX_SIZE= 4L * 1024L * 1024L;
+static const pep_cache_admission_t DEFAULT_CACHE_ADMISSION= PEP_CACHE_ADMISSION_ALWAYS;
+static const int    DEFAULT_HEDGE_DELAY= 0;
+static const int    DEFAULT_HEDGE_ADAPTIVE= FALSE;
+static const pep_http_version_t DEFAULT_HTTP_VERSION= PEP_HTTP_VERSION_DEFAULT;
+static const int    DEFAULT_TCP_NODELAY= TRUE;
+static const int    DEFAULT_TCP_KEEPALIVE= 0;
+static const int    DEFAULT_TCP_FASTOPEN= FALSE;
+static const pep_wire_encoding_t DEFAULT_WIRE_ENCODING= PEP_WIRE_ENCODING_BASE64;
+static const int    DEFAULT_COMPRESSION= FALSE;
+static const int    DEFAULT_COMPRESSION_THRESHOLD= 1024;
+static const int    DEFAULT_CIRCUIT_THRESHOLD= 0;
+static const int    DEFAULT_CIRCUIT_OPEN_TIME= 5000;
+static const int    DEFAULT_SINGLE_FLIGHT= FALSE;
+static const size_t DEFAULT_SHM_CACHE_SIZE= 16L * 1024L * 1024L;
+/* content type of the raw Hessian requests and responses */
+#define HESSIAN_CONTENT_TYPE "application/x-hessian"
+/* http headers lists index flags */
+#define HTTP_HEADERS_BINARY 1
+#define HTTP_HEADERS_GZIP   2
 /* default SSL cipher without ECDH: OpenSSL 1.0 bug */
 /*
 static const char * DEFAULT_SSL_CIPHER_LIST= "DEFAULT:-ECDH";
@@ -60,7 +95,12 @@ static void init_pep_defaults(PEP * pep);
 static void init_curl_defaults(PEP * pep);
 /* static void init_log_defaults(const PEP * pep); */
 static int set_curl_endpoint_url(const PEP * pep);
+static CURLcode set_curl_url(CURL * curl, const char * url, const char * socket);
 static int set_curl_connection_timeout(const PEP * pep);
+static int set_curl_connect_timeout(const PEP * pep);
+static long get_transfer_timeout_ms(const PEP * pep);
+static int set_session_timeouts(const PEP * pep, pep_session_t * session);
+static void clear_session_deadline(const PEP * pep, pep_session_t * session);
 static int set_curl_ssl_validation(const PEP * pep);
 static int set_curl_ssl_cipher_list(const PEP * pep);
 static int set_curl_server_cert(const PEP * pep);
@@ -68,11 +108,48 @@ static int set_curl_server_capath(const PEP * pep);
 static int set_curl_client_cert(const PEP * pep);
 static int set_curl_client_key(const PEP * pep);
 static int set_curl_client_keypassword(const PEP * pep);
+static void set_curl_credential_files(const PEP * pep);
 static int set_curl_verbose(const PEP * pep);
 static int set_curl_stderr(const PEP * pep);
 static int set_curl_nosignal(const PEP * pep);
 static int set_curl_http_headers(PEP * pep);
+static struct curl_slist * get_curl_http_headers(PEP * pep, int gzip);
+static void free_curl_http_headers(PEP * pep);
+static int set_curl_accept_encoding(const PEP * pep);
 static int set_curl_ssl_option_allow_beast(PEP * pep);
+static int set_curl_http_version(const PEP * pep);
+static int set_curl_share(const PEP * pep);
+static int set_curl_tcp_nodelay(const PEP * pep);
+static int set_curl_tcp_keepalive(const PEP * pep);
+static int set_curl_tcp_fastopen(const PEP * pep);
+static pep_error_t pep_warmup_session(PEP * pep, pep_session_t * session, int endpoint);
+static pep_error_t pep_authorize_session(PEP * pep, pep_session_t * session, xacml_request_t ** request, xacml_response_t ** response);
+static pep_error_t pep_authorize_prepare(PEP * pep, pep_session_t * session, xacml_request_t ** request, int * cacheable, int * cache_rc);
+static pep_error_t pep_authorize_setup(PEP * pep, pep_session_t * session);
+static pep_error_t pep_authorize_exchange(PEP * pep, pep_session_t * session, int * cacheable);
+static pep_error_t pep_authorize_send(PEP * pep, pep_session_t * session);
+static void pep_authorize_lookup(PEP * pep, pep_session_t * session, int cacheable, int * cache_rc);
+static void pep_authorize_store(PEP * pep, pep_session_t * session, const xacml_request_t * request, const xacml_response_t * response);
+static pep_error_t pep_authorize_received(PEP * pep, pep_session_t * session);
+static pep_error_t pep_authorize_complete(PEP * pep, pep_session_t * session, xacml_request_t ** request, xacml_response_t ** response, int cacheable, int cache_rc);
+static pep_error_t pep_authorize_finish(PEP * pep, pep_session_t * session, xacml_request_t ** request, xacml_response_t ** response, int cacheable, int cache_rc);
+static pep_error_t pep_authorize_batch_session(PEP * pep, pep_session_t * session, xacml_request_t ** requests, size_t n, xacml_response_t ** responses);
+static pep_error_t pep_authorize_batch_send(PEP * pep, pep_session_t * session);
+static void pep_batch_write_requests(pep_buffer_t * output, pep_session_t * requests_sessions, const int * cache_rcs, size_t n, size_t sent_l);
+static pep_error_t pep_batch_read_list(PEP * pep, pep_buffer_t * input);
+static pep_error_t pep_sidecar_authorize_session(PEP * pep, pep_session_t * session, pep_buffer_t * request, pep_buffer_t * response);
+static pep_error_t pep_sidecar_batch_session(PEP * pep, pep_session_t * session, pep_buffer_t ** requests, pep_buffer_t ** responses, pep_error_t * rcs, size_t n);
+static void pep_sidecar_store(PEP * pep, pep_session_t * session, pep_buffer_t * input);
+static void pep_async_deliver(PEP * pep, pep_async_transfer_t * transfer);
+static int pep_endpoint_next(PEP * pep, pep_session_t * session);
+static pep_error_t pep_endpoint_hedged(PEP * pep, pep_session_t * session);
+static pep_error_t pep_endpoint_done(PEP * pep, pep_session_t * session, pep_error_t transfer_rc);
+static int is_response_cacheable(const PEP * pep, const xacml_request_t * request, const xacml_response_t * response);
+static void pep_trace_begin(PEP * pep, pep_session_t * session);
+static void pep_trace_close(PEP * pep, pep_session_t * session, pep_error_t rc);
+static void * pep_trace_start(PEP * pep, const pep_session_t * session, pep_trace_phase_t phase);
+static void pep_trace_end(PEP * pep, void * span, pep_trace_phase_t phase, pep_error_t rc);
+static void pep_trace_transfer_end(PEP * pep, pep_session_t * session, const char * endpoint, int performed, pep_error_t transfer_rc, pep_error_t rc);
 
 /** 
 * ADT for PEP client handle.
@@ -83,14 +160,19 @@ static int set_curl_ssl_option_allow_beast(PEP * pep);
 struct pep_handle {
     int id;
     CURL * curl;
-    struct curl_slist * curl_http_headers;
+    struct curl_slist * curl_http_headers[4]; /* indexed by HTTP_HEADERS_BINARY | HTTP_HEADERS_GZIP */
     pep_linkedlist_t * pips;
     pep_linkedlist_t * ohs;
-    char * option_endpoint_url; /* current url */
-    pep_linkedlist_t * option_endpoint_urls; /* urls list */
+    char * option_endpoint_url; /* first endpoint url */
+    pep_endpoints_t * endpoints; /* endpoint urls and health */
+    char * option_batch_endpoint_url; /* batch url */
     int option_loglevel;
     FILE * option_logout;
     long option_timeout; 
+    long option_connect_timeout_ms; /* 0 for the libcurl default */
+    long option_transfer_timeout_ms; /* 0 to use option_timeout */
+    int option_circuit_threshold; /* consecutive failures, 0 if disabled */
+    int option_circuit_open_time; /* ms */
     char * option_server_cert;
     char * option_server_capath;
     char * option_client_cert;
@@ -100,11 +182,36 @@ struct pep_handle {
     char * option_ssl_cipher_list;
     int option_pips_enabled;
     int option_ohs_enabled;
-    // temporary buffers for pep_authorize
-    pep_buffer_t * output;
-    pep_buffer_t * b64output;
-    pep_buffer_t * input;
-    pep_buffer_t * b64input;
+    int option_cache_enabled;
+    long option_cache_ttl;
+    size_t option_cache_max_size;
+    pep_cache_admission_t option_cache_admission;
+    pep_linkedlist_t * option_cache_uncacheable_obligations; /* obligation ids */
+    pep_cache_filter_callback * option_cache_filter;
+    pep_cache_t * cache;
+    int option_session_pool_size;
+    pep_session_t session; /* single-threaded session, uses the curl handle */
+    pep_session_pool_t * pool; /* shared handle session pool, or NULL */
+    unsigned long generation; /* curl handle options generation */
+    pep_async_t * async; /* asynchronous authorizations, or NULL */
+    int option_hedge_delay; /* ms, 0 if hedging is disabled */
+    int option_hedge_adaptive;
+    pep_http_version_t option_http_version;
+    pep_share_t * option_share;
+    pep_credentials_t * option_credentials; /* in-memory TLS credentials, or NULL */
+    pep_metrics_t metrics; /* updated atomically, see pep_getstats and pep_metrics_write */
+    pep_tracer_t option_tracer; /* start callback NULL if no tracer */
+    int option_tcp_nodelay;
+    int option_tcp_keepalive; /* seconds, 0 if disabled */
+    int option_tcp_fastopen;
+    pep_wire_encoding_t option_wire_encoding;
+    int option_compression;
+    int option_compression_threshold; /* bytes */
+    int option_single_flight;
+    pep_flights_t * flights; /* requests in flight, or NULL */
+    size_t option_shm_cache_size;
+    pep_shmcache_t * shmcache; /* shared memory decision cache, or NULL */
+    char * option_sidecar_socket; /* sidecar daemon socket path, or NULL */
 };
 
 /* GLOBAL NOT THREAD SAFE FUNCTION */
@@ -145,11 +252,22 @@ PEP * pep_initialize(void) {
     }
     /* set default CURL options */
     init_curl_defaults(pep);
+    if (pep->curl_http_headers[HTTP_HEADERS_BINARY | HTTP_HEADERS_GZIP] == NULL) {
+        pep_log_error("pep_initialize: curl http headers allocation failed.");
+        free_curl_http_headers(pep);
+        curl_easy_cleanup(pep->curl);
+        free(pep);
+        return NULL;
+    }
+    /* the single-threaded session uses the handle curl session */
+    pep->session.curl= pep->curl;
+    pep->session.owned= FALSE;
         
     /* create all required lists */
     pep->pips= pep_llist_create();
     if (pep->pips == NULL) {
         pep_log_error("pep_initialize: PIPs list allocation failed.");
+        free_curl_http_headers(pep);
         curl_easy_cleanup(pep->curl);
         free(pep);
         return NULL;
@@ -157,18 +275,32 @@ PEP * pep_initialize(void) {
     pep->ohs= pep_llist_create();
     if (pep->ohs == NULL) {
         pep_log_error("pep_initialize: OHs list allocation failed.");
+        free_curl_http_headers(pep);
         curl_easy_cleanup(pep->curl);
         pep_llist_delete(pep->pips);
         free(pep);
         return NULL;
     }
     
-    pep->option_endpoint_urls= pep_llist_create();
-    if (pep->option_endpoint_urls == NULL) {
-        pep_log_error("pep_initialize: endpoint URLs list allocation failed.");
+    pep->endpoints= pep_endpoints_create();
+    if (pep->endpoints == NULL) {
+        pep_log_error("pep_initialize: endpoints allocation failed.");
+        free_curl_http_headers(pep);
+        curl_easy_cleanup(pep->curl);
+        pep_llist_delete(pep->pips);
+        pep_llist_delete(pep->ohs);
+        free(pep);
+        return NULL;
+    }
+
+    pep->option_cache_uncacheable_obligations= pep_llist_create();
+    if (pep->option_cache_uncacheable_obligations == NULL) {
+        pep_log_error("pep_initialize: uncacheable obligations list allocation failed.");
+        free_curl_http_headers(pep);
         curl_easy_cleanup(pep->curl);
         pep_llist_delete(pep->pips);
         pep_llist_delete(pep->ohs);
+        pep_endpoints_delete(pep->endpoints);
         free(pep);
         return NULL;
     }
@@ -232,9 +364,14 @@ pep_error_t pep_setoption(PEP * pep, pep_option_t option, ... ) {
     pep_error_t rc= PEP_OK;
     va_list args;
     char * str= NULL;
+    char * str_copy= NULL;
     size_t str_l= 0;
     int value= -1;
+    long lvalue= -1L;
     FILE * file= NULL;
+    pep_credentials_t * credentials= NULL, * previous= NULL;
+    unsigned long generation= 0;
+    const pep_tracer_t * tracer= NULL;
     pep_log_handler_callback * log_handler= NULL;
     if (pep == NULL) {
         pep_log_error("pep_setoption: NULL pep handle");
@@ -249,11 +386,25 @@ pep_error_t pep_setoption(PEP * pep, pep_option_t option, ... ) {
                 rc= PEP_ERR_OPTION_INVALID;
                 break;
             }
-            /* copy url */
+#if LIBCURL_VERSION_NUM < 0x072800
+            if (strncmp(str,PEP_ENDPOINT_UNIX_SCHEME,strlen(PEP_ENDPOINT_UNIX_SCHEME)) == 0) {
+                pep_log_error("pep_setoption: PEP#%d unix:// endpoint requires libcurl >= 7.40: %s.",pep->id,str);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+#endif
+            /* add url to the endpoints */
+            if (pep_endpoints_add(pep->endpoints,str) != PEP_ENDPOINT_OK) {
+                pep_log_error("pep_setoption: PEP#%d can't add endpoint: %s.",pep->id,str);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            /* the first url is the default one */
             if (pep->option_endpoint_url != NULL) { 
-                pep_log_debug("pep_setoption: PEP#%d option_endpoint_url already set to '%s', freeing...",pep->id,pep->option_endpoint_url);
-                free(pep->option_endpoint_url); 
+                pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_ENDPOINT_URL: %s (%d endpoints)",pep->id,str,(int)pep_endpoints_length(pep->endpoints));
+                break;
             }
+            /* copy url */
             str_l= strlen(str);
             pep->option_endpoint_url= calloc(str_l + 1, sizeof(char));
             if (pep->option_endpoint_url == NULL) {
@@ -265,6 +416,35 @@ pep_error_t pep_setoption(PEP * pep, pep_option_t option, ... ) {
             pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_ENDPOINT_URL: %s",pep->id,pep->option_endpoint_url);
             set_curl_endpoint_url(pep);
             break;
+        case PEP_OPTION_BATCH_ENDPOINT_URL:
+            str= va_arg(args,char *);
+            if (str == NULL) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_BATCH_ENDPOINT_URL argument is NULL.", pep->id);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+#if LIBCURL_VERSION_NUM < 0x072800
+            if (strncmp(str,PEP_ENDPOINT_UNIX_SCHEME,strlen(PEP_ENDPOINT_UNIX_SCHEME)) == 0) {
+                pep_log_error("pep_setoption: PEP#%d unix:// endpoint requires libcurl >= 7.40: %s.",pep->id,str);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+#endif
+            /* copy url */
+            if (pep->option_batch_endpoint_url != NULL) { 
+                pep_log_debug("pep_setoption: PEP#%d option_batch_endpoint_url already set to '%s', freeing...",pep->id,pep->option_batch_endpoint_url);
+                free(pep->option_batch_endpoint_url); 
+            }
+            str_l= strlen(str);
+            pep->option_batch_endpoint_url= calloc(str_l + 1, sizeof(char));
+            if (pep->option_batch_endpoint_url == NULL) {
+                pep_log_error("pep_setoption: PEP#%d can't allocate option_batch_endpoint_url: %s.",pep->id,str);
+                rc= PEP_ERR_MEMORY;
+                break;
+            }
+            strncpy(pep->option_batch_endpoint_url,str,str_l);
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_BATCH_ENDPOINT_URL: %s",pep->id,pep->option_batch_endpoint_url);
+            break;
         case PEP_OPTION_ENDPOINT_TIMEOUT:
             value= va_arg(args,int);
             if (value > 0) {
@@ -273,6 +453,50 @@ pep_error_t pep_setoption(PEP * pep, pep_option_t option, ... ) {
             pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_ENDPOINT_TIMEOUT: %d",pep->id,(int)(pep->option_timeout));
             set_curl_connection_timeout(pep);
             break;
+        case PEP_OPTION_ENDPOINT_CONNECT_TIMEOUT_MS:
+            value= va_arg(args,int);
+            if (value < 0) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_ENDPOINT_CONNECT_TIMEOUT_MS invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_connect_timeout_ms= (long)value;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_ENDPOINT_CONNECT_TIMEOUT_MS: %d",pep->id,(int)(pep->option_connect_timeout_ms));
+            set_curl_connect_timeout(pep);
+            break;
+        case PEP_OPTION_ENDPOINT_TRANSFER_TIMEOUT_MS:
+            value= va_arg(args,int);
+            if (value < 0) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_ENDPOINT_TRANSFER_TIMEOUT_MS invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_transfer_timeout_ms= (long)value;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_ENDPOINT_TRANSFER_TIMEOUT_MS: %d",pep->id,(int)(pep->option_transfer_timeout_ms));
+            set_curl_connection_timeout(pep);
+            break;
+        case PEP_OPTION_CIRCUIT_BREAKER_THRESHOLD:
+            value= va_arg(args,int);
+            if (value < 0) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_CIRCUIT_BREAKER_THRESHOLD invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_circuit_threshold= value;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_CIRCUIT_BREAKER_THRESHOLD: %d",pep->id,pep->option_circuit_threshold);
+            pep_endpoints_setcircuit(pep->endpoints,pep->option_circuit_threshold,(unsigned long)pep->option_circuit_open_time);
+            break;
+        case PEP_OPTION_CIRCUIT_BREAKER_OPEN_TIME:
+            value= va_arg(args,int);
+            if (value <= 0) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_CIRCUIT_BREAKER_OPEN_TIME invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_circuit_open_time= value;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_CIRCUIT_BREAKER_OPEN_TIME: %d",pep->id,pep->option_circuit_open_time);
+            pep_endpoints_setcircuit(pep->endpoints,pep->option_circuit_threshold,(unsigned long)pep->option_circuit_open_time);
+            break;
         case PEP_OPTION_ENDPOINT_SSL_VALIDATION:
             value= va_arg(args,int);
             if (value == 1) {
@@ -444,6 +668,330 @@ pep_error_t pep_setoption(PEP * pep, pep_option_t option, ... ) {
             }
             pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_ENABLE_OBLIGATIONHANDLERS: %s",pep->id,(pep->option_ohs_enabled == TRUE) ? "TRUE" : "FALSE");
             break;
+        case PEP_OPTION_CACHE_ENABLED:
+            value= va_arg(args,int);
+            if (value == 1) {
+                pep->option_cache_enabled= TRUE;
+            }
+            else {
+                pep->option_cache_enabled= FALSE;
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_CACHE_ENABLED: %s",pep->id,(pep->option_cache_enabled == TRUE) ? "TRUE" : "FALSE");
+            if (pep->option_cache_enabled && pep->cache == NULL) {
+                pep->cache= pep_cache_create(pep->option_cache_ttl,pep->option_cache_max_size,pep->option_cache_admission);
+                if (pep->cache == NULL) {
+                    pep_log_error("pep_setoption: PEP#%d can't create decision cache.",pep->id);
+                    pep->option_cache_enabled= FALSE;
+                    rc= PEP_ERR_MEMORY;
+                }
+            }
+            break;
+        case PEP_OPTION_CACHE_TTL:
+            value= va_arg(args,int);
+            if (value > 0) {
+                pep->option_cache_ttl= (long)value;
+                pep_cache_setttl(pep->cache,pep->option_cache_ttl);
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_CACHE_TTL: %d",pep->id,(int)(pep->option_cache_ttl));
+            break;
+        case PEP_OPTION_CACHE_MAX_SIZE:
+            lvalue= va_arg(args,long);
+            if (lvalue > 0) {
+                pep->option_cache_max_size= (size_t)lvalue;
+                pep_cache_setmaxsize(pep->cache,pep->option_cache_max_size);
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_CACHE_MAX_SIZE: %ld",pep->id,(long)(pep->option_cache_max_size));
+            break;
+        case PEP_OPTION_CACHE_ADMISSION:
+            value= va_arg(args,int);
+            if (value != PEP_CACHE_ADMISSION_ALWAYS && value != PEP_CACHE_ADMISSION_SECOND_HIT) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_CACHE_ADMISSION invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_cache_admission= (pep_cache_admission_t)value;
+            pep_cache_setadmission(pep->cache,pep->option_cache_admission);
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_CACHE_ADMISSION: %d",pep->id,(int)pep->option_cache_admission);
+            break;
+        case PEP_OPTION_CACHE_UNCACHEABLE_OBLIGATION:
+            str= va_arg(args,char *);
+            if (str == NULL) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_CACHE_UNCACHEABLE_OBLIGATION argument is NULL.",pep->id);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            /* copy obligation id */
+            str_l= strlen(str);
+            str_copy= calloc(str_l + 1, sizeof(char));
+            if (str_copy == NULL) {
+                pep_log_error("pep_setoption: PEP#%d can't allocate uncacheable obligation: %s.",pep->id,str);
+                rc= PEP_ERR_MEMORY;
+                break;
+            }
+            memcpy(str_copy,str,str_l + 1);
+            if (pep_llist_add(pep->option_cache_uncacheable_obligations,str_copy) != LLIST_OK) {
+                pep_log_error("pep_setoption: PEP#%d can't add uncacheable obligation: %s.",pep->id,str);
+                free(str_copy);
+                rc= PEP_ERR_LLIST;
+                break;
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_CACHE_UNCACHEABLE_OBLIGATION: %s",pep->id,str_copy);
+            break;
+        case PEP_OPTION_CACHE_FILTER:
+            pep->option_cache_filter= va_arg(args,pep_cache_filter_callback *);
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_CACHE_FILTER: %p",pep->id,pep->option_cache_filter);
+            break;
+        case PEP_OPTION_SESSION_POOL_SIZE:
+            value= va_arg(args,int);
+            if (value < 0) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_SESSION_POOL_SIZE invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            if (pep->pool != NULL) {
+                pep_log_debug("pep_setoption: PEP#%d session pool already created (%d sessions), deleting...",pep->id,pep_session_pool_size(pep->pool));
+                pep_session_pool_delete(pep->pool);
+                pep->pool= NULL;
+            }
+            pep->option_session_pool_size= value;
+            if (value > 0) {
+                pep->pool= pep_session_pool_create(value);
+                if (pep->pool == NULL) {
+                    pep_log_error("pep_setoption: PEP#%d can't create session pool (%d sessions).",pep->id,value);
+                    pep->option_session_pool_size= 0;
+                    rc= PEP_ERR_MEMORY;
+                    break;
+                }
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_SESSION_POOL_SIZE: %d",pep->id,pep->option_session_pool_size);
+            break;
+        case PEP_OPTION_HEDGE_DELAY:
+            value= va_arg(args,int);
+            if (value < 0) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_HEDGE_DELAY invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_hedge_delay= value;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_HEDGE_DELAY: %d",pep->id,pep->option_hedge_delay);
+            break;
+        case PEP_OPTION_HEDGE_ADAPTIVE:
+            value= va_arg(args,int);
+            if (value == 0) {
+                pep->option_hedge_adaptive= FALSE;
+            }
+            else {
+                pep->option_hedge_adaptive= TRUE;
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_HEDGE_ADAPTIVE: %s",pep->id,(pep->option_hedge_adaptive == TRUE) ? "TRUE" : "FALSE");
+            break;
+        case PEP_OPTION_HTTP_VERSION:
+            value= va_arg(args,int);
+            if (value < PEP_HTTP_VERSION_DEFAULT || value > PEP_HTTP_VERSION_2_PRIOR_KNOWLEDGE) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_HTTP_VERSION invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_http_version= (pep_http_version_t)value;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_HTTP_VERSION: %d",pep->id,(int)pep->option_http_version);
+            if (set_curl_http_version(pep) != 0) {
+                pep->option_http_version= DEFAULT_HTTP_VERSION;
+                rc= PEP_ERR_OPTION_INVALID;
+            }
+            break;
+        case PEP_OPTION_SHARE:
+            pep->option_share= va_arg(args,pep_share_t *);
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_SHARE: %p",pep->id,pep->option_share);
+            if (set_curl_share(pep) != 0) {
+                pep->option_share= NULL;
+                rc= PEP_ERR_OPTION_INVALID;
+            }
+            break;
+        case PEP_OPTION_TCP_NODELAY:
+            value= va_arg(args,int);
+            if (value == 0) {
+                pep->option_tcp_nodelay= FALSE;
+            }
+            else {
+                pep->option_tcp_nodelay= TRUE;
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_TCP_NODELAY: %s",pep->id,(pep->option_tcp_nodelay == TRUE) ? "TRUE" : "FALSE");
+            set_curl_tcp_nodelay(pep);
+            break;
+        case PEP_OPTION_TCP_KEEPALIVE:
+            value= va_arg(args,int);
+            if (value < 0) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_TCP_KEEPALIVE invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_tcp_keepalive= value;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_TCP_KEEPALIVE: %d",pep->id,pep->option_tcp_keepalive);
+            if (set_curl_tcp_keepalive(pep) != 0) {
+                rc= PEP_ERR_OPTION_INVALID;
+            }
+            break;
+        case PEP_OPTION_TCP_FASTOPEN:
+            value= va_arg(args,int);
+            if (value == 0) {
+                pep->option_tcp_fastopen= FALSE;
+            }
+            else {
+                pep->option_tcp_fastopen= TRUE;
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_TCP_FASTOPEN: %s",pep->id,(pep->option_tcp_fastopen == TRUE) ? "TRUE" : "FALSE");
+            if (set_curl_tcp_fastopen(pep) != 0) {
+                pep->option_tcp_fastopen= FALSE;
+                rc= PEP_ERR_OPTION_INVALID;
+            }
+            break;
+        case PEP_OPTION_WIRE_ENCODING:
+            value= va_arg(args,int);
+            if (value < PEP_WIRE_ENCODING_BASE64 || value > PEP_WIRE_ENCODING_BINARY) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_WIRE_ENCODING invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_wire_encoding= (pep_wire_encoding_t)value;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_WIRE_ENCODING: %s",pep->id,(pep->option_wire_encoding == PEP_WIRE_ENCODING_BINARY) ? "BINARY" : "BASE64");
+            if (set_curl_http_headers(pep) != 0) {
+                rc= PEP_ERR_OPTION_INVALID;
+            }
+            /* the single-threaded session uses the template handle directly */
+            pep->session.configured= FALSE;
+            break;
+        case PEP_OPTION_COMPRESSION:
+            value= va_arg(args,int);
+            if (value == 0) {
+                pep->option_compression= FALSE;
+            }
+            else {
+                pep->option_compression= TRUE;
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_COMPRESSION: %s",pep->id,(pep->option_compression == TRUE) ? "TRUE" : "FALSE");
+            if (pep->option_compression && !pep_gzip_available()) {
+                pep_log_warn("pep_setoption: PEP#%d PEP_OPTION_COMPRESSION: library compiled without zlib, only the responses are compressed.",pep->id);
+            }
+            if (set_curl_accept_encoding(pep) != 0) {
+                pep->option_compression= FALSE;
+                rc= PEP_ERR_OPTION_INVALID;
+            }
+            /* restore the template handle headers and post fields */
+            set_curl_http_headers(pep);
+            pep->session.configured= FALSE;
+            break;
+        case PEP_OPTION_COMPRESSION_THRESHOLD:
+            value= va_arg(args,int);
+            if (value < 0) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_COMPRESSION_THRESHOLD invalid value: %d.",pep->id,value);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            pep->option_compression_threshold= value;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_COMPRESSION_THRESHOLD: %d",pep->id,pep->option_compression_threshold);
+            break;
+        case PEP_OPTION_SHM_CACHE:
+            str= va_arg(args,char *);
+            if (pep->shmcache != NULL) {
+                pep_shmcache_close(pep->shmcache);
+                pep->shmcache= NULL;
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_SHM_CACHE: %s",pep->id,(str == NULL) ? "NULL" : str);
+            if (str != NULL) {
+                pep->shmcache= pep_shmcache_open(str,pep->option_shm_cache_size);
+                if (pep->shmcache == NULL) {
+                    pep_log_error("pep_setoption: PEP#%d can't open shared memory decision cache %s.",pep->id,str);
+                    rc= PEP_ERR_OPTION_INVALID;
+                }
+            }
+            break;
+        case PEP_OPTION_SHM_CACHE_SIZE:
+            lvalue= va_arg(args,long);
+            if (lvalue > 0) {
+                pep->option_shm_cache_size= (size_t)lvalue;
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_SHM_CACHE_SIZE: %ld",pep->id,(long)pep->option_shm_cache_size);
+            break;
+        case PEP_OPTION_SINGLE_FLIGHT:
+            value= va_arg(args,int);
+            pep->option_single_flight= (value == 1) ? TRUE : FALSE;
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_SINGLE_FLIGHT: %s",pep->id,(pep->option_single_flight == TRUE) ? "TRUE" : "FALSE");
+            if (pep->option_single_flight && pep->flights == NULL) {
+                pep->flights= pep_flights_create();
+                if (pep->flights == NULL) {
+                    pep_log_error("pep_setoption: PEP#%d can't create in flight requests table.",pep->id);
+                    pep->option_single_flight= FALSE;
+                    rc= PEP_ERR_MEMORY;
+                }
+            }
+            break;
+        case PEP_OPTION_SIDECAR_SOCKET:
+            str= va_arg(args,char *);
+            if (pep->option_sidecar_socket != NULL) {
+                free(pep->option_sidecar_socket);
+                pep->option_sidecar_socket= NULL;
+            }
+            if (str != NULL) {
+                str_l= strlen(str);
+                pep->option_sidecar_socket= calloc(str_l + 1, sizeof(char));
+                if (pep->option_sidecar_socket == NULL) {
+                    pep_log_error("pep_setoption: PEP#%d can't allocate option_sidecar_socket: %s.",pep->id,str);
+                    rc= PEP_ERR_MEMORY;
+                    break;
+                }
+                strncpy(pep->option_sidecar_socket,str,str_l);
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_SIDECAR_SOCKET: %s",pep->id,(str == NULL) ? "NULL" : str);
+            break;
+        case PEP_OPTION_CREDENTIALS:
+            credentials= va_arg(args,pep_credentials_t *);
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_CREDENTIALS: %p",pep->id,credentials);
+            if (credentials == pep->option_credentials) {
+                break;
+            }
+            /* the new credentials replace the previous ones only if they can be applied */
+            previous= pep->option_credentials;
+            generation= 0;
+            pep_credentials_unapply(pep->curl);
+            if (credentials != NULL && pep_credentials_apply(credentials,pep->curl,&generation) != 0) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_CREDENTIALS can't be applied, previous credentials kept.",pep->id);
+                /* restore the previous credentials, or the credential files options */
+                pep_credentials_unapply(pep->curl);
+                pep->session.credentials_generation= 0;
+                if (previous == NULL || pep_credentials_apply(previous,pep->curl,&(pep->session.credentials_generation)) != 0) {
+                    set_curl_credential_files(pep);
+                }
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            if (credentials != NULL) {
+                pep_credentials_attach(credentials,1);
+            }
+            if (previous != NULL) {
+                pep_credentials_attach(previous,-1);
+            }
+            pep->option_credentials= credentials;
+            pep->session.credentials_generation= generation;
+            if (credentials == NULL) {
+                /* back to the credential files options */
+                set_curl_credential_files(pep);
+            }
+            break;
+        case PEP_OPTION_TRACER:
+            tracer= va_arg(args,const pep_tracer_t *);
+            if (tracer != NULL && (tracer->start == NULL || tracer->end == NULL)) {
+                pep_log_error("pep_setoption: PEP#%d PEP_OPTION_TRACER start and end callbacks required.",pep->id);
+                rc= PEP_ERR_OPTION_INVALID;
+                break;
+            }
+            if (tracer == NULL) {
+                memset(&(pep->option_tracer),0,sizeof(pep_tracer_t));
+            }
+            else {
+                pep->option_tracer= *tracer;
+            }
+            pep_log_debug("pep_setoption: PEP#%d PEP_OPTION_TRACER: %p",pep->id,tracer);
+            break;
         case PEP_OPTION_LOG_LEVEL:
             value= va_arg(args,int);
             if (PEP_LOGLEVEL_NONE <= value && value <= PEP_LOGLEVEL_DEBUG) {
@@ -471,188 +1019,1321 @@ pep_error_t pep_setoption(PEP * pep, pep_option_t option, ... ) {
             break;
     }
     va_end(args);
+    /* pooled sessions must duplicate the curl handle again */
+    pep->generation++;
     return rc;
 }
 
 
 pep_error_t pep_authorize(PEP * pep, xacml_request_t ** request, xacml_response_t ** response) {
-    int i= 0;
-    int pip_rc, oh_rc;
-    //pep_buffer_t * output, * b64output, * b64input, * input;
-    size_t output_l, b64output_l;
-    pep_error_t marshal_rc, unmarshal_rc;
-    CURLcode curl_rc;
-    long http_code= 0;
-    xacml_request_t * effective_request;
+    return pep_authorize_ex(pep,request,response,0);
+}
+
+pep_error_t pep_authorize_ex(PEP * pep, xacml_request_t ** request, xacml_response_t ** response, int timeout_ms) {
+    pep_session_t * session;
+    pep_error_t rc;
+    uint64_t deadline= 0;
     if (pep == NULL) {
         pep_log_error("pep_authorize: NULL pep handle");
         return PEP_ERR_NULL_POINTER;
     }
-    if (pep->option_endpoint_url == NULL) {
-        pep_log_error("pep_authorize: NULL mandatory option PEP_OPTION_ENDPOINT_URL");
+    if (pep->option_endpoint_url == NULL && pep->option_sidecar_socket == NULL) {
+        pep_log_error("pep_authorize: NULL mandatory option PEP_OPTION_ENDPOINT_URL or PEP_OPTION_SIDECAR_SOCKET");
         return PEP_ERR_NULL_POINTER;
     }
     if (request == NULL || *request == NULL) {
         pep_log_error("pep_authorize: PEP#%d NULL request pointer",pep->id);
         return PEP_ERR_NULL_POINTER;
     }
-    
-    /* apply pips if enabled and any */
-    if (pep->option_pips_enabled && pep_llist_length(pep->pips) > 0) {
-        size_t pips_l= pep_llist_length(pep->pips);
-        pep_log_info("pep_authorize: PEP#%d %d PIPs available, processing...",pep->id, (int)pips_l);
-        for (i= 0; i<pips_l; i++) {
-            pep_pip_t * pip= pep_llist_get(pep->pips,i);
-            if (pip != NULL) {
-                pep_log_debug("pep_authorize: PEP#%d calling pip[%s]->process(request)...",pep->id,pip->id);
-                pip_rc= pip->process(request);
-                if (pip_rc != 0) {
-                    pep_log_error("pep_authorize: PIP[%s] process(request) failed: %d", pip->id, pip_rc);
-                    return PEP_ERR_PIP_PROCESS;
-                }
-            }
+    if (timeout_ms > 0) {
+        deadline= pep_clock_ms() + (uint64_t)timeout_ms;
+    }
+
+    /* single-threaded handle: use the handle own session */
+    if (pep->pool == NULL) {
+        pep->session.deadline= deadline;
+        pep_trace_begin(pep,&(pep->session));
+        rc= pep_authorize_session(pep,&(pep->session),request,response);
+        pep_trace_close(pep,&(pep->session),rc);
+        if (deadline != 0) {
+            clear_session_deadline(pep,&(pep->session));
         }
+        pep_stats_result(&(pep->metrics),rc,(response != NULL) ? *response : NULL);
+        return rc;
     }
 
-    /* marshal the authorization request into output buffer */
-    pep->output= pep_buffer_create(512);
-    if (pep->output == NULL) {
-        pep_log_error("pep_authorize: PEP#%d can't create output buffer (512 bytes).",pep->id);
+    /* shared handle: lease a session from the pool */
+    session= pep_session_pool_lease(pep->pool,pep->curl,pep->generation);
+    if (session == NULL) {
+        pep_log_error("pep_authorize: PEP#%d can't lease a session from the pool.",pep->id);
+        pep_stats_result(&(pep->metrics),PEP_ERR_MEMORY,NULL);
         return PEP_ERR_MEMORY;
     }
-    marshal_rc= xacml_request_marshalling(*request,pep->output);
-    if ( marshal_rc != PEP_OK ) {
-        pep_log_error("pep_authorize: PEP#%d can't marshal XACML request: %s.",pep->id,pep_strerror(marshal_rc));
-        pep_buffer_delete(pep->output);
-        return marshal_rc;
+    session->deadline= deadline;
+    pep_trace_begin(pep,session);
+    rc= pep_authorize_session(pep,session,request,response);
+    pep_trace_close(pep,session,rc);
+    if (deadline != 0) {
+        clear_session_deadline(pep,session);
     }
+    pep_session_pool_release(pep->pool,session);
+    pep_stats_result(&(pep->metrics),rc,(response != NULL) ? *response : NULL);
+    return rc;
+}
 
-    /* base64 encode the output buffer */
-    output_l= pep_buffer_length(pep->output);
-    pep->b64output= pep_buffer_create( output_l );
-    if (pep->b64output == NULL) {
-        pep_log_error("pep_authorize: PEP#%d can't create base64 output buffer (%d bytes).",pep->id,(int)output_l);
-        pep_buffer_delete(pep->output);
-        return PEP_ERR_MEMORY;
+pep_error_t pep_authorize_batch(PEP * pep, xacml_request_t ** requests, size_t n, xacml_response_t ** responses) {
+    pep_session_t * session;
+    pep_error_t rc;
+    int i;
+    if (pep == NULL) {
+        pep_log_error("pep_authorize_batch: NULL pep handle");
+        return PEP_ERR_NULL_POINTER;
     }
-    
-    pep_log_debug("pep_authorize: PEP#%d: encoding base64 output...",pep->id);
-    pep_base64_encode_buffer_l(pep->output,pep->b64output,BASE64_DEFAULT_LINE_SIZE);
-
-    /* output buffer not needed anymore. */
-    pep_buffer_delete(pep->output);
-
-    /* configure curl handler to POST the base64 encoded marshalled PEP request buffer */
-    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_POST, 1L);
-    if (curl_rc != CURLE_OK) {
-        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_POST,1) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
-        pep_buffer_delete(pep->b64output);
-        return PEP_ERR_CURL + curl_rc;
+    if (pep->option_endpoint_url == NULL && pep->option_sidecar_socket == NULL) {
+        pep_log_error("pep_authorize_batch: NULL mandatory option PEP_OPTION_ENDPOINT_URL or PEP_OPTION_SIDECAR_SOCKET");
+        return PEP_ERR_NULL_POINTER;
     }
-    b64output_l= pep_buffer_length(pep->b64output);
-    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_POSTFIELDSIZE, (long)b64output_l);
-    if (curl_rc != CURLE_OK) {
-        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_POSTFIELDSIZE,%d) failed: %s.",pep->id,(int)b64output_l,curl_easy_strerror(curl_rc));
-        pep_buffer_delete(pep->b64output);
-        return PEP_ERR_CURL + curl_rc;
+    if (requests == NULL || responses == NULL) {
+        pep_log_error("pep_authorize_batch: PEP#%d NULL requests or responses array",pep->id);
+        return PEP_ERR_NULL_POINTER;
     }
-
-    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_READDATA, pep->b64output);
-    if (curl_rc != CURLE_OK) {
-        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_READDATA,b64output) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
-        pep_buffer_delete(pep->b64output);
-        return PEP_ERR_CURL + curl_rc;
+    for (i= 0; i < n; i++) {
+        responses[i]= NULL;
+        if (requests[i] == NULL) {
+            pep_log_error("pep_authorize_batch: PEP#%d NULL request pointer at: %d",pep->id,i);
+            return PEP_ERR_NULL_POINTER;
+        }
     }
-
-    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_READFUNCTION, pep_buffer_read);
-    if (curl_rc != CURLE_OK) {
-        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_READFUNCTION,buffer_read) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
-        pep_buffer_delete(pep->b64output);
-        return PEP_ERR_CURL + curl_rc;
+    if (n == 0) {
+        return PEP_OK;
     }
 
-
-    /* configure curl handler to read the base64 encoded HTTP response */
-    pep->b64input= pep_buffer_create(1024);
-    if (pep->b64input == NULL) {
-        pep_log_error("pep_authorize: PEP#%d can't create base64 input buffer.",pep->id);
-        pep_buffer_delete(pep->b64output);
-        return PEP_ERR_MEMORY;
+    /* single-threaded handle: use the handle own session */
+    if (pep->pool == NULL) {
+        pep_trace_begin(pep,&(pep->session));
+        rc= pep_authorize_batch_session(pep,&(pep->session),requests,n,responses);
+        pep_trace_close(pep,&(pep->session),rc);
     }
-
-    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_WRITEDATA, pep->b64input);
-    if (curl_rc != CURLE_OK) {
-        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_WRITEDATA,b64input) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
-        pep_buffer_delete(pep->b64output);
-        pep_buffer_delete(pep->b64input);
-        return PEP_ERR_CURL + curl_rc;
+    else {
+        /* shared handle: lease a session from the pool */
+        session= pep_session_pool_lease(pep->pool,pep->curl,pep->generation);
+        if (session == NULL) {
+            pep_log_error("pep_authorize_batch: PEP#%d can't lease a session from the pool.",pep->id);
+            rc= PEP_ERR_MEMORY;
+        }
+        else {
+            pep_trace_begin(pep,session);
+            rc= pep_authorize_batch_session(pep,session,requests,n,responses);
+            pep_trace_close(pep,session,rc);
+            pep_session_pool_release(pep->pool,session);
+        }
     }
-    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_WRITEFUNCTION, pep_buffer_write);
-    if (curl_rc != CURLE_OK) {
-        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_WRITEFUNCTION,buffer_write) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
-        pep_buffer_delete(pep->b64output);
-        pep_buffer_delete(pep->b64input);
-        return PEP_ERR_CURL + curl_rc;
+    /* the requests without response failed with the batch, or without session */
+    for (i= 0; i < n; i++) {
+        pep_stats_result(&(pep->metrics),(responses[i] != NULL) ? PEP_OK : rc,responses[i]);
     }
+    return rc;
+}
 
+pep_error_t pep_authorize_async(PEP * pep, xacml_request_t * request, pep_authorize_callback * callback, void * userdata) {
+    pep_async_transfer_t * transfer;
+    pep_error_t rc;
+    int next;
+    if (pep == NULL) {
+        pep_log_error("pep_authorize_async: NULL pep handle");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (pep->option_endpoint_url == NULL) {
+        pep_log_error("pep_authorize_async: NULL mandatory option PEP_OPTION_ENDPOINT_URL");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (request == NULL) {
+        pep_log_error("pep_authorize_async: PEP#%d NULL request pointer",pep->id);
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (callback == NULL) {
+        pep_log_error("pep_authorize_async: PEP#%d NULL callback pointer",pep->id);
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (pep->async == NULL) {
+        pep->async= pep_async_create();
+        if (pep->async == NULL) {
+            pep_log_error("pep_authorize_async: PEP#%d can't create asynchronous context.",pep->id);
+            return PEP_ERR_MEMORY;
+        }
+    }
+    transfer= pep_async_transfer_create(pep->async,pep->curl,pep->generation);
+    if (transfer == NULL) {
+        pep_log_error("pep_authorize_async: PEP#%d can't create asynchronous transfer.",pep->id);
+        return PEP_ERR_MEMORY;
+    }
+    transfer->request= request;
+    transfer->submitted= request;
+    transfer->callback= callback;
+    transfer->userdata= userdata;
+    transfer->rc= PEP_OK;
+    pep_trace_begin(pep,&(transfer->session));
+
+    /* 
+     * from now on, the PIPs can replace the request: the errors are reported 
+     * to the callback with the current request 
+     */
+    rc= pep_authorize_prepare(pep,&(transfer->session),&(transfer->request),&(transfer->cacheable),&(transfer->cache_rc));
+    if (rc == PEP_OK && transfer->cache_rc != PEP_CACHE_HIT) {
+        rc= pep_authorize_setup(pep,&(transfer->session));
+        if (rc == PEP_OK) {
+            transfer->session.tried= 0;
+            next= pep_endpoint_next(pep,&(transfer->session));
+            if (next >= 0 && pep_async_start(pep->async,transfer) == 0) {
+                return PEP_OK;
+            }
+            rc= (next == PEP_ENDPOINT_CIRCUIT_OPEN) ? PEP_ERR_CIRCUIT_OPEN : PEP_ERR_AUTHZ_REQUEST;
+        }
+    }
+    /* not sent */
+    transfer->session.tried= 0;
+    transfer->rc= rc;
+    pep_async_ready(pep->async,transfer);
+    return PEP_OK;
+}
+
+pep_error_t pep_async_poll(PEP * pep, int timeout_ms, int * running) {
+    pep_async_transfer_t * transfer;
+    size_t ready_l;
+    if (pep == NULL) {
+        pep_log_error("pep_async_poll: NULL pep handle");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (pep->async == NULL) {
+        if (running != NULL) *running= 0;
+        return PEP_OK;
+    }
+    if (pep_async_perform(pep->async,timeout_ms) != 0) {
+        pep_log_error("pep_async_poll: PEP#%d performing asynchronous transfers failed.",pep->id);
+        return PEP_ERR_AUTHZ_REQUEST;
+    }
+    /* only the transfers completed so far, the callbacks can submit new requests */
+    ready_l= pep_async_readylength(pep->async);
+    while (ready_l-- > 0 && (transfer= pep_async_next(pep->async)) != NULL) {
+        pep_async_deliver(pep,transfer);
+    }
+    if (running != NULL) {
+        *running= (int)pep_async_length(pep->async);
+    }
+    return PEP_OK;
+}
+
+pep_error_t pep_async_cancel(PEP * pep, const xacml_request_t * request) {
+    pep_async_transfer_t * transfer;
+    if (pep == NULL) {
+        pep_log_error("pep_async_cancel: NULL pep handle");
+        return PEP_ERR_NULL_POINTER;
+    }
+    transfer= pep_async_find(pep->async,request);
+    if (transfer == NULL) {
+        pep_log_warn("pep_async_cancel: PEP#%d request %p is not pending.",pep->id,request);
+        return PEP_ERR_NULL_POINTER;
+    }
+    pep_log_info("pep_async_cancel: PEP#%d cancelling request %p.",pep->id,request);
+    pep_async_remove(pep->async,transfer);
+    transfer->rc= PEP_ERR_CANCELLED;
+    pep_async_deliver(pep,transfer);
+    return PEP_OK;
+}
+
+pep_error_t pep_async_drain(PEP * pep, int timeout_ms) {
+    pep_async_transfer_t * transfer;
+    uint64_t deadline= 0, now;
+    int running= 0;
+    pep_error_t rc= PEP_OK;
+    if (pep == NULL) {
+        pep_log_error("pep_async_drain: NULL pep handle");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (pep->async == NULL) {
+        return PEP_OK;
+    }
+    if (timeout_ms > 0) {
+        deadline= pep_clock_ms() + (uint64_t)timeout_ms;
+    }
+    /* wait for the pending authorizations */
+    while (timeout_ms != 0 && pep_async_length(pep->async) > 0) {
+        int wait_ms= 1000;
+        if (timeout_ms > 0) {
+            now= pep_clock_ms();
+            if (now >= deadline) break;
+            if (deadline - now < (uint64_t)wait_ms) wait_ms= (int)(deadline - now);
+        }
+        rc= pep_async_poll(pep,wait_ms,&running);
+        if (rc != PEP_OK) break;
+    }
+    /* and cancel the remaining ones */
+    if (pep_async_length(pep->async) > 0) {
+        pep_log_info("pep_async_drain: PEP#%d cancelling %d pending requests.",pep->id,(int)pep_async_length(pep->async));
+    }
+    while ((transfer= pep_async_next(pep->async)) != NULL) {
+        pep_async_deliver(pep,transfer);
+    }
+    while ((transfer= pep_async_first(pep->async)) != NULL) {
+        pep_async_remove(pep->async,transfer);
+        transfer->rc= PEP_ERR_CANCELLED;
+        pep_async_deliver(pep,transfer);
+    }
+    return rc;
+}
+
+pep_error_t pep_getcachestats(PEP * pep, pep_cache_stats_t * stats) {
+    if (pep == NULL) {
+        pep_log_error("pep_getcachestats: NULL pep handle");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (stats == NULL) {
+        pep_log_error("pep_getcachestats: PEP#%d NULL stats pointer",pep->id);
+        return PEP_ERR_NULL_POINTER;
+    }
+    memset(stats,0,sizeof(pep_cache_stats_t));
+    if (pep->cache != NULL) {
+        pep_cache_getstats(pep->cache,stats);
+    }
+    return PEP_OK;
+}
+
+pep_error_t pep_getstats(PEP * pep, pep_stats_t * stats) {
+    if (pep == NULL) {
+        pep_log_error("pep_getstats: NULL pep handle");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (stats == NULL) {
+        pep_log_error("pep_getstats: PEP#%d NULL stats pointer",pep->id);
+        return PEP_ERR_NULL_POINTER;
+    }
+    pep_stats_copy(&(pep->metrics),stats);
+    return PEP_OK;
+}
+
+pep_error_t pep_metrics_write(PEP * pep, FILE * out) {
+    pep_cache_stats_t cache_stats;
+    if (pep == NULL) {
+        pep_log_error("pep_metrics_write: NULL pep handle");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (out == NULL) {
+        pep_log_error("pep_metrics_write: PEP#%d NULL output stream",pep->id);
+        return PEP_ERR_NULL_POINTER;
+    }
+    memset(&cache_stats,0,sizeof(pep_cache_stats_t));
+    if (pep->cache != NULL) {
+        pep_cache_getstats(pep->cache,&cache_stats);
+    }
+    if (pep_stats_write(&(pep->metrics),pep->endpoints,(pep->cache != NULL) ? &cache_stats : NULL,out) != 0) {
+        pep_log_error("pep_metrics_write: PEP#%d writing the metrics failed.",pep->id);
+        return PEP_ERR_MARSHALLING_IO;
+    }
+    return PEP_OK;
+}
+
+pep_error_t pep_warmup(PEP * pep, int nconns) {
+    pep_session_t ** sessions;
+    pep_error_t rc= PEP_OK, warmup_rc;
+    int i, j, n, opened= 0, endpoints_l;
+    if (pep == NULL) {
+        pep_log_error("pep_warmup: NULL pep handle");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (pep->option_endpoint_url == NULL) {
+        pep_log_error("pep_warmup: NULL mandatory option PEP_OPTION_ENDPOINT_URL");
+        return PEP_ERR_NULL_POINTER;
+    }
+    /* the sessions to warm up */
+    n= 1;
+    if (pep->pool != NULL) {
+        n= pep_session_pool_size(pep->pool);
+        if (nconns > 0 && nconns < n) n= nconns;
+    }
+    sessions= calloc(n,sizeof(pep_session_t *));
+    if (sessions == NULL) {
+        pep_log_error("pep_warmup: PEP#%d can't allocate %d sessions.",pep->id,n);
+        return PEP_ERR_MEMORY;
+    }
+    if (pep->pool == NULL) {
+        sessions[0]= &(pep->session);
+    }
+    else {
+        for (i= 0; i < n; i++) {
+            sessions[i]= pep_session_pool_lease(pep->pool,pep->curl,pep->generation);
+            if (sessions[i] == NULL) {
+                pep_log_error("pep_warmup: PEP#%d can't lease a session from the pool.",pep->id);
+                rc= PEP_ERR_MEMORY;
+                n= i;
+                break;
+            }
+        }
+    }
+    /* connect each session to each endpoint */
+    endpoints_l= (int)pep_endpoints_length(pep->endpoints);
+    for (i= 0; i < n; i++) {
+        for (j= 0; j < endpoints_l; j++) {
+            warmup_rc= pep_warmup_session(pep,sessions[i],j);
+            if (warmup_rc == PEP_OK) {
+                opened++;
+            }
+            else {
+                rc= warmup_rc;
+            }
+        }
+        if (pep->pool != NULL) {
+            pep_session_pool_release(pep->pool,sessions[i]);
+        }
+    }
+    free(sessions);
+    /* the single-threaded session uses the handle curl template */
+    if (pep->pool == NULL) {
+        set_curl_endpoint_url(pep);
+    }
+    pep_log_info("pep_warmup: PEP#%d %d connections opened.",pep->id,opened);
+    return (opened > 0) ? PEP_OK : rc;
+}
+
+/**
+ * Authorizes a marshalled request of a sidecar client, as a batch of one request.
+ * See sidecar.h.
+ */
+pep_error_t pep_sidecar_authorize(PEP * pep, pep_buffer_t * request, pep_buffer_t * response, int timeout_ms) {
+    return pep_sidecar_authorize_batch(pep,&request,&response,NULL,1,timeout_ms);
+}
+
+pep_error_t pep_sidecar_authorize_batch(PEP * pep, pep_buffer_t ** requests, pep_buffer_t ** responses, pep_error_t * rcs, size_t n, int timeout_ms) {
+    pep_session_t * session;
+    pep_error_t rc= PEP_OK;
+    int i;
+    if (pep == NULL || requests == NULL || responses == NULL) {
+        pep_log_error("pep_sidecar_authorize_batch: NULL pep handle, requests or responses pointer");
+        return PEP_ERR_NULL_POINTER;
+    }
+    if (pep->option_endpoint_url == NULL) {
+        pep_log_error("pep_sidecar_authorize_batch: NULL mandatory option PEP_OPTION_ENDPOINT_URL");
+        rc= PEP_ERR_NULL_POINTER;
+    }
+    if (rc == PEP_OK && n == 0) {
+        return PEP_OK;
+    }
+
+    /* single-threaded handle: use the handle own session */
+    session= &(pep->session);
+    if (rc == PEP_OK && pep->pool != NULL) {
+        session= pep_session_pool_lease(pep->pool,pep->curl,pep->generation);
+        if (session == NULL) {
+            pep_log_error("pep_sidecar_authorize_batch: PEP#%d can't lease a session from the pool.",pep->id);
+            rc= PEP_ERR_MEMORY;
+        }
+    }
+    if (rc != PEP_OK) {
+        for (i= 0; i < n && rcs != NULL; i++) {
+            rcs[i]= rc;
+        }
+        return rc;
+    }
+    if (timeout_ms > 0) {
+        session->deadline= pep_clock_ms() + (uint64_t)timeout_ms;
+    }
+
+    if (n == 1 || pep->option_batch_endpoint_url == NULL) {
+        for (i= 0; i < n; i++) {
+            pep_error_t request_rc= pep_sidecar_authorize_session(pep,session,requests[i],responses[i]);
+            if (rcs != NULL) rcs[i]= request_rc;
+            if (rc == PEP_OK) rc= request_rc;
+        }
+    }
+    else {
+        rc= pep_sidecar_batch_session(pep,session,requests,responses,rcs,n);
+    }
+
+    if (session->deadline != 0) {
+        clear_session_deadline(pep,session);
+    }
+    if (pep->pool != NULL) {
+        pep_session_pool_release(pep->pool,session);
+    }
+    return rc;
+}
+
+/* no return code, not useful */
+void pep_destroy(PEP * pep) {
+    int pips_destroy_rc= 0;
+    int ohs_destroy_rc= 0;
+    
+    if (pep == NULL) return;
+
+    /* cancel the pending asynchronous authorizations */
+    if (pep->async != NULL) {
+        pep_async_drain(pep,0);
+        pep_async_delete(pep->async);
+        pep->async= NULL;
+    }
+
+    /* release curl http headers */
+    free_curl_http_headers(pep);
+
+    /* release the single-threaded session hedge, buffers and sidecar connection */
+    pep_sidecar_disconnect(&(pep->session));
+    pep_session_deletehedge(&(pep->session));
+    pep_session_deletebuffers(&(pep->session));
+
+    /* release the session pool */
+    if (pep->pool != NULL) {
+        pep_session_pool_delete(pep->pool);
+        pep->pool= NULL;
+    }
+
+    /* release curl */
+    if (pep->curl != NULL) {
+        curl_easy_cleanup(pep->curl);
+        pep->curl= NULL;
+    }
+    if (pep->option_credentials != NULL) {
+        pep_credentials_attach(pep->option_credentials,-1);
+        pep->option_credentials= NULL;
+    }
+    
+    /* free options... */
+    if (pep->option_endpoint_url != NULL) {
+        free(pep->option_endpoint_url);
+        pep->option_endpoint_url= NULL;
+    }
+    if (pep->option_batch_endpoint_url != NULL) {
+        free(pep->option_batch_endpoint_url);
+        pep->option_batch_endpoint_url= NULL;
+    }
+    if (pep->option_sidecar_socket != NULL) {
+        free(pep->option_sidecar_socket);
+        pep->option_sidecar_socket= NULL;
+    }
+    if (pep->option_ssl_cipher_list != NULL) {
+        free(pep->option_ssl_cipher_list);
+        pep->option_ssl_cipher_list= NULL;
+    }
+    if (pep->option_server_cert != NULL) {
+        free(pep->option_server_cert);
+        pep->option_server_cert= NULL;
+    }
+    if (pep->option_server_capath != NULL) {
+        free(pep->option_server_capath);
+        pep->option_server_capath= NULL;
+    }
+    if (pep->option_client_cert != NULL) {
+        free(pep->option_client_cert);
+        pep->option_client_cert= NULL;
+    }
+    if (pep->option_client_key != NULL) {
+        free(pep->option_client_key);
+        pep->option_client_key= NULL;
+    }
+    if (pep->option_client_keypassword != NULL) {
+        memset(pep->option_client_keypassword,'\0',strlen(pep->option_client_keypassword));
+        free(pep->option_client_keypassword);
+        pep->option_client_keypassword= NULL;
+    }
+
+    /* destroy all pips if any */
+    while (pep_llist_length(pep->pips) > 0) {
+        pep_pip_t * pip= pep_llist_remove(pep->pips,0);
+        if (pip != NULL) {
+            pips_destroy_rc += pip->destroy();
+        }
+    }
+    pep_llist_delete(pep->pips);
+    if (pips_destroy_rc > 0) {
+        pep_log_warn("pep_destroy: some PIP->destroy() failed...");
+    }
+
+    /* destroy all obligation handlers if any */
+    while (pep_llist_length(pep->ohs) > 0) {
+        pep_obligationhandler_t * oh= pep_llist_remove(pep->ohs,0);
+        if (oh != NULL) {
+            ohs_destroy_rc += oh->destroy();
+        }
+    }
+    pep_llist_delete(pep->ohs);
+    if (ohs_destroy_rc > 0) {
+        pep_log_warn("pep_destroy: some OH->destroy() failed...");
+    }
+
+    /* destroy all endpoints */
+    pep_endpoints_delete(pep->endpoints);
+
+    /* destroy the decision cache and its options */
+    if (pep->cache != NULL) {
+        pep_cache_delete(pep->cache);
+        pep->cache= NULL;
+    }
+    /* unmap the shared memory decision cache, kept for the other processes */
+    pep_shmcache_close(pep->shmcache);
+    pep->shmcache= NULL;
+    /* no request is in flight anymore */
+    pep_flights_delete(pep->flights);
+    pep->flights= NULL;
+    pep_llist_delete_elements(pep->option_cache_uncacheable_obligations,free);
+    pep_llist_delete(pep->option_cache_uncacheable_obligations);
+
+    free(pep);
+}
+
+
+/**************************/
+/*** INTERNAL FUNCTIONS ***/
+/**************************/
+
+/**
+ * Authorizes the request within the given session: applies the PIPs, sends the
+ * request (or looks up the decision cache), and applies the OHs.
+ */
+static pep_error_t pep_authorize_session(PEP * pep, pep_session_t * session, xacml_request_t ** request, xacml_response_t ** response) {
+    int cacheable= FALSE, cache_rc= PEP_CACHE_MISS;
+    pep_error_t rc;
+
+    rc= pep_authorize_prepare(pep,session,request,&cacheable,&cache_rc);
+    if (rc != PEP_OK) {
+        return rc;
+    }
+
+    if (cache_rc != PEP_CACHE_HIT) {
+        rc= pep_authorize_exchange(pep,session,&cacheable);
+        if (rc != PEP_OK) {
+            pep_session_releasebuffers(session);
+            return rc;
+        }
+    }
+
+    return pep_authorize_complete(pep,session,request,response,cacheable,cache_rc);
+}
+
+/**
+ * Gets the response of the marshalled request (session->output) not found in the decision
+ * caches into session->input: joins an identical request in flight, or sends the request.
+ * cacheable is cleared if the response was already stored by the flight leader.
+ */
+static pep_error_t pep_authorize_exchange(PEP * pep, pep_session_t * session, int * cacheable) {
+    int role= PEP_FLIGHT_ERROR;
+    pep_flight_t * flight= NULL;
+    pep_error_t rc;
+
+    /* join an identical request in flight, or lead a new flight */
+    if (pep->option_single_flight && pep->flights != NULL) {
+        role= pep_flights_join(pep->flights,pep_buffer_data(session->output),pep_buffer_length(session->output),&flight);
+    }
+    if (role == PEP_FLIGHT_FOLLOWER) {
+        rc= pep_flights_wait(pep->flights,flight,session->input,pep_session_remaining(session));
+        /* already stored by the leader */
+        *cacheable= FALSE;
+        if (rc == PEP_OK) {
+            pep_log_info("pep_authorize: PEP#%d XACML response received by an identical request in flight.",pep->id);
+        }
+        else if (rc == PEP_ERR_TIMEOUT && pep_session_remaining(session) != 0) {
+            /* the leader deadline passed, not ours */
+            pep_log_debug("pep_authorize: PEP#%d identical request in flight timed out, sending request.",pep->id);
+            rc= pep_authorize_send(pep,session);
+        }
+    }
+    else {
+        rc= pep_authorize_send(pep,session);
+        if (role == PEP_FLIGHT_LEADER) {
+            pep_flights_land(pep->flights,flight,rc,pep_buffer_data(session->input),pep_buffer_length(session->input));
+        }
+    }
+    return rc;
+}
+
+/**
+ * Second phase of an authorization, on decision cache miss: sends the request in
+ * session->output to the healthiest endpoint, and fails over to the next ones.
+ *
+ * @return PEP_OK with the decoded response in session->input, or an error code.
+ */
+static pep_error_t pep_authorize_send(PEP * pep, pep_session_t * session) {
+    pep_error_t rc;
+    CURLcode curl_rc;
+    int next= 0;
+
+    if (pep->option_sidecar_socket != NULL) {
+        uint64_t deadline= session->deadline;
+        long timeout_ms= get_transfer_timeout_ms(pep);
+        if (deadline == 0 && timeout_ms > 0) {
+            deadline= pep_clock_ms() + (uint64_t)timeout_ms;
+        }
+        pep_log_info("pep_authorize: PEP#%d sending XACML request to sidecar: %s",pep->id,pep->option_sidecar_socket);
+        session->trace_transfer= pep_trace_start(pep,session,PEP_TRACE_TRANSFER);
+        rc= pep_sidecar_send(session,pep->option_sidecar_socket,deadline);
+        pep_trace_transfer_end(pep,session,pep->option_sidecar_socket,FALSE,rc,rc);
+        if (rc != PEP_ERR_SIDECAR || pep->option_endpoint_url == NULL) {
+            if (rc == PEP_ERR_SIDECAR && pep_session_remaining(session) == 0) {
+                rc= PEP_ERR_TIMEOUT;
+            }
+            return rc;
+        }
+        pep_log_warn("pep_authorize: PEP#%d sidecar unreachable, sending XACML request to the endpoints.",pep->id);
+    }
+
+    rc= pep_authorize_setup(pep,session);
+    if (rc != PEP_OK) {
+        return rc;
+    }
+    session->tried= 0;
+    rc= PEP_ERR_AUTHZ_REQUEST;
+    if (pep->option_hedge_delay > 0 && pep_endpoints_length(pep->endpoints) > 1) {
+        rc= pep_endpoint_hedged(pep,session);
+    }
+    while (rc != PEP_OK && (next= pep_endpoint_next(pep,session)) >= 0) {
+        curl_rc= curl_easy_perform(session->curl);
+        rc= pep_endpoint_done(pep,session,(curl_rc == CURLE_OK) ? PEP_OK : PEP_ERR_CURL + curl_rc);
+        if (rc == PEP_OK) break;
+    }
+    if (rc != PEP_OK && session->tried == 0 && next == PEP_ENDPOINT_CIRCUIT_OPEN) {
+        pep_log_error("pep_authorize: PEP#%d circuit breaker open for all endpoints, XACML request not sent.",pep->id);
+        rc= PEP_ERR_CIRCUIT_OPEN;
+    }
+    else if (rc != PEP_OK && pep_session_remaining(session) == 0) {
+        pep_log_error("pep_authorize: PEP#%d deadline exceeded, no XACML response received.",pep->id);
+        rc= PEP_ERR_TIMEOUT;
+    }
+    return rc;
+}
+
+/**
+ * First phase of an authorization: applies the PIPs, marshals the request into
+ * session->output and looks up the decision cache. On cache hit, the cached
+ * Hessian response is in session->input.
+ */
+static pep_error_t pep_authorize_prepare(PEP * pep, pep_session_t * session, xacml_request_t ** request, int * cacheable, int * cache_rc) {
+    int i= 0;
+    int pip_rc;
+    pep_error_t marshal_rc;
+    uint64_t start;
+    void * span;
+
+    *cacheable= FALSE;
+    *cache_rc= PEP_CACHE_MISS;
+
+    /* apply pips if enabled and any */
+    if (pep->option_pips_enabled && pep_llist_length(pep->pips) > 0) {
+        size_t pips_l= pep_llist_length(pep->pips);
+        span= pep_trace_start(pep,session,PEP_TRACE_PIP);
+        start= pep_clock_us();
+        pep_log_info("pep_authorize: PEP#%d %d PIPs available, processing...",pep->id, (int)pips_l);
+        for (i= 0; i<pips_l; i++) {
+            pep_pip_t * pip= pep_llist_get(pep->pips,i);
+            if (pip != NULL) {
+                pep_log_debug("pep_authorize: PEP#%d calling pip[%s]->process(request)...",pep->id,pip->id);
+                pip_rc= pip->process(request);
+                if (pip_rc != 0) {
+                    pep_log_error("pep_authorize: PIP[%s] process(request) failed: %d", pip->id, pip_rc);
+                    pep_trace_end(pep,span,PEP_TRACE_PIP,PEP_ERR_PIP_PROCESS);
+                    return PEP_ERR_PIP_PROCESS;
+                }
+            }
+        }
+        pep_stats_phase(&(pep->metrics),PEP_PHASE_PIP,pep_clock_us() - start);
+        pep_trace_end(pep,span,PEP_TRACE_PIP,PEP_OK);
+        if (pep_session_remaining(session) == 0) {
+            pep_log_error("pep_authorize: PEP#%d deadline exceeded after PIPs processing.",pep->id);
+            return PEP_ERR_TIMEOUT;
+        }
+    }
+
+    /* get the session output and Hessian input buffers */
+    if (pep_session_getbuffers(session) != 0) {
+        pep_log_error("pep_authorize: PEP#%d can't create output and input buffers.",pep->id);
+        return PEP_ERR_MEMORY;
+    }
+
+    /* marshal the authorization request into output buffer */
+    span= pep_trace_start(pep,session,PEP_TRACE_MARSHAL);
+    start= pep_clock_us();
+    marshal_rc= xacml_request_marshalling(*request,session->output);
+    pep_trace_end(pep,span,PEP_TRACE_MARSHAL,marshal_rc);
+    if ( marshal_rc != PEP_OK ) {
+        pep_log_error("pep_authorize: PEP#%d can't marshal XACML request: %s.",pep->id,pep_strerror(marshal_rc));
+        pep_session_releasebuffers(session);
+        return marshal_rc;
+    }
+    pep_stats_phase(&(pep->metrics),PEP_PHASE_MARSHAL,pep_clock_us() - start);
+
+    /* lookup the decision caches, the marshalled request is the key */
+    if ((pep->option_cache_enabled && pep->cache != NULL) || pep->shmcache != NULL) {
+        *cacheable= (pep->option_cache_filter == NULL) ? TRUE : pep->option_cache_filter(*request,NULL);
+    }
+    pep_authorize_lookup(pep,session,*cacheable,cache_rc);
+    return PEP_OK;
+}
+
+/**
+ * Looks up the decision caches, the marshalled request (session->output) is the key.
+ * On cache hit, the cached Hessian response is in session->input.
+ */
+static void pep_authorize_lookup(PEP * pep, pep_session_t * session, int cacheable, int * cache_rc) {
+    *cache_rc= PEP_CACHE_MISS;
+    if (!cacheable) {
+        return;
+    }
+    if (pep->option_cache_enabled && pep->cache != NULL) {
+        *cache_rc= pep_cache_lookup(pep->cache,pep_buffer_data(session->output),pep_buffer_length(session->output),session->input);
+        if (*cache_rc == PEP_CACHE_HIT) {
+            pep_log_info("pep_authorize: PEP#%d XACML response found in decision cache.",pep->id);
+        }
+        else if (*cache_rc == PEP_CACHE_ERROR) {
+            pep_log_warn("pep_authorize: PEP#%d decision cache lookup failed, sending request.",pep->id);
+            pep_buffer_reset(session->input);
+        }
+    }
+    if (*cache_rc != PEP_CACHE_HIT && pep->shmcache != NULL) {
+        *cache_rc= pep_shmcache_lookup(pep->shmcache,pep_buffer_data(session->output),pep_buffer_length(session->output),session->input);
+        if (*cache_rc == PEP_CACHE_HIT) {
+            pep_log_info("pep_authorize: PEP#%d XACML response found in shared memory decision cache.",pep->id);
+        }
+        else if (*cache_rc == PEP_CACHE_ERROR) {
+            pep_log_warn("pep_authorize: PEP#%d shared memory decision cache lookup failed, sending request.",pep->id);
+            pep_buffer_reset(session->input);
+        }
+    }
+}
+
+/**
+ * CURLOPT_SEEKFUNCTION for the streamed request body: libcurl rewinds it when
+ * the request must be sent again (e.g. on a reused connection closed by the server).
+ */
+static int pep_b64output_seek(void * encoder, curl_off_t offset, int origin) {
+    if (offset != 0 || origin != SEEK_SET) {
+        return CURL_SEEKFUNC_CANTSEEK;
+    }
+    pep_base64_encoder_rewind((pep_base64_encoder_t *)encoder);
+    return CURL_SEEKFUNC_OK;
+}
+
+/**
+ * CURLOPT_WRITEFUNCTION for the raw Hessian response: writes it into the session input,
+ * and times the first and last bytes received.
+ */
+static size_t pep_session_write_input(const void * src, size_t size, size_t count, void * session) {
+    pep_session_t * s= (pep_session_t *)session;
+    s->received_last= pep_clock_us();
+    if (s->received_first == 0) {
+        s->received_first= s->received_last;
+    }
+    return pep_buffer_write(src,size,count,s->input);
+}
+
+/**
+ * CURLOPT_READFUNCTION for the base64 request body: encodes the session output on
+ * the fly, and accounts the encoding time.
+ */
+static size_t pep_session_read_output(void * dst, size_t size, size_t count, void * session) {
+    pep_session_t * s= (pep_session_t *)session;
+    uint64_t start= pep_clock_us();
+    size_t n= pep_base64_encoder_read(dst,size,count,&(s->b64output));
+    s->encode_us += pep_clock_us() - start;
+    return n;
+}
+
+/**
+ * CURLOPT_WRITEFUNCTION for the base64 response: decodes it into the session input as
+ * it arrives, accounts the decoding time, and times the first and last bytes received.
+ */
+static size_t pep_session_write_decoded(const void * src, size_t size, size_t count, void * session) {
+    pep_session_t * s= (pep_session_t *)session;
+    uint64_t start= pep_clock_us();
+    size_t n;
+    if (s->received_first == 0) {
+        s->received_first= start;
+    }
+    n= pep_base64_decoder_write(src,size,count,&(s->b64input));
+    s->received_last= pep_clock_us();
+    s->decode_us += s->received_last - start;
+    return n;
+}
+
+/**
+ * Sets the transfer callbacks of the session curl handle, once for each easy handle:
+ * POST the session output base64 encoded on the fly, and base64 decode the HTTP
+ * response into the session input as it arrives. With the binary wire encoding, the
+ * session output and input are sent and received as is.
+ */
+static pep_error_t pep_session_configure(PEP * pep, pep_session_t * session) {
+    CURLcode curl_rc;
+
+    curl_rc= curl_easy_setopt(session->curl, CURLOPT_POST, 1L);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_POST,1) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+
+    if (pep->option_wire_encoding == PEP_WIRE_ENCODING_BINARY) {
+        /* the request is posted from the output buffer (CURLOPT_POSTFIELDS), the response written as is */
+        curl_rc= curl_easy_setopt(session->curl, CURLOPT_WRITEDATA, session);
+        if (curl_rc != CURLE_OK) {
+            pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_WRITEDATA,session) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+            return PEP_ERR_CURL + curl_rc;
+        }
+        curl_rc= curl_easy_setopt(session->curl, CURLOPT_WRITEFUNCTION, pep_session_write_input);
+        if (curl_rc != CURLE_OK) {
+            pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_WRITEFUNCTION,session_write_input) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+            return PEP_ERR_CURL + curl_rc;
+        }
+        session->configured= TRUE;
+        return PEP_OK;
+    }
+
+    /* no post fields: the request is read from the read function */
+    curl_rc= curl_easy_setopt(session->curl, CURLOPT_POSTFIELDS, NULL);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_POSTFIELDS,NULL) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+
+    curl_rc= curl_easy_setopt(session->curl, CURLOPT_READDATA, session);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_READDATA,session) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+
+    curl_rc= curl_easy_setopt(session->curl, CURLOPT_READFUNCTION, pep_session_read_output);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_READFUNCTION,session_read_output) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+
+    curl_rc= curl_easy_setopt(session->curl, CURLOPT_SEEKDATA, &(session->b64output));
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_SEEKDATA,b64output) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+
+    curl_rc= curl_easy_setopt(session->curl, CURLOPT_SEEKFUNCTION, pep_b64output_seek);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_SEEKFUNCTION,b64output_seek) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+
+    curl_rc= curl_easy_setopt(session->curl, CURLOPT_WRITEDATA, session);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_WRITEDATA,session) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+
+    curl_rc= curl_easy_setopt(session->curl, CURLOPT_WRITEFUNCTION, pep_session_write_decoded);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_WRITEFUNCTION,session_write_decoded) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+
+    session->configured= TRUE;
+    return PEP_OK;
+}
+
+/**
+ * Compresses the request body (the session output, base64 encoded or raw) in gzip
+ * format into session->compressed.
+ *
+ * @return PEP_OK or PEP_ERR_MEMORY if the body can't be compressed.
+ */
+static pep_error_t pep_session_compress(PEP * pep, pep_session_t * session, size_t body_l) {
+    int gzip_rc;
+    uint64_t start= pep_clock_us();
+    if (session->compressed == NULL) {
+        session->compressed= pep_buffer_create(body_l / 2);
+        if (session->compressed == NULL) {
+            pep_log_error("pep_authorize: PEP#%d can't create compressed output buffer.",pep->id);
+            return PEP_ERR_MEMORY;
+        }
+    }
+    else {
+        pep_buffer_clear(session->compressed);
+    }
+    if (pep->option_wire_encoding == PEP_WIRE_ENCODING_BINARY) {
+        gzip_rc= pep_gzip_compress(pep_buffer_read,session->output,session->compressed);
+        pep_buffer_rewind(session->output);
+    }
+    else {
+        gzip_rc= pep_gzip_compress(pep_base64_encoder_read,&(session->b64output),session->compressed);
+        pep_base64_encoder_rewind(&(session->b64output));
+    }
+    if (gzip_rc != GZIP_OK) {
+        pep_log_error("pep_authorize: PEP#%d can't compress the request body (%d bytes).",pep->id,(int)body_l);
+        return PEP_ERR_MEMORY;
+    }
+    pep_log_debug("pep_authorize: PEP#%d request body compressed: %d -> %d bytes.",pep->id,(int)body_l,(int)pep_buffer_length(session->compressed));
+    session->encode_us += pep_clock_us() - start;
+    return PEP_OK;
+}
+
+/**
+ * Second phase of an authorization: prepares the session curl handle to POST the
+ * marshalled request, base64 encoded on the fly while it is sent, and to write
+ * the HTTP response, base64 decoded on the fly, into session->input. With the
+ * binary wire encoding, the marshalled request is posted as is. With compression,
+ * a request body larger than the threshold is compressed before. The caller
+ * performs the transfer.
+ */
+static pep_error_t pep_authorize_setup(PEP * pep, pep_session_t * session) {
+    int binary= (pep->option_wire_encoding == PEP_WIRE_ENCODING_BINARY);
+    int gzip= FALSE;
+    const unsigned char * body= NULL; /* NULL if read from the read function */
+    size_t body_l;
+    struct curl_slist * headers;
+    CURLcode curl_rc;
+    pep_error_t rc;
+
+    if (!session->configured) {
+        rc= pep_session_configure(pep,session);
+        if (rc != PEP_OK) {
+            return rc;
+        }
+    }
+    if (pep->option_credentials != NULL
+        && pep_credentials_apply(pep->option_credentials,session->curl,&(session->credentials_generation)) != 0) {
+        return PEP_ERR_OPTION_INVALID;
+    }
+
+    if (binary) {
+        /* post the marshalled request as is */
+        body= pep_buffer_data(session->output);
+        body_l= pep_buffer_length(session->output);
+    }
+    else {
+        /* the base64 output is streamed, its length is known in advance */
+        pep_base64_encoder_init(&(session->b64output),session->output,BASE64_DEFAULT_LINE_SIZE);
+        body_l= pep_base64_encoder_length(&(session->b64output));
+        pep_base64_decoder_init(&(session->b64input),session->input);
+    }
+
+    if (pep->option_compression) {
+        /* small bodies are sent uncompressed */
+        if (body_l >= (size_t)pep->option_compression_threshold && pep_gzip_available()) {
+            gzip= (pep_session_compress(pep,session,body_l) == PEP_OK);
+            if (gzip) {
+                body= pep_buffer_data(session->compressed);
+                body_l= pep_buffer_length(session->compressed);
+            }
+        }
+        headers= get_curl_http_headers(pep,gzip);
+        if (headers == NULL) {
+            pep_log_error("pep_authorize: PEP#%d curl_http_headers list not allocated.",pep->id);
+            return PEP_ERR_MEMORY;
+        }
+        curl_rc= curl_easy_setopt(session->curl, CURLOPT_HTTPHEADER, headers);
+        if (curl_rc != CURLE_OK) {
+            pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_HTTPHEADER,curl_http_headers) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+            return PEP_ERR_CURL + curl_rc;
+        }
+    }
+
+    curl_rc= curl_easy_setopt(session->curl, CURLOPT_POSTFIELDSIZE, (long)body_l);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_POSTFIELDSIZE,%d) failed: %s.",pep->id,(int)body_l,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+    /* the base64 body is set once to be read (see pep_session_configure) */
+    if (body != NULL || pep->option_compression) {
+        curl_rc= curl_easy_setopt(session->curl, CURLOPT_POSTFIELDS, body);
+        if (curl_rc != CURLE_OK) {
+            pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_POSTFIELDS,body) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+            return PEP_ERR_CURL + curl_rc;
+        }
+    }
+    return PEP_OK;
+}
+
+/**
+ * Third phase of an authorization, after the transfer: checks the HTTP status code
+ * and decodes the end of the received response into session->input.
+ */
+static pep_error_t pep_authorize_received(PEP * pep, pep_session_t * session) {
+    CURLcode curl_rc;
+    long http_code= 0;
 
-    /* send the request */
-    pep_log_info("pep_authorize: PEP#%d sending XACML request to: %s",pep->id,pep->option_endpoint_url);
-    curl_rc= curl_easy_perform(pep->curl);
-    if (curl_rc != CURLE_OK) {
-        pep_log_error("pep_authorize: PEP#%d sending XACML request to %s failed: curl[%d] %s.",pep->id,pep->option_endpoint_url,(int)curl_rc,curl_easy_strerror(curl_rc));
-        pep_buffer_delete(pep->b64output);
-        pep_buffer_delete(pep->b64input);
-        return PEP_ERR_CURL + curl_rc;
-    }
-
     /* check for HTTP 200 response code */
-    http_code= 0;
-    curl_rc= curl_easy_getinfo(pep->curl,CURLINFO_RESPONSE_CODE,&http_code);
+    curl_rc= curl_easy_getinfo(session->curl,CURLINFO_RESPONSE_CODE,&http_code);
     if (curl_rc != CURLE_OK) {
-        pep_log_error("pep_authorize: PEP#%d curl_easy_getinfo(pep->curl,CURLINFO_RESPONSE_CODE,&http_code) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
-        pep_buffer_delete(pep->b64output);
-        pep_buffer_delete(pep->b64input);
+        pep_log_error("pep_authorize: PEP#%d curl_easy_getinfo(session->curl,CURLINFO_RESPONSE_CODE,&http_code) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
         return PEP_ERR_CURL + curl_rc;
     }
     if (http_code != 200) {
         pep_log_error("pep_authorize: PEP#%d: HTTP status code: %d.",pep->id,(int)http_code);
-        pep_buffer_delete(pep->b64output);
-        pep_buffer_delete(pep->b64input);
         return PEP_ERR_AUTHZ_REQUEST;
     }
 
-    /* not required anymore */
-    pep_buffer_delete(pep->b64output);
-
     pep_log_debug("pep_authorize: PEP#%d: HTTP status code: %d.",pep->id,(int)http_code);
 
-    /* create the Hessian input buffer */
-    pep->input= pep_buffer_create(1024);
-    if (pep->input == NULL) {
-        pep_log_error("pep_authorize: PEP#%d can't create input buffer.",pep->id);
-        pep_buffer_delete(pep->b64input);
-        return PEP_ERR_MEMORY;
+    /* the response was base64 decoded while received, except its last block */
+    if (pep->option_wire_encoding == PEP_WIRE_ENCODING_BASE64) {
+        pep_base64_decoder_finish(&(session->b64input));
+    }
+
+    return PEP_OK;
+}
+
+/**
+ * Points the session curl handle to the healthiest endpoint not yet tried for the
+ * current request, and rewinds the session transfer buffers. With a session deadline,
+ * the transfer timeouts are lowered to the time left.
+ *
+ * @return the endpoint index, -1 if all the endpoints were tried or the deadline passed, or
+ *         PEP_ENDPOINT_CIRCUIT_OPEN if the endpoints not yet tried have their circuit open.
+ */
+static int pep_endpoint_next(PEP * pep, pep_session_t * session) {
+    const char * url;
+    CURLcode curl_rc;
+    int i;
+    if (session->deadline != 0 && set_session_timeouts(pep,session) != 0) {
+        pep_log_warn("pep_authorize: PEP#%d deadline exceeded, XACML request not sent.",pep->id);
+        return -1;
     }
+    while ((i= pep_endpoints_select(pep->endpoints,session->tried)) >= 0) {
+        const char * socket;
+        const char * target= pep_endpoints_gettarget(pep->endpoints,i,&socket);
+        session->tried |= 1UL << i;
+        url= pep_endpoints_geturl(pep->endpoints,i);
+        curl_rc= set_curl_url(session->curl,target,socket);
+        if (curl_rc != CURLE_OK) {
+            pep_log_error("pep_authorize: PEP#%d curl_easy_setopt(curl,CURLOPT_URL,%s) failed: %s.",pep->id,url,curl_easy_strerror(curl_rc));
+            continue;
+        }
+        pep_base64_encoder_rewind(&(session->b64output));
+        pep_base64_decoder_reset(&(session->b64input));
+        pep_buffer_clear(session->input);
+        session->endpoint= i;
+        session->sent= pep_clock_us();
+        session->trace_transfer= pep_trace_start(pep,session,PEP_TRACE_TRANSFER);
+        pep_log_info("pep_authorize: PEP#%d sending XACML request to: %s",pep->id,url);
+        return i;
+    }
+    return i;
+}
+
+/**
+ * Ends the transfer to the current session endpoint: checks and decodes the
+ * response (see pep_authorize_received) and updates the endpoint health.
+ *
+ * @return PEP_OK or an error code if the transfer or the response failed.
+ */
+static pep_error_t pep_endpoint_done(PEP * pep, pep_session_t * session, pep_error_t transfer_rc) {
+    pep_error_t rc= transfer_rc;
+    uint64_t latency;
+    if (rc == PEP_OK) {
+        rc= pep_authorize_received(pep,session);
+    }
+    else {
+        pep_log_error("pep_authorize: PEP#%d sending XACML request to %s failed: %s.",pep->id,pep_endpoints_geturl(pep->endpoints,session->endpoint),pep_strerror(rc));
+    }
+    pep_stats_transfer(&(pep->metrics),session,rc);
+    latency= pep_clock_us() - session->sent;
+    pep_stats_endpoint(&(pep->metrics),session->endpoint,latency,rc);
+    pep_trace_transfer_end(pep,session,pep_endpoints_geturl(pep->endpoints,session->endpoint),TRUE,transfer_rc,rc);
+    if (rc == PEP_OK) {
+        pep_endpoints_success(pep->endpoints,session->endpoint,(unsigned long)latency);
+    }
+    else if (pep_session_remaining(session) != 0) {
+        /* a transfer cut by the caller deadline is not an endpoint failure */
+        pep_endpoints_failure(pep->endpoints,session->endpoint);
+    }
+    return rc;
+}
+
+/**
+ * Sends the request to the healthiest endpoint, and if it did not answer after the
+ * hedge delay, sends a duplicate request to the next endpoint. The first valid
+ * response wins, and the other transfer is cancelled. The endpoints tried are
+ * recorded in session->tried, the caller can failover to the remaining ones.
+ *
+ * @return PEP_OK with the decoded response in session->input, or an error code.
+ */
+static pep_error_t pep_endpoint_hedged(PEP * pep, pep_session_t * session) {
+    pep_session_t * hedge, * done= NULL;
+    pep_error_t rc= PEP_ERR_AUTHZ_REQUEST;
+    CURLMsg * msg;
+    CURLMcode curlm_rc;
+    int primary_running= FALSE, hedge_running= FALSE, hedged= FALSE;
+    int running_handles= 0, msgs_l= 0, timeout_ms;
+    uint64_t hedge_time, now;
+    unsigned long p95_us;
+
+    hedge= pep_session_gethedge(session,pep->curl,pep->generation);
+    if (hedge == NULL) {
+        pep_log_warn("pep_authorize: PEP#%d can't create hedge session, request not hedged.",pep->id);
+        return PEP_ERR_AUTHZ_REQUEST;
+    }
+    if (pep_endpoint_next(pep,session) < 0) {
+        return PEP_ERR_AUTHZ_REQUEST;
+    }
+    curlm_rc= curl_multi_add_handle(session->multi,session->curl);
+    if (curlm_rc != CURLM_OK) {
+        pep_log_error("pep_authorize: PEP#%d curl_multi_add_handle(multi,curl) failed: %s.",pep->id,curl_multi_strerror(curlm_rc));
+        pep_trace_transfer_end(pep,session,pep_endpoints_geturl(pep->endpoints,session->endpoint),FALSE,PEP_ERR_AUTHZ_REQUEST,PEP_ERR_AUTHZ_REQUEST);
+        /* not sent, can be retried */
+        session->tried &= ~(1UL << session->endpoint);
+        return PEP_ERR_AUTHZ_REQUEST;
+    }
+    primary_running= TRUE;
+
+    /* hedge delay: the configured one, or the lower observed 95th percentile */
+    timeout_ms= pep->option_hedge_delay;
+    if (pep->option_hedge_adaptive) {
+        p95_us= pep_endpoints_p95(pep->endpoints,session->endpoint);
+        if (p95_us > 0 && p95_us / 1000 < (unsigned long)timeout_ms) {
+            timeout_ms= (int)(p95_us / 1000) + 1;
+        }
+    }
+    hedge_time= pep_clock_ms() + (uint64_t)timeout_ms;
+
+    while (primary_running || hedge_running) {
+        /* send the duplicate request */
+        now= pep_clock_ms();
+        if (!hedged && now >= hedge_time) {
+            hedged= TRUE;
+            hedge->tried= session->tried;
+            hedge->deadline= session->deadline;
+            hedge->trace= session->trace;
+            /* stream the same marshalled request, the response is decoded in the hedge input */
+            hedge->output= session->output;
+            if (hedge->input == NULL) {
+                hedge->input= pep_buffer_create(pep_buffer_size(session->input));
+            }
+            rc= (hedge->input != NULL) ? pep_authorize_setup(pep,hedge) : PEP_ERR_MEMORY;
+            hedge->output= NULL;
+            if (rc == PEP_OK && pep_endpoint_next(pep,hedge) >= 0) {
+                curlm_rc= curl_multi_add_handle(session->multi,hedge->curl);
+                if (curlm_rc == CURLM_OK) {
+                    pep_log_info("pep_authorize: PEP#%d hedged XACML request after %d ms.",pep->id,timeout_ms);
+                    session->tried |= hedge->tried;
+                    hedge_running= TRUE;
+                }
+                else {
+                    pep_log_error("pep_authorize: PEP#%d curl_multi_add_handle(multi,hedge) failed: %s.",pep->id,curl_multi_strerror(curlm_rc));
+                    pep_trace_transfer_end(pep,hedge,pep_endpoints_geturl(pep->endpoints,hedge->endpoint),FALSE,PEP_ERR_AUTHZ_REQUEST,PEP_ERR_AUTHZ_REQUEST);
+                }
+            }
+            rc= PEP_ERR_AUTHZ_REQUEST;
+        }
+        if (pep_async_wait(session->multi,hedged ? 1000 : (int)(hedge_time - now)) != 0) {
+            break;
+        }
+        do {
+            curlm_rc= curl_multi_perform(session->multi,&running_handles);
+        } while (curlm_rc == CURLM_CALL_MULTI_PERFORM);
+        if (curlm_rc != CURLM_OK) {
+            pep_log_error("pep_authorize: PEP#%d curl_multi_perform(multi) failed: %s.",pep->id,curl_multi_strerror(curlm_rc));
+            break;
+        }
+        while (rc != PEP_OK && (msg= curl_multi_info_read(session->multi,&msgs_l)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            curl_multi_remove_handle(session->multi,msg->easy_handle);
+            if (msg->easy_handle == session->curl) {
+                done= session;
+                primary_running= FALSE;
+            }
+            else {
+                done= hedge;
+                hedge_running= FALSE;
+            }
+            rc= pep_endpoint_done(pep,done,(msg->data.result == CURLE_OK) ? PEP_OK : PEP_ERR_CURL + msg->data.result);
+        }
+        if (rc == PEP_OK) break;
+    }
+
+    /* cancel the loser */
+    if (primary_running) {
+        curl_multi_remove_handle(session->multi,session->curl);
+        pep_trace_transfer_end(pep,session,pep_endpoints_geturl(pep->endpoints,session->endpoint),TRUE,PEP_ERR_CANCELLED,PEP_ERR_CANCELLED);
+    }
+    if (hedge_running) {
+        curl_multi_remove_handle(session->multi,hedge->curl);
+        pep_trace_transfer_end(pep,hedge,pep_endpoints_geturl(pep->endpoints,hedge->endpoint),TRUE,PEP_ERR_CANCELLED,PEP_ERR_CANCELLED);
+    }
+    hedge->trace= NULL;
+    /* the hedge response won: swap the input buffers */
+    if (rc == PEP_OK && done == hedge) {
+        pep_buffer_t * input= session->input;
+        session->input= hedge->input;
+        hedge->input= input;
+    }
+    return rc;
+}
+
+/** discards the HEAD response body, if any */
+static size_t warmup_discard(void * src, size_t size, size_t count, void * userdata) {
+    return size * count;
+}
+
+/**
+ * Opens the session connection to the endpoint with a HEAD request. Whatever its HTTP
+ * status, the connection stays in the session easy handle (or the share) cache.
+ */
+static pep_error_t pep_warmup_session(PEP * pep, pep_session_t * session, int endpoint) {
+    const char * url= pep_endpoints_geturl(pep->endpoints,endpoint);
+    const char * socket;
+    const char * target= pep_endpoints_gettarget(pep->endpoints,endpoint,&socket);
+    CURLcode curl_rc;
+    long http_code= 0;
+    set_curl_url(session->curl,target,socket);
+    if (pep->option_credentials != NULL) {
+        pep_credentials_apply(pep->option_credentials,session->curl,&(session->credentials_generation));
+    }
+    curl_easy_setopt(session->curl, CURLOPT_WRITEFUNCTION, warmup_discard);
+    curl_easy_setopt(session->curl, CURLOPT_NOBODY, 1L);
+    /* the transfer callbacks are set again by the next authorization */
+    session->configured= FALSE;
+    pep_log_debug("pep_warmup: PEP#%d connecting to: %s",pep->id,url);
+    curl_rc= curl_easy_perform(session->curl);
+    curl_easy_setopt(session->curl, CURLOPT_NOBODY, 0L);
+    if (curl_rc != CURLE_OK) {
+        pep_log_warn("pep_warmup: PEP#%d connecting to %s failed: curl[%d] %s.",pep->id,url,(int)curl_rc,curl_easy_strerror(curl_rc));
+        pep_endpoints_failure(pep->endpoints,endpoint);
+        return PEP_ERR_CURL + curl_rc;
+    }
+    curl_easy_getinfo(session->curl,CURLINFO_RESPONSE_CODE,&http_code);
+    pep_log_debug("pep_warmup: PEP#%d connected to %s: HTTP status code: %d.",pep->id,url,(int)http_code);
+    return PEP_OK;
+}
 
-    /* base64 decode the input buffer into the Hessian buffer. */
-    pep_log_debug("pep_authorize: PEP#%d: decoding base64 input...",pep->id);
-    pep_base64_decode_buffer(pep->b64input,pep->input);
+/**
+ * Last phase of an authorization: unmarshals the Hessian response (session->input),
+ * and finishes the authorization. The session buffers are always released.
+ */
+static pep_error_t pep_authorize_complete(PEP * pep, pep_session_t * session, xacml_request_t ** request, xacml_response_t ** response, int cacheable, int cache_rc) {
+    pep_error_t unmarshal_rc;
+    void * span= pep_trace_start(pep,session,PEP_TRACE_UNMARSHAL);
+    uint64_t start= pep_clock_us();
 
     /* unmarshal the PEP response */
-    unmarshal_rc= xacml_response_unmarshalling(response,pep->input);
+    unmarshal_rc= xacml_response_unmarshalling(response,session->input);
+    pep_trace_end(pep,span,PEP_TRACE_UNMARSHAL,unmarshal_rc);
     if ( unmarshal_rc != PEP_OK) {
         pep_log_error("pep_authorize: PEP#%d can't unmarshal the XACML response: %s.", pep->id, pep_strerror(unmarshal_rc));
-        pep_buffer_delete(pep->b64input);
-        pep_buffer_delete(pep->input);
+        pep_session_releasebuffers(session);
         return unmarshal_rc;
     }
+    pep_stats_phase(&(pep->metrics),PEP_PHASE_UNMARSHAL,pep_clock_us() - start);
 
     pep_log_info("pep_authorize: PEP#%d XACML Response decoded and deserialized.",pep->id);
 
-    /* not required anymore */
-    pep_buffer_delete(pep->b64input);
-    pep_buffer_delete(pep->input);
+    return pep_authorize_finish(pep,session,request,response,cacheable,cache_rc);
+}
+
+/**
+ * Finishes an authorization with the unmarshalled response: stores the Hessian response
+ * (session->input) in the decision cache, replaces the request by the effective one and
+ * applies the OHs. The session buffers are always released.
+ */
+static pep_error_t pep_authorize_finish(PEP * pep, pep_session_t * session, xacml_request_t ** request, xacml_response_t ** response, int cacheable, int cache_rc) {
+    int i= 0;
+    int oh_rc;
+    xacml_request_t * effective_request;
+
+    /* store the received decision in the cache */
+    if (cacheable && cache_rc != PEP_CACHE_HIT) {
+        pep_authorize_store(pep,session,*request,*response);
+    }
+
+    /* not required anymore, kept for the next authorization */
+    pep_session_releasebuffers(session);
 
 
     /* get effective response */
@@ -668,6 +2349,14 @@ pep_error_t pep_authorize(PEP * pep, xacml_request_t ** request, xacml_response_
     /* apply obligation handlers if enabled and any */
     if (pep->option_ohs_enabled && pep_llist_length(pep->ohs) > 0) {
         size_t ohs_l= pep_llist_length(pep->ohs);
+        void * span;
+        uint64_t start;
+        if (pep_session_remaining(session) == 0) {
+            pep_log_error("pep_authorize: PEP#%d deadline exceeded before OHs processing.",pep->id);
+            return PEP_ERR_TIMEOUT;
+        }
+        span= pep_trace_start(pep,session,PEP_TRACE_OH);
+        start= pep_clock_us();
         pep_log_info("pep_authorize: PEP#%d %d OHs available, processing...",pep->id,(int)ohs_l);
         for (i= 0; i<ohs_l; i++) {
             pep_obligationhandler_t * oh= pep_llist_get(pep->ohs,i);
@@ -676,111 +2365,546 @@ pep_error_t pep_authorize(PEP * pep, xacml_request_t ** request, xacml_response_
                 oh_rc = oh->process(request,response);
                 if (oh_rc != 0) {
                     pep_log_error("pep_authorize: PEP#%d OH[%s] process(request,response) failed: %d.",pep->id,oh->id,oh_rc);
+                    pep_trace_end(pep,span,PEP_TRACE_OH,PEP_ERR_OH_PROCESS);
                     return PEP_ERR_OH_PROCESS;
                 }
             }
         }
+        pep_stats_phase(&(pep->metrics),PEP_PHASE_OH,pep_clock_us() - start);
+        pep_trace_end(pep,span,PEP_TRACE_OH,PEP_OK);
+    }
+    
+    return PEP_OK;
+}
+
+/**
+ * Stores the Hessian response (session->input) of the marshalled request (session->output)
+ * in the decision caches, if the unmarshalled response is cacheable.
+ */
+static void pep_authorize_store(PEP * pep, pep_session_t * session, const xacml_request_t * request, const xacml_response_t * response) {
+    if (!is_response_cacheable(pep,request,response)) {
+        return;
+    }
+    pep_buffer_rewind(session->output);
+    pep_buffer_rewind(session->input);
+    if (pep->option_cache_enabled && pep->cache != NULL
+        && pep_cache_store(pep->cache,pep_buffer_data(session->output),pep_buffer_length(session->output),pep_buffer_data(session->input),pep_buffer_length(session->input)) != PEP_CACHE_OK) {
+        pep_log_warn("pep_authorize: PEP#%d can't store XACML response in decision cache.",pep->id);
+    }
+    /* not stored if too large or being written by another process */
+    if (pep->shmcache != NULL
+        && pep_shmcache_store(pep->shmcache,pep_buffer_data(session->output),pep_buffer_length(session->output),pep_buffer_data(session->input),pep_buffer_length(session->input),pep->option_cache_ttl) != PEP_CACHE_OK) {
+        pep_log_debug("pep_authorize: PEP#%d XACML response not stored in shared memory decision cache.",pep->id);
+    }
+}
+
+/**
+ * Authorizes the requests within the given session. Each request is prepared (PIPs,
+ * marshalling and decision cache lookup) and the requests not found in the decision cache
+ * are sent in one Hessian list to the batch endpoint. The Hessian list of responses
+ * is unmarshalled, and each authorization is finished (OHs).
+ * Without batch endpoint, the requests are authorized one by one.
+ */
+static pep_error_t pep_authorize_batch_session(PEP * pep, pep_session_t * session, xacml_request_t ** requests, size_t n, xacml_response_t ** responses) {
+    pep_session_t * requests_sessions;
+    int * cacheables, * cache_rcs;
+    size_t sent_l= 0;
+    int i;
+    pep_error_t rc= PEP_OK;
+    void * span;
+
+    /* the sidecar daemon batches the requests itself */
+    if (pep->option_batch_endpoint_url == NULL || pep->option_sidecar_socket != NULL) {
+        pep_log_debug("pep_authorize_batch: PEP#%d no batch endpoint, authorizing %d requests one by one.",pep->id,(int)n);
+        for (i= 0; i < n && rc == PEP_OK; i++) {
+            rc= pep_authorize_session(pep,session,&(requests[i]),&(responses[i]));
+        }
+        return rc;
+    }
+
+    /* per request buffers (the curl handle is not used) and cache state */
+    requests_sessions= calloc(n,sizeof(pep_session_t));
+    cacheables= calloc(n,sizeof(int));
+    cache_rcs= calloc(n,sizeof(int));
+    if (requests_sessions == NULL || cacheables == NULL || cache_rcs == NULL) {
+        pep_log_error("pep_authorize_batch: PEP#%d can't allocate the state of %d requests.",pep->id,(int)n);
+        free(requests_sessions);
+        free(cacheables);
+        free(cache_rcs);
+        return PEP_ERR_MEMORY;
+    }
+
+    /* apply PIPs, marshal and lookup the decision cache for each request */
+    for (i= 0; i < n && rc == PEP_OK; i++) {
+        requests_sessions[i].trace= session->trace;
+        rc= pep_authorize_prepare(pep,&(requests_sessions[i]),&(requests[i]),&(cacheables[i]),&(cache_rcs[i]));
+        if (rc == PEP_OK && cache_rcs[i] != PEP_CACHE_HIT) {
+            sent_l++;
+        }
+    }
+
+    /* Hessian list of the marshalled requests to send: V l b32 b24 b16 b8 value* z */
+    if (rc == PEP_OK && sent_l > 0) {
+        if (pep_session_getbuffers(session) != 0) {
+            pep_log_error("pep_authorize_batch: PEP#%d can't create batch buffers.",pep->id);
+            rc= PEP_ERR_MEMORY;
+        }
+        else {
+            pep_batch_write_requests(session->output,requests_sessions,cache_rcs,n,sent_l);
+            pep_log_info("pep_authorize_batch: PEP#%d sending %d XACML requests (%d cached) to: %s",pep->id,(int)sent_l,(int)(n - sent_l),pep->option_batch_endpoint_url);
+            rc= pep_authorize_batch_send(pep,session);
+        }
+        if (rc == PEP_OK) {
+            rc= pep_batch_read_list(pep,session->input);
+        }
+        /* unmarshal each response, and keep its Hessian bytes for the cache */
+        span= (rc == PEP_OK) ? pep_trace_start(pep,session,PEP_TRACE_UNMARSHAL) : NULL;
+        for (i= 0; i < n && rc == PEP_OK; i++) {
+            const unsigned char * response_data;
+            size_t response_l;
+            if (cache_rcs[i] == PEP_CACHE_HIT) continue;
+            response_data= pep_buffer_data(session->input);
+            response_l= pep_buffer_length(session->input);
+            rc= xacml_response_unmarshalling(&(responses[i]),session->input);
+            if (rc != PEP_OK) {
+                pep_log_error("pep_authorize_batch: PEP#%d can't unmarshal the XACML response %d: %s.",pep->id,i,pep_strerror(rc));
+                break;
+            }
+            response_l -= pep_buffer_length(session->input);
+            if (cacheables[i]) {
+                pep_buffer_write(response_data,1,response_l,requests_sessions[i].input);
+            }
+        }
+        if (rc == PEP_OK && pep_buffer_getc(session->input) != 'z') {
+            pep_log_error("pep_authorize_batch: PEP#%d Hessian list of responses has more than %d responses.",pep->id,(int)sent_l);
+            rc= PEP_ERR_UNMARSHALLING_IO;
+        }
+        pep_trace_end(pep,span,PEP_TRACE_UNMARSHAL,rc);
+        /* the batch buffers are not kept */
+        pep_session_deletebuffers(session);
+    }
+
+    /* finish each authorization */
+    for (i= 0; i < n && rc == PEP_OK; i++) {
+        if (cache_rcs[i] == PEP_CACHE_HIT) {
+            rc= pep_authorize_complete(pep,&(requests_sessions[i]),&(requests[i]),&(responses[i]),cacheables[i],cache_rcs[i]);
+        }
+        else {
+            rc= pep_authorize_finish(pep,&(requests_sessions[i]),&(requests[i]),&(responses[i]),cacheables[i],cache_rcs[i]);
+        }
+    }
+
+    for (i= 0; i < n; i++) {
+        pep_session_deletebuffers(&(requests_sessions[i]));
+    }
+    free(requests_sessions);
+    free(cacheables);
+    free(cache_rcs);
+    return rc;
+}
+
+/**
+ * Writes the Hessian list of the marshalled requests to send, the ones not found in the
+ * decision caches: V l b32 b24 b16 b8 value* z
+ */
+static void pep_batch_write_requests(pep_buffer_t * output, pep_session_t * requests_sessions, const int * cache_rcs, size_t n, size_t sent_l) {
+    int i;
+    pep_buffer_putc('V',output);
+    pep_buffer_putc('l',output);
+    pep_buffer_putc((int)((sent_l >> 24) & 0xFF),output);
+    pep_buffer_putc((int)((sent_l >> 16) & 0xFF),output);
+    pep_buffer_putc((int)((sent_l >> 8) & 0xFF),output);
+    pep_buffer_putc((int)(sent_l & 0xFF),output);
+    for (i= 0; i < n; i++) {
+        if (cache_rcs[i] != PEP_CACHE_HIT) {
+            pep_buffer_write(pep_buffer_data(requests_sessions[i].output),1,pep_buffer_length(requests_sessions[i].output),output);
+        }
+    }
+    pep_buffer_putc('z',output);
+}
+
+/**
+ * Reads the header of the Hessian list of responses: V [t b16 b8 type] [l b32 b24 b16 b8],
+ * the responses follow.
+ */
+static pep_error_t pep_batch_read_list(PEP * pep, pep_buffer_t * input) {
+    int i, tag;
+    tag= pep_buffer_getc(input);
+    if (tag != 'V') {
+        pep_log_error("pep_authorize_batch: PEP#%d invalid Hessian list tag: %c (%d).",pep->id,(char)tag,tag);
+        return PEP_ERR_UNMARSHALLING_IO;
+    }
+    tag= pep_buffer_getc(input);
+    if (tag == 't') {
+        int b16= pep_buffer_getc(input);
+        int b8= pep_buffer_getc(input);
+        size_t type_l= (b16 << 8) + b8;
+        while (type_l-- > 0) pep_buffer_getc(input);
+        tag= pep_buffer_getc(input);
+    }
+    if (tag == 'l') {
+        for (i= 0; i < 4; i++) pep_buffer_getc(input);
+    }
+    else {
+        pep_buffer_ungetc(tag,input);
+    }
+    return PEP_OK;
+}
+
+/**
+ * Sends the Hessian list of requests (session->output) to the batch endpoint, and writes
+ * the received Hessian list of responses into session->input.
+ */
+static pep_error_t pep_authorize_batch_send(PEP * pep, pep_session_t * session) {
+    CURLcode curl_rc;
+    pep_error_t rc;
+    char * target, * socket;
+    const char * endpoint_socket;
+    const char * endpoint_target;
+
+    rc= pep_authorize_setup(pep,session);
+    if (rc != PEP_OK) {
+        return rc;
+    }
+    target= pep_endpoint_parseurl(pep->option_batch_endpoint_url,&socket);
+    if (target == NULL) {
+        pep_log_error("pep_authorize_batch: PEP#%d invalid batch endpoint url: %s.",pep->id,pep->option_batch_endpoint_url);
+        return PEP_ERR_OPTION_INVALID;
+    }
+    curl_rc= set_curl_url(session->curl,target,socket);
+    free(target);
+    free(socket);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize_batch: PEP#%d curl_easy_setopt(curl,CURLOPT_URL,%s) failed: %s.",pep->id,pep->option_batch_endpoint_url,curl_easy_strerror(curl_rc));
+        return PEP_ERR_CURL + curl_rc;
+    }
+    session->sent= pep_clock_us();
+    session->trace_transfer= pep_trace_start(pep,session,PEP_TRACE_TRANSFER);
+    curl_rc= curl_easy_perform(session->curl);
+    /* restore the endpoint url */
+    endpoint_target= pep_endpoints_gettarget(pep->endpoints,0,&endpoint_socket);
+    set_curl_url(session->curl,endpoint_target,endpoint_socket);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("pep_authorize_batch: PEP#%d sending XACML requests to %s failed: curl[%d] %s.",pep->id,pep->option_batch_endpoint_url,(int)curl_rc,curl_easy_strerror(curl_rc));
+        rc= PEP_ERR_CURL + curl_rc;
+    }
+    else {
+        rc= pep_authorize_received(pep,session);
     }
-    
-    return PEP_OK;
+    pep_stats_transfer(&(pep->metrics),session,rc);
+    pep_trace_transfer_end(pep,session,pep->option_batch_endpoint_url,TRUE,(curl_rc == CURLE_OK) ? PEP_OK : PEP_ERR_CURL + curl_rc,rc);
+    return rc;
 }
 
-/* no return code, not useful */
-void pep_destroy(PEP * pep) {
-    int pips_destroy_rc= 0;
-    int ohs_destroy_rc= 0;
-    
-    if (pep == NULL) return;
+/**
+ * Authorizes the marshalled request of a sidecar client within the given session: looks up
+ * the decision caches, joins an identical request in flight or sends the request, and
+ * writes the Hessian response into response. The cache filter needs the request object,
+ * with a filter the requests are not cached.
+ */
+static pep_error_t pep_sidecar_authorize_session(PEP * pep, pep_session_t * session, pep_buffer_t * request, pep_buffer_t * response) {
+    int cacheable= FALSE, cache_rc= PEP_CACHE_MISS;
+    pep_error_t rc= PEP_OK;
 
-    /* release curl http headers */
-    if (pep->curl_http_headers != NULL) {
-        curl_slist_free_all(pep->curl_http_headers);
-        pep->curl_http_headers= NULL;
+    if (pep_session_getbuffers(session) != 0) {
+        pep_log_error("pep_sidecar_authorize_session: PEP#%d can't create output and input buffers.",pep->id);
+        return PEP_ERR_MEMORY;
     }
+    pep_buffer_write(pep_buffer_data(request),1,pep_buffer_length(request),session->output);
 
-    /* release curl */
-    if (pep->curl != NULL) {
-        curl_easy_cleanup(pep->curl);
-        pep->curl= NULL;
-    }
-    
-    /* free options... */
-    if (pep->option_endpoint_url != NULL) {
-        free(pep->option_endpoint_url);
-        pep->option_endpoint_url= NULL;
+    if (((pep->option_cache_enabled && pep->cache != NULL) || pep->shmcache != NULL) && pep->option_cache_filter == NULL) {
+        cacheable= TRUE;
     }
-    if (pep->option_ssl_cipher_list != NULL) {
-        free(pep->option_ssl_cipher_list);
-        pep->option_ssl_cipher_list= NULL;
+    pep_authorize_lookup(pep,session,cacheable,&cache_rc);
+    if (cache_rc != PEP_CACHE_HIT) {
+        rc= pep_authorize_exchange(pep,session,&cacheable);
+        if (rc == PEP_OK && cacheable) {
+            pep_sidecar_store(pep,session,session->input);
+        }
     }
-    if (pep->option_server_cert != NULL) {
-        free(pep->option_server_cert);
-        pep->option_server_cert= NULL;
+    if (rc == PEP_OK) {
+        pep_buffer_write(pep_buffer_data(session->input),1,pep_buffer_length(session->input),response);
     }
-    if (pep->option_server_capath != NULL) {
-        free(pep->option_server_capath);
-        pep->option_server_capath= NULL;
+    pep_session_releasebuffers(session);
+    return rc;
+}
+
+/**
+ * Authorizes the marshalled requests of sidecar clients in one batch request, see
+ * pep_authorize_batch_session. The requests found in the decision caches are not sent.
+ */
+static pep_error_t pep_sidecar_batch_session(PEP * pep, pep_session_t * session, pep_buffer_t ** requests, pep_buffer_t ** responses, pep_error_t * rcs, size_t n) {
+    pep_session_t * requests_sessions;
+    int * cache_rcs;
+    int cacheable= FALSE;
+    size_t sent_l= 0;
+    int i;
+    pep_error_t rc= PEP_OK;
+
+    /* per request buffers (the curl handle is not used) and cache state */
+    requests_sessions= calloc(n,sizeof(pep_session_t));
+    cache_rcs= calloc(n,sizeof(int));
+    if (requests_sessions == NULL || cache_rcs == NULL) {
+        pep_log_error("pep_sidecar_batch_session: PEP#%d can't allocate the state of %d requests.",pep->id,(int)n);
+        free(requests_sessions);
+        free(cache_rcs);
+        return PEP_ERR_MEMORY;
     }
-    if (pep->option_client_cert != NULL) {
-        free(pep->option_client_cert);
-        pep->option_client_cert= NULL;
+
+    /* lookup the decision caches for each request */
+    if (((pep->option_cache_enabled && pep->cache != NULL) || pep->shmcache != NULL) && pep->option_cache_filter == NULL) {
+        cacheable= TRUE;
     }
-    if (pep->option_client_key != NULL) {
-        free(pep->option_client_key);
-        pep->option_client_key= NULL;
+    for (i= 0; i < n && rc == PEP_OK; i++) {
+        if (pep_session_getbuffers(&(requests_sessions[i])) != 0) {
+            rc= PEP_ERR_MEMORY;
+            break;
+        }
+        pep_buffer_write(pep_buffer_data(requests[i]),1,pep_buffer_length(requests[i]),requests_sessions[i].output);
+        pep_authorize_lookup(pep,&(requests_sessions[i]),cacheable,&(cache_rcs[i]));
+        if (cache_rcs[i] != PEP_CACHE_HIT) {
+            sent_l++;
+        }
     }
-    if (pep->option_client_keypassword != NULL) {
-        memset(pep->option_client_keypassword,'\0',strlen(pep->option_client_keypassword));
-        free(pep->option_client_keypassword);
-        pep->option_client_keypassword= NULL;
+
+    if (rc == PEP_OK && sent_l > 0) {
+        if (pep_session_getbuffers(session) != 0) {
+            pep_log_error("pep_sidecar_batch_session: PEP#%d can't create batch buffers.",pep->id);
+            rc= PEP_ERR_MEMORY;
+        }
+        else if (session->deadline != 0 && set_session_timeouts(pep,session) != 0) {
+            pep_log_error("pep_sidecar_batch_session: PEP#%d deadline exceeded, XACML requests not sent.",pep->id);
+            rc= PEP_ERR_TIMEOUT;
+        }
+        else {
+            pep_batch_write_requests(session->output,requests_sessions,cache_rcs,n,sent_l);
+            pep_log_info("pep_sidecar_batch_session: PEP#%d sending %d XACML requests (%d cached) to: %s",pep->id,(int)sent_l,(int)(n - sent_l),pep->option_batch_endpoint_url);
+            rc= pep_authorize_batch_send(pep,session);
+        }
+        if (rc == PEP_OK) {
+            rc= pep_batch_read_list(pep,session->input);
+        }
+        /* split the Hessian list: each response is unmarshalled to find its end */
+        for (i= 0; i < n && rc == PEP_OK; i++) {
+            xacml_response_t * response= NULL;
+            const unsigned char * response_data;
+            size_t response_l;
+            if (cache_rcs[i] == PEP_CACHE_HIT) continue;
+            response_data= pep_buffer_data(session->input);
+            response_l= pep_buffer_length(session->input);
+            rc= xacml_response_unmarshalling(&response,session->input);
+            if (rc != PEP_OK) {
+                pep_log_error("pep_sidecar_batch_session: PEP#%d can't unmarshal the XACML response %d: %s.",pep->id,i,pep_strerror(rc));
+                break;
+            }
+            xacml_response_delete(response);
+            response_l -= pep_buffer_length(session->input);
+            pep_buffer_write(response_data,1,response_l,requests_sessions[i].input);
+            if (cacheable) {
+                pep_sidecar_store(pep,&(requests_sessions[i]),requests_sessions[i].input);
+            }
+        }
+        if (rc == PEP_OK && pep_buffer_getc(session->input) != 'z') {
+            pep_log_error("pep_sidecar_batch_session: PEP#%d Hessian list of responses has more than %d responses.",pep->id,(int)sent_l);
+            rc= PEP_ERR_UNMARSHALLING_IO;
+        }
+        pep_session_releasebuffers(session);
     }
 
-    /* destroy all pips if any */
-    while (pep_llist_length(pep->pips) > 0) {
-        pep_pip_t * pip= pep_llist_remove(pep->pips,0);
-        if (pip != NULL) {
-            pips_destroy_rc += pip->destroy();
+    /* the requests found in the caches succeed even if the batch failed */
+    for (i= 0; i < n; i++) {
+        pep_error_t request_rc= (cache_rcs[i] == PEP_CACHE_HIT) ? PEP_OK : rc;
+        if (request_rc == PEP_OK) {
+            pep_buffer_write(pep_buffer_data(requests_sessions[i].input),1,pep_buffer_length(requests_sessions[i].input),responses[i]);
         }
+        if (rcs != NULL) rcs[i]= request_rc;
+        pep_session_deletebuffers(&(requests_sessions[i]));
     }
-    pep_llist_delete(pep->pips);
-    if (pips_destroy_rc > 0) {
-        pep_log_warn("pep_destroy: some PIP->destroy() failed...");
+    free(requests_sessions);
+    free(cache_rcs);
+    return rc;
+}
+
+/**
+ * Stores the received Hessian response of a sidecar client in the decision caches:
+ * the response is unmarshalled to check its decisions are cacheable.
+ */
+static void pep_sidecar_store(PEP * pep, pep_session_t * session, pep_buffer_t * input) {
+    xacml_response_t * response= NULL;
+    if (xacml_response_unmarshalling(&response,input) == PEP_OK) {
+        pep_authorize_store(pep,session,NULL,response);
     }
+    xacml_response_delete(response);
+    pep_buffer_rewind(input);
+}
 
-    /* destroy all obligation handlers if any */
-    while (pep_llist_length(pep->ohs) > 0) {
-        pep_obligationhandler_t * oh= pep_llist_remove(pep->ohs,0);
-        if (oh != NULL) {
-            ohs_destroy_rc += oh->destroy();
+/**
+ * Completes an asynchronous authorization, removed from the pending ones: decodes
+ * the response, applies the OHs, releases the transfer and calls the callback.
+ */
+static void pep_async_deliver(PEP * pep, pep_async_transfer_t * transfer) {
+    pep_authorize_callback * callback= transfer->callback;
+    void * userdata= transfer->userdata;
+    xacml_request_t * request= transfer->request;
+    xacml_response_t * response= NULL;
+    pep_error_t rc= transfer->rc;
+    if (transfer->session.tried != 0 && rc != PEP_ERR_CANCELLED) {
+        /* sent to an endpoint: on failure, resend to the next one */
+        rc= pep_endpoint_done(pep,&(transfer->session),rc);
+        if (rc != PEP_OK && pep_endpoint_next(pep,&(transfer->session)) >= 0) {
+            if (pep_async_start(pep->async,transfer) == 0) {
+                return;
+            }
+            rc= PEP_ERR_AUTHZ_REQUEST;
         }
     }
-    pep_llist_delete(pep->ohs);
-    if (ohs_destroy_rc > 0) {
-        pep_log_warn("pep_destroy: some OH->destroy() failed...");
+    else if (rc != PEP_OK && rc != PEP_ERR_CANCELLED) {
+        pep_log_error("pep_authorize_async: PEP#%d XACML request failed: %s.",pep->id,pep_strerror(rc));
+    }
+    if (rc == PEP_OK) {
+        rc= pep_authorize_complete(pep,&(transfer->session),&request,&response,transfer->cacheable,transfer->cache_rc);
+    }
+    pep_stats_result(&(pep->metrics),rc,response);
+    pep_trace_close(pep,&(transfer->session),rc);
+    /* the callback can submit new requests */
+    pep_async_transfer_release(pep->async,transfer);
+    callback(pep,request,response,rc,userdata);
+}
+
+/**
+ * Starts the authorization span of the session, if a tracer is set.
+ */
+static void pep_trace_begin(PEP * pep, pep_session_t * session) {
+    session->trace= NULL;
+    session->trace_transfer= NULL;
+    if (pep->option_tracer.start != NULL) {
+        session->trace= pep->option_tracer.start(pep->id,PEP_TRACE_AUTHORIZE,NULL,pep->option_tracer.userdata);
     }
+}
 
-    /* destroy all endpoint urls if any */
-    pep_llist_delete(pep->option_endpoint_urls);
+/**
+ * Ends the authorization span of the session, and its transfer span still open
+ * (asynchronous transfer cancelled or not started).
+ */
+static void pep_trace_close(PEP * pep, pep_session_t * session, pep_error_t rc) {
+    if (session->trace == NULL) return;
+    if (session->trace_transfer != NULL) {
+        pep_trace_transfer_end(pep,session,pep_endpoints_geturl(pep->endpoints,session->endpoint),FALSE,PEP_ERR_CANCELLED,(rc != PEP_OK) ? rc : PEP_ERR_CANCELLED);
+    }
+    pep_trace_end(pep,session->trace,PEP_TRACE_AUTHORIZE,rc);
+    session->trace= NULL;
+}
 
-    free(pep);
+/**
+ * Starts the span of a phase of the session authorization.
+ *
+ * @return the span, or NULL if the authorization is not traced.
+ */
+static void * pep_trace_start(PEP * pep, const pep_session_t * session, pep_trace_phase_t phase) {
+    if (session->trace == NULL || pep->option_tracer.start == NULL) {
+        return NULL;
+    }
+    return pep->option_tracer.start(pep->id,phase,session->trace,pep->option_tracer.userdata);
 }
 
+/**
+ * Ends the span, if traced.
+ */
+static void pep_trace_end(PEP * pep, void * span, pep_trace_phase_t phase, pep_error_t rc) {
+    pep_trace_attributes_t attributes;
+    if (span == NULL || pep->option_tracer.end == NULL) return;
+    memset(&attributes,0,sizeof(pep_trace_attributes_t));
+    attributes.rc= rc;
+    pep->option_tracer.end(span,phase,&attributes,pep->option_tracer.userdata);
+}
 
-/**************************/
-/*** INTERNAL FUNCTIONS ***/
-/**************************/
+/**
+ * Ends the transfer span of the session, if traced. The bytes and the HTTP status are
+ * read from the easy handle if the transfer was performed.
+ */
+static void pep_trace_transfer_end(PEP * pep, pep_session_t * session, const char * endpoint, int performed, pep_error_t transfer_rc, pep_error_t rc) {
+    pep_trace_attributes_t attributes;
+    void * span= session->trace_transfer;
+    if (span == NULL) return;
+    session->trace_transfer= NULL;
+    if (pep->option_tracer.end == NULL) return;
+    memset(&attributes,0,sizeof(pep_trace_attributes_t));
+    attributes.rc= rc;
+    attributes.endpoint= endpoint;
+    if (transfer_rc >= PEP_ERR_CURL) {
+        attributes.curl_code= transfer_rc - PEP_ERR_CURL;
+    }
+    if (performed) {
+        attributes.bytes_sent= pep_stats_bytes(session->curl,1);
+        attributes.bytes_received= pep_stats_bytes(session->curl,0);
+        curl_easy_getinfo(session->curl,CURLINFO_RESPONSE_CODE,&(attributes.http_status));
+    }
+    pep->option_tracer.end(span,PEP_TRACE_TRANSFER,&attributes,pep->option_tracer.userdata);
+}
+
+/**
+ * Returns TRUE if the XACML response can be stored in the decision cache: all results
+ * have a definitive decision with an OK status, no result carries an uncacheable
+ * obligation, and the optional cache filter accepts it.
+ */
+static int is_response_cacheable(const PEP * pep, const xacml_request_t * request, const xacml_response_t * response) {
+    size_t results_l, obligations_l, uncacheables_l;
+    int i, j, k;
+    results_l= xacml_response_results_length(response);
+    if (results_l == 0) {
+        return FALSE;
+    }
+    uncacheables_l= pep_llist_length(pep->option_cache_uncacheable_obligations);
+    for (i= 0; i < results_l; i++) {
+        xacml_result_t * result= xacml_response_getresult(response,i);
+        xacml_status_t * status= xacml_result_getstatus(result);
+        if (xacml_result_getdecision(result) == XACML_DECISION_INDETERMINATE) {
+            pep_log_debug("is_response_cacheable: PEP#%d result[%d] decision is Indeterminate.",pep->id,i);
+            return FALSE;
+        }
+        if (status != NULL) {
+            xacml_statuscode_t * statuscode= xacml_status_getcode(status);
+            const char * value= xacml_statuscode_getvalue(statuscode);
+            if (value != NULL && strcmp(XACML_STATUSCODE_OK,value) != 0) {
+                pep_log_debug("is_response_cacheable: PEP#%d result[%d] status code is %s.",pep->id,i,value);
+                return FALSE;
+            }
+        }
+        obligations_l= xacml_result_obligations_length(result);
+        for (j= 0; j < obligations_l && uncacheables_l > 0; j++) {
+            const char * obligation_id= xacml_obligation_getid(xacml_result_getobligation(result,j));
+            if (obligation_id == NULL) continue;
+            for (k= 0; k < uncacheables_l; k++) {
+                const char * uncacheable_id= pep_llist_get(pep->option_cache_uncacheable_obligations,k);
+                if (uncacheable_id != NULL && strcmp(uncacheable_id,obligation_id) == 0) {
+                    pep_log_debug("is_response_cacheable: PEP#%d result[%d] has uncacheable obligation %s.",pep->id,i,obligation_id);
+                    return FALSE;
+                }
+            }
+        }
+    }
+    if (pep->option_cache_filter != NULL && !pep->option_cache_filter(request,response)) {
+        pep_log_debug("is_response_cacheable: PEP#%d cache filter rejected the response.",pep->id);
+        return FALSE;
+    }
+    return TRUE;
+}
 
 /** set the pep handle default values */
 static void init_pep_defaults(PEP * pep) {
     if (pep==NULL) return;
     /* increase client counter */
     pep->id= n_pep_clients++;
-    pep->curl_http_headers= NULL;
+    memset(pep->curl_http_headers,0,sizeof(pep->curl_http_headers));
     /* set default options */
     pep->option_endpoint_url= NULL;
     pep->option_loglevel= DEFAULT_LOG_LEVEL;
     pep->option_logout= (FILE *)DEFAULT_LOG_FILE;
     pep->option_timeout= (long)DEFAULT_CURL_TIMEOUT; 
+    pep->option_connect_timeout_ms= 0;
+    pep->option_transfer_timeout_ms= 0;
+    pep->option_circuit_threshold= DEFAULT_CIRCUIT_THRESHOLD;
+    pep->option_circuit_open_time= DEFAULT_CIRCUIT_OPEN_TIME;
     pep->option_server_cert= NULL;
     pep->option_server_capath= NULL;
     pep->option_client_cert= NULL;
@@ -790,20 +2914,51 @@ static void init_pep_defaults(PEP * pep) {
     pep->option_ssl_cipher_list= NULL;
     pep->option_pips_enabled= DEFAULT_PIPS_ENABLED;
     pep->option_ohs_enabled= DEFAULT_OHS_ENABLED;
+    pep->option_cache_enabled= DEFAULT_CACHE_ENABLED;
+    pep->option_cache_ttl= DEFAULT_CACHE_TTL;
+    pep->option_cache_max_size= DEFAULT_CACHE_MAX_SIZE;
+    pep->option_cache_admission= DEFAULT_CACHE_ADMISSION;
+    pep->option_cache_filter= NULL;
+    pep->cache= NULL;
+    pep->option_session_pool_size= 0;
+    pep->pool= NULL;
+    pep->generation= 0;
+    pep->async= NULL;
+    pep->option_hedge_delay= DEFAULT_HEDGE_DELAY;
+    pep->option_hedge_adaptive= DEFAULT_HEDGE_ADAPTIVE;
+    pep->option_http_version= DEFAULT_HTTP_VERSION;
+    pep->option_share= NULL;
+    pep->option_tcp_nodelay= DEFAULT_TCP_NODELAY;
+    pep->option_tcp_keepalive= DEFAULT_TCP_KEEPALIVE;
+    pep->option_tcp_fastopen= DEFAULT_TCP_FASTOPEN;
+    pep->option_wire_encoding= DEFAULT_WIRE_ENCODING;
+    pep->option_compression= DEFAULT_COMPRESSION;
+    pep->option_compression_threshold= DEFAULT_COMPRESSION_THRESHOLD;
+    pep->option_single_flight= DEFAULT_SINGLE_FLIGHT;
+    pep->flights= NULL;
+    pep->option_shm_cache_size= DEFAULT_SHM_CACHE_SIZE;
+    pep->shmcache= NULL;
+    pep->option_sidecar_socket= NULL;
+    memset(&(pep->option_tracer),0,sizeof(pep_tracer_t));
 }
 
 /** set some curl default value */
 static void init_curl_defaults(PEP * pep) {
     /* set default http headers */
     set_curl_http_headers(pep);
-    /* set default timeout */
+    /* set default timeouts */
     set_curl_connection_timeout(pep);
+    set_curl_connect_timeout(pep);
     /* set default ssl validation */
     set_curl_ssl_validation(pep);
     /* disable signal for multi-threading */
     set_curl_nosignal(pep);
     /* enable curl SSL option CURLSSLOPT_ALLOW_BEAST (libcurl >= 7.25) */
     set_curl_ssl_option_allow_beast(pep);
+    /* set default socket options */
+    set_curl_tcp_nodelay(pep);
+    set_curl_tcp_keepalive(pep);
+    set_curl_tcp_fastopen(pep);
 }
 
 /**
@@ -827,20 +2982,84 @@ static int set_curl_ssl_option_allow_beast(PEP * pep) {
     return 0;
 }
 
-/** 
- * set curl http headers:
+/**
+ * Creates the curl http headers list of the index (HTTP_HEADERS_BINARY | HTTP_HEADERS_GZIP):
  * - disable 'Expect: 100-continue' HTTP 1.1 header in POST
  * - set 'User-Agent: <value>' header
+ * - set 'Content-Type:' and 'Accept:' headers for the raw Hessian wire encoding
+ * - set 'Content-Encoding: gzip' header for the compressed request body
+ * Returns NULL on allocation failure.
+ */
+static struct curl_slist * create_curl_http_headers(PEP * pep, int i) {
+    struct curl_slist * headers= NULL, * appended;
+    const char * values[5];
+    int values_l= 0, j;
+    values[values_l++]= "Expect:";
+    values[values_l++]= "User-Agent: " PACKAGE_NAME "/" PACKAGE_VERSION;
+    if (i & HTTP_HEADERS_BINARY) {
+        values[values_l++]= "Content-Type: " HESSIAN_CONTENT_TYPE;
+        values[values_l++]= "Accept: " HESSIAN_CONTENT_TYPE;
+    }
+    if (i & HTTP_HEADERS_GZIP) {
+        values[values_l++]= "Content-Encoding: gzip";
+    }
+    for (j= 0; j < values_l; j++) {
+        appended= curl_slist_append(headers, values[j]);
+        if (appended == NULL) {
+            curl_slist_free_all(headers);
+            return NULL;
+        }
+        headers= appended;
+        pep_log_debug("set_curl_http_headers: PEP#%d curl_http_headers[%d]: '%s'",pep->id,i,values[j]);
+    }
+    return headers;
+}
+
+/**
+ * Returns the curl http headers list for the wire encoding and the request body
+ * compression, or NULL if it can't be allocated. The lists are created by
+ * set_curl_http_headers, under the serialized pep_initialize and pep_setoption, and
+ * only read here: the shared handle sessions use them concurrently. The lists are only
+ * freed by pep_destroy: the duplicated curl handles still running can keep a pointer to
+ * one of them.
+ */
+static struct curl_slist * get_curl_http_headers(PEP * pep, int gzip) {
+    int i= (pep->option_wire_encoding == PEP_WIRE_ENCODING_BINARY ? HTTP_HEADERS_BINARY : 0) | (gzip ? HTTP_HEADERS_GZIP : 0);
+    return pep->curl_http_headers[i];
+}
+
+/**
+ * Frees the curl http headers lists.
+ */
+static void free_curl_http_headers(PEP * pep) {
+    int i;
+    for (i= 0; i < 4; i++) {
+        if (pep->curl_http_headers[i] != NULL) {
+            curl_slist_free_all(pep->curl_http_headers[i]);
+            pep->curl_http_headers[i]= NULL;
+        }
+    }
+}
+
+/** 
+ * Creates the missing curl http headers lists, and sets the headers of the template
+ * handle, see get_curl_http_headers
  */
 static int set_curl_http_headers(PEP * pep) {
     CURLcode curl_rc;
-    /* disable 'Expect: 100-continue' HTTP 1.1 header in POST */
-    pep->curl_http_headers= curl_slist_append(pep->curl_http_headers, "Expect:");  
-    pep_log_debug("set_curl_http_headers: PEP#%d curl_http_headers: 'Expect:'",pep->id);    
-    /* set 'User-Agent:' header */
-    pep->curl_http_headers= curl_slist_append(pep->curl_http_headers, "User-Agent: " PACKAGE_NAME "/" PACKAGE_VERSION );  
-    pep_log_debug("set_curl_http_headers: PEP#%d curl_http_headers: 'User-Agent: " PACKAGE_NAME "/" PACKAGE_VERSION "'",pep->id);    
-    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_HTTPHEADER, pep->curl_http_headers);
+    struct curl_slist * headers;
+    int i;
+    for (i= 0; i < 4; i++) {
+        if (pep->curl_http_headers[i] == NULL) {
+            pep->curl_http_headers[i]= create_curl_http_headers(pep,i);
+            if (pep->curl_http_headers[i] == NULL) {
+                pep_log_error("set_curl_http_headers: PEP#%d can't allocate the curl_http_headers[%d] list.",pep->id,i);
+                return 1;
+            }
+        }
+    }
+    headers= get_curl_http_headers(pep,FALSE);
+    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_HTTPHEADER, headers);
     if (curl_rc != CURLE_OK) {
         pep_log_warn("set_curl_http_headers: PEP#%d curl_easy_setopt(curl,CURLOPT_HTTPHEADER,curl_http_headers) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
         return 1;
@@ -848,6 +3067,26 @@ static int set_curl_http_headers(PEP * pep) {
     return 0;
 }
 
+/**
+ * set the curl accepted encodings of the response: all the encodings supported by
+ * libcurl when compression is enabled, none otherwise.
+ */
+static int set_curl_accept_encoding(const PEP * pep) {
+    CURLcode curl_rc;
+    const char * encoding= pep->option_compression ? "" : NULL;
+    pep_log_debug("set_curl_accept_encoding: PEP#%d option_compression: %s",pep->id,pep->option_compression ? "TRUE" : "FALSE");
+#if LIBCURL_VERSION_NUM >= 0x071506
+    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_ACCEPT_ENCODING, encoding);
+#else
+    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_ENCODING, encoding);
+#endif
+    if (curl_rc != CURLE_OK) {
+        pep_log_warn("set_curl_accept_encoding: PEP#%d curl_easy_setopt(curl,CURLOPT_ACCEPT_ENCODING) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return 1;
+    }
+    return 0;
+}
+
 /** disable signal for multi-threading */
 static int set_curl_nosignal(const PEP * pep) {
     CURLcode curl_rc;
@@ -860,11 +3099,13 @@ static int set_curl_nosignal(const PEP * pep) {
     return 0;
 }
 
-/** set libcurl CURLOPT_URL */
+/** set libcurl CURLOPT_URL and CURLOPT_UNIX_SOCKET_PATH to the first endpoint */
 static int set_curl_endpoint_url(const PEP * pep) {
     CURLcode curl_rc;
+    const char * socket;
+    const char * target= pep_endpoints_gettarget(pep->endpoints,0,&socket);
     pep_log_debug("set_curl_endpoint_url: PEP#%d option_endpoint_url: %s",pep->id,pep->option_endpoint_url);
-    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_URL, pep->option_endpoint_url);
+    curl_rc= set_curl_url(pep->curl,target,socket);
     if (curl_rc != CURLE_OK) {
         pep_log_error("set_curl_endpoint_url: PEP#%d curl_easy_setopt(curl,CURLOPT_URL,%s) failed: %s.",pep->id,pep->option_endpoint_url,curl_easy_strerror(curl_rc));
         return 1;
@@ -872,19 +3113,202 @@ static int set_curl_endpoint_url(const PEP * pep) {
     return 0;
 }
 
+/*
+ * set libcurl CURLOPT_URL, and CURLOPT_UNIX_SOCKET_PATH to the socket of a unix:// endpoint
+ * or to NULL (libcurl >= 7.40)
+ */
+static CURLcode set_curl_url(CURL * curl, const char * url, const char * socket) {
+#if LIBCURL_VERSION_NUM >= 0x072800
+    CURLcode curl_rc= curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, socket);
+    if (curl_rc != CURLE_OK) {
+        return curl_rc;
+    }
+#endif
+    return curl_easy_setopt(curl, CURLOPT_URL, url);
+}
+
+/* transfer timeout in ms: the PEP_OPTION_ENDPOINT_TRANSFER_TIMEOUT_MS one, or PEP_OPTION_ENDPOINT_TIMEOUT */
+static long get_transfer_timeout_ms(const PEP * pep) {
+    if (pep->option_transfer_timeout_ms > 0) {
+        return pep->option_transfer_timeout_ms;
+    }
+    return pep->option_timeout * 1000L;
+}
 
-/* set libcurl CURLOPT_TIMEOUT */
+/* set libcurl CURLOPT_TIMEOUT_MS */
 static int set_curl_connection_timeout(const PEP * pep) {
     CURLcode curl_rc;
-    pep_log_debug("set_curl_connection_timeout: PEP#%d option_timeout: %d",pep->id,(int)(pep->option_timeout));
-    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_TIMEOUT, pep->option_timeout);
+    long timeout_ms= get_transfer_timeout_ms(pep);
+    pep_log_debug("set_curl_connection_timeout: PEP#%d transfer timeout: %d ms",pep->id,(int)timeout_ms);
+    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("set_curl_connection_timeout: PEP#%d curl_easy_setopt(curl,CURLOPT_TIMEOUT_MS,%d) failed: %s",pep->id, (int)timeout_ms,curl_easy_strerror(curl_rc));
+        return 1;
+    }
+    return 0;
+}
+
+/* set libcurl CURLOPT_CONNECTTIMEOUT_MS, 0 is the libcurl default (300s) */
+static int set_curl_connect_timeout(const PEP * pep) {
+    CURLcode curl_rc;
+    pep_log_debug("set_curl_connect_timeout: PEP#%d option_connect_timeout_ms: %d",pep->id,(int)(pep->option_connect_timeout_ms));
+    curl_rc= curl_easy_setopt(pep->curl, CURLOPT_CONNECTTIMEOUT_MS, pep->option_connect_timeout_ms);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("set_curl_connect_timeout: PEP#%d curl_easy_setopt(curl,CURLOPT_CONNECTTIMEOUT_MS,%d) failed: %s",pep->id, (int)(pep->option_connect_timeout_ms),curl_easy_strerror(curl_rc));
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * set the connect and transfer timeouts of the session easy handle, lowered to the
+ * time left before the session deadline. Returns -1 if the deadline passed.
+ */
+static int set_session_timeouts(const PEP * pep, pep_session_t * session) {
+    long connect_ms= pep->option_connect_timeout_ms;
+    long transfer_ms= get_transfer_timeout_ms(pep);
+    long remaining_ms= pep_session_remaining(session);
+    if (remaining_ms == 0) {
+        return -1;
+    }
+    if (remaining_ms > 0) {
+        /* 0 is no timeout for libcurl */
+        if (connect_ms == 0 || connect_ms > remaining_ms) connect_ms= remaining_ms;
+        if (transfer_ms == 0 || transfer_ms > remaining_ms) transfer_ms= remaining_ms;
+    }
+    curl_easy_setopt(session->curl, CURLOPT_CONNECTTIMEOUT_MS, connect_ms);
+    curl_easy_setopt(session->curl, CURLOPT_TIMEOUT_MS, transfer_ms);
+    return 0;
+}
+
+/* clear the session deadline, and restore the handle timeouts lowered to it */
+static void clear_session_deadline(const PEP * pep, pep_session_t * session) {
+    session->deadline= 0;
+    set_session_timeouts(pep,session);
+    if (session->hedge != NULL && session->hedge->deadline != 0) {
+        session->hedge->deadline= 0;
+        set_session_timeouts(pep,session->hedge);
+    }
+}
+
+/*
+ * set libcurl CURLOPT_HTTP_VERSION, and CURLOPT_PIPEWAIT for HTTP/2: the asynchronous
+ * transfers wait for the multiplexed connection rather than opening new ones.
+ */
+static int set_curl_http_version(const PEP * pep) {
+    CURLcode curl_rc;
+    long http_version;
+    switch (pep->option_http_version) {
+        case PEP_HTTP_VERSION_1_1:
+            http_version= CURL_HTTP_VERSION_1_1;
+            break;
+#if LIBCURL_VERSION_NUM >= 0x072f00
+        case PEP_HTTP_VERSION_2:
+            http_version= CURL_HTTP_VERSION_2TLS;
+            break;
+#elif LIBCURL_VERSION_NUM >= 0x072100
+        case PEP_HTTP_VERSION_2:
+            http_version= CURL_HTTP_VERSION_2_0;
+            break;
+#endif
+#if LIBCURL_VERSION_NUM >= 0x073100
+        case PEP_HTTP_VERSION_2_PRIOR_KNOWLEDGE:
+            http_version= CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+            break;
+#endif
+        case PEP_HTTP_VERSION_DEFAULT:
+            http_version= CURL_HTTP_VERSION_NONE;
+            break;
+        default:
+            pep_log_error("set_curl_http_version: PEP#%d HTTP version %d not supported by libcurl %s.",pep->id,(int)pep->option_http_version,LIBCURL_VERSION);
+            return 1;
+    }
+    pep_log_debug("set_curl_http_version: PEP#%d curl_easy_setopt(curl,CURLOPT_HTTP_VERSION,%d)",pep->id,(int)http_version);
+    curl_rc= curl_easy_setopt(pep->curl,CURLOPT_HTTP_VERSION,http_version);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("set_curl_http_version: PEP#%d curl_easy_setopt(curl,CURLOPT_HTTP_VERSION,%d) failed: %s.",pep->id,(int)http_version,curl_easy_strerror(curl_rc));
+        return 1;
+    }
+#if LIBCURL_VERSION_NUM >= 0x072b00
+    curl_rc= curl_easy_setopt(pep->curl,CURLOPT_PIPEWAIT,(pep->option_http_version >= PEP_HTTP_VERSION_2) ? 1L : 0L);
+    if (curl_rc != CURLE_OK) {
+        pep_log_warn("set_curl_http_version: PEP#%d curl_easy_setopt(curl,CURLOPT_PIPEWAIT) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+    }
+#endif
+    return 0;
+}
+
+/* set libcurl CURLOPT_SHARE, or unshare if option_share is NULL */
+static int set_curl_share(const PEP * pep) {
+    CURLcode curl_rc;
+    CURLSH * curlsh= pep_share_getcurlsh(pep->option_share);
+    pep_log_debug("set_curl_share: PEP#%d curl_easy_setopt(curl,CURLOPT_SHARE,%p)",pep->id,curlsh);
+    curl_rc= curl_easy_setopt(pep->curl,CURLOPT_SHARE,curlsh);
+    if (curl_rc != CURLE_OK) {
+        pep_log_error("set_curl_share: PEP#%d curl_easy_setopt(curl,CURLOPT_SHARE,%p) failed: %s.",pep->id,curlsh,curl_easy_strerror(curl_rc));
+        return 1;
+    }
+    return 0;
+}
+
+/* set libcurl CURLOPT_TCP_NODELAY */
+static int set_curl_tcp_nodelay(const PEP * pep) {
+    CURLcode curl_rc;
+    pep_log_debug("set_curl_tcp_nodelay: PEP#%d option_tcp_nodelay: %s",pep->id,pep->option_tcp_nodelay ? "TRUE" : "FALSE");
+    curl_rc= curl_easy_setopt(pep->curl,CURLOPT_TCP_NODELAY,(long)pep->option_tcp_nodelay);
     if (curl_rc != CURLE_OK) {
-        pep_log_error("set_curl_connection_timeout: PEP#%d curl_easy_setopt(curl,CURLOPT_TIMEOUT,%d) failed: %s",pep->id, (int)(pep->option_timeout),curl_easy_strerror(curl_rc));
+        pep_log_warn("set_curl_tcp_nodelay: PEP#%d curl_easy_setopt(curl,CURLOPT_TCP_NODELAY,%d) failed: %s.",pep->id,pep->option_tcp_nodelay,curl_easy_strerror(curl_rc));
         return 1;
     }
     return 0;
 }
 
+/* set libcurl CURLOPT_TCP_KEEPALIVE, CURLOPT_TCP_KEEPIDLE and CURLOPT_TCP_KEEPINTVL (libcurl >= 7.25) */
+static int set_curl_tcp_keepalive(const PEP * pep) {
+#if LIBCURL_VERSION_NUM >= 0x071900
+    CURLcode curl_rc;
+    long keepalive= pep->option_tcp_keepalive;
+    pep_log_debug("set_curl_tcp_keepalive: PEP#%d option_tcp_keepalive: %d",pep->id,(int)keepalive);
+    curl_rc= curl_easy_setopt(pep->curl,CURLOPT_TCP_KEEPALIVE,(keepalive > 0) ? 1L : 0L);
+    if (curl_rc != CURLE_OK) {
+        pep_log_warn("set_curl_tcp_keepalive: PEP#%d curl_easy_setopt(curl,CURLOPT_TCP_KEEPALIVE) failed: %s.",pep->id,curl_easy_strerror(curl_rc));
+        return 1;
+    }
+    if (keepalive > 0) {
+        curl_easy_setopt(pep->curl,CURLOPT_TCP_KEEPIDLE,keepalive);
+        curl_easy_setopt(pep->curl,CURLOPT_TCP_KEEPINTVL,keepalive);
+    }
+    return 0;
+#else
+    if (pep->option_tcp_keepalive > 0) {
+        pep_log_warn("set_curl_tcp_keepalive: PEP#%d TCP keepalive not supported by libcurl %s.",pep->id,LIBCURL_VERSION);
+        return 1;
+    }
+    return 0;
+#endif
+}
+
+/* set libcurl CURLOPT_TCP_FASTOPEN (libcurl >= 7.49) */
+static int set_curl_tcp_fastopen(const PEP * pep) {
+#if LIBCURL_VERSION_NUM >= 0x073100
+    CURLcode curl_rc;
+    pep_log_debug("set_curl_tcp_fastopen: PEP#%d option_tcp_fastopen: %s",pep->id,pep->option_tcp_fastopen ? "TRUE" : "FALSE");
+    curl_rc= curl_easy_setopt(pep->curl,CURLOPT_TCP_FASTOPEN,(long)pep->option_tcp_fastopen);
+    if (curl_rc != CURLE_OK) {
+        /* not supported by the platform */
+        pep_log_warn("set_curl_tcp_fastopen: PEP#%d curl_easy_setopt(curl,CURLOPT_TCP_FASTOPEN,%d) failed: %s.",pep->id,pep->option_tcp_fastopen,curl_easy_strerror(curl_rc));
+        return 1;
+    }
+    return 0;
+#else
+    if (pep->option_tcp_fastopen) {
+        pep_log_warn("set_curl_tcp_fastopen: PEP#%d TCP Fast Open not supported by libcurl %s.",pep->id,LIBCURL_VERSION);
+        return 1;
+    }
+    return 0;
+#endif
+}
+
 /* set libcurl CURLOPT_SSL_VERIFYPEER */
 static int set_curl_ssl_validation(const PEP * pep) {
     CURLcode curl_rc;
@@ -915,7 +3339,7 @@ static int set_curl_ssl_cipher_list(const PEP * pep) {
 static int set_curl_server_cert(const PEP * pep) {
     CURLcode curl_rc;
     pep_log_debug("set_curl_server_cert: PEP#%d option_server_cert: %s",pep->id,pep->option_server_cert);
-    if (pep->option_server_cert != NULL) {
+    if (pep->option_server_cert != NULL && pep->option_credentials == NULL) {
         curl_rc= curl_easy_setopt(pep->curl,CURLOPT_CAINFO,pep->option_server_cert);
         if (curl_rc != CURLE_OK) {
             pep_log_error("set_curl_server_cert: PEP#%d curl_easy_setopt(curl,CURLOPT_CAINFO,%s) failed: %s",pep->id,pep->option_server_cert,curl_easy_strerror(curl_rc));
@@ -929,7 +3353,7 @@ static int set_curl_server_cert(const PEP * pep) {
 static int set_curl_server_capath(const PEP * pep) {
     CURLcode curl_rc;
     pep_log_debug("set_curl_server_capath: PEP#%d option_server_capath: %s",pep->id,pep->option_server_capath);
-    if (pep->option_server_capath != NULL) {
+    if (pep->option_server_capath != NULL && pep->option_credentials == NULL) {
         curl_rc= curl_easy_setopt(pep->curl,CURLOPT_CAPATH,pep->option_server_capath);
         if (curl_rc != CURLE_OK) {
             pep_log_error("set_curl_server_capath: PEP#%d curl_easy_setopt(curl,CURLOPT_CAPATH,%s) failed: %s",pep->id,pep->option_server_capath,curl_easy_strerror(curl_rc));
@@ -943,7 +3367,7 @@ static int set_curl_server_capath(const PEP * pep) {
 static int set_curl_client_cert(const PEP * pep) {
     CURLcode curl_rc;
     pep_log_debug("set_curl_client_cert: PEP#%d option_client_cert: %s",pep->id,pep->option_client_cert);
-    if (pep->option_client_cert != NULL) {
+    if (pep->option_client_cert != NULL && pep->option_credentials == NULL) {
         curl_rc= curl_easy_setopt(pep->curl,CURLOPT_SSLCERT,pep->option_client_cert);
         if (curl_rc != CURLE_OK) {
             pep_log_error("set_curl_client_cert: PEP#%d curl_easy_setopt(curl,CURLOPT_SSLCERT,%s) failed: %s",pep->id,pep->option_client_cert,curl_easy_strerror(curl_rc));
@@ -958,7 +3382,7 @@ static int set_curl_client_cert(const PEP * pep) {
 static int set_curl_client_key(const PEP * pep) {
     CURLcode curl_rc;
     pep_log_debug("set_curl_client_key: PEP#%d option_client_key: %s",pep->id,pep->option_client_key);
-    if (pep->option_client_key != NULL) {
+    if (pep->option_client_key != NULL && pep->option_credentials == NULL) {
         curl_rc= curl_easy_setopt(pep->curl,CURLOPT_SSLKEY,pep->option_client_key);
         if (curl_rc != CURLE_OK) {
             pep_log_error("set_curl_client_key: PEP#%d curl_easy_setopt(curl,CURLOPT_SSLKEY,%s) failed: %s",pep->id,pep->option_client_key,curl_easy_strerror(curl_rc));
@@ -972,7 +3396,7 @@ static int set_curl_client_key(const PEP * pep) {
 /** set libcurl CURLOPT_SSLKEYPASSWD iff option_client_keypassword not NULL */
 static int set_curl_client_keypassword(const PEP * pep) {
     CURLcode curl_rc;
-    if (pep->option_client_keypassword != NULL) {
+    if (pep->option_client_keypassword != NULL && pep->option_credentials == NULL) {
         pep_log_debug("set_curl_client_keypassword: PEP#%d option_client_keypassword: %d char long",pep->id,(int)strlen(pep->option_client_keypassword));
         curl_rc= curl_easy_setopt(pep->curl,CURLOPT_SSLKEYPASSWD,pep->option_client_keypassword);
         if (curl_rc != CURLE_OK) {
@@ -983,6 +3407,15 @@ static int set_curl_client_keypassword(const PEP * pep) {
     return 0;
 }
 
+/** set libcurl CA, client certificate, key and key password from the credential files options */
+static void set_curl_credential_files(const PEP * pep) {
+    set_curl_server_cert(pep);
+    set_curl_server_capath(pep);
+    set_curl_client_cert(pep);
+    set_curl_client_key(pep);
+    set_curl_client_keypassword(pep);
+}
+
 /** set libcurl CURLOPT_VERBOSE to true if option_loglevel >= DEBUG, false otherwise */
 static int set_curl_verbose(const PEP * pep) {
     CURLcode curl_rc;
@@ -52,6 +52,15 @@ extern "C" {
  * If your threads are object (OO programming, ...), it is recommended you to 
  * create (pep_initialize) the PEP handle in the constructor, and release it (pep_destroy) 
  * in the destructor. 
+ * <h4>Shared PEP handle</h4>
+ * Since version 2.4, a PEP handle can be shared by several threads calling pep_authorize()
+ * simultaneously, if the option {@link #PEP_OPTION_SESSION_POOL_SIZE} is set. The handle
+ * then leases to each call an authorization session (CURL easy handle and buffers) from an
+ * internal pool of at most that number of sessions. A call blocks until a session is available.
+ * The sessions keep their connections to the PEPd open between the calls.
+ * The PEP handle must be configured (pep_setoption, pep_addpip, pep_addobligationhandler)
+ * before being shared, and released (pep_destroy) after all threads have finished using it.
+ * The PIPs and ObligationHandlers of a shared PEP handle must be thread-safe.
  * <h4>Application using libcurl</h4>
  * If the application using the PEP client API uses libcurl too, then it is recommended to 
  * bootstrap your application with curl_global_init(CURL_GLOBAL_ALL). The PEP client API uses SSL
@@ -68,7 +77,9 @@ extern "C" {
 /** @defgroup PEPClient PEP client API */
 /** @defgroup Logging Log Level and Output */
 
+#include <stdio.h> /* FILE */
 #include <stdarg.h> /* va_list */
+#include <stdint.h> /* uint64_t */
 #include "xacml.h"
 #include "profiles.h"
 #include "pip.h"
@@ -165,6 +176,23 @@ typedef int pep_log_handler_callback(int level, const char * format, va_list arg
  */
 typedef struct pep_handle PEP;
 
+/**
+ * Share object: TLS sessions, DNS cache and connections shared by PEP client @b handles.
+ *
+ * @see pep_share_create()
+ * @see pep_setoption(pep,PEP_OPTION_SHARE, ...)
+ */
+typedef struct pep_share pep_share_t;
+
+/**
+ * Credentials object: TLS client certificate, key and CA certificates loaded once in
+ * memory, shared by PEP client @b handles.
+ *
+ * @see pep_credentials_create()
+ * @see pep_setoption(pep,PEP_OPTION_CREDENTIALS, ...)
+ */
+typedef struct pep_credentials pep_credentials_t;
+
 /**
  * PEP client configuration options.
  *
@@ -174,19 +202,251 @@ typedef enum pep_option {
     PEP_OPTION_LOG_LEVEL,  /**< Set log level (default {@link #PEP_LOGLEVEL_NONE}) */
     PEP_OPTION_LOG_STDERR,  /**< Set log engine file descriptor: @c stderr, @c stdout, @c NULL (default @c NULL) */
     PEP_OPTION_LOG_HANDLER,  /**< Set the optional log handler callback function pointer (default @c NULL) */
-    PEP_OPTION_ENDPOINT_URL, /**< Set the @b mandatory PEP daemon endpoint URL. */
+    PEP_OPTION_ENDPOINT_URL, /**< Set the @b mandatory PEP daemon endpoint URL, can be set several times for failover (up to 32 URLs): string */
     PEP_OPTION_ENDPOINT_SSL_VALIDATION, /**< Enable SSL validation: 0 or 1 (default 1) */
     PEP_OPTION_ENDPOINT_SERVER_CERT, /**< PEP daemon server SSL certificate (PEM format): absolute filename */
     PEP_OPTION_ENDPOINT_SERVER_CAPATH, /**< Directory holding CA certificates (hashed filenames in PEM format) to verify the PEP daemon: absolute directory name */
     PEP_OPTION_ENDPOINT_CLIENT_CERT, /**< PEP client SSL certificate (PEM format) for client authN: absolute filename */
     PEP_OPTION_ENDPOINT_CLIENT_KEY, /**< PEP client SSL private key (PEM format) for client authN: absolute filename */
     PEP_OPTION_ENDPOINT_CLIENT_KEYPASSWORD, /**< PEP client SSL private key password for client authN: string */
-    PEP_OPTION_ENDPOINT_TIMEOUT, /**< Timeout for the connection to endpoint URL in second (default 30s) */
+    PEP_OPTION_ENDPOINT_TIMEOUT, /**< Timeout for the connection to endpoint URL in second (default 30s), see also {@link #PEP_OPTION_ENDPOINT_TRANSFER_TIMEOUT_MS} */
     PEP_OPTION_ENABLE_PIPS, /**< Enable PIPs pre-processing: 0 or 1 (default 1) */
     PEP_OPTION_ENABLE_OBLIGATIONHANDLERS, /**< Enable OHs post-processing: 0 or 1 (default 1) */
-    PEP_OPTION_ENDPOINT_SSL_CIPHER_LIST /**< PEP client list of ciphers to use for the SSL connection: string */
+    PEP_OPTION_ENDPOINT_SSL_CIPHER_LIST, /**< PEP client list of ciphers to use for the SSL connection: string */
+    PEP_OPTION_CACHE_ENABLED, /**< Enable the in-process decision cache: 0 or 1 (default 0) */
+    PEP_OPTION_CACHE_TTL, /**< Time-to-live of the cached decisions in second (default 60s) */
+    PEP_OPTION_CACHE_MAX_SIZE, /**< Memory bound of the decision cache in bytes (default 4MB) */
+    PEP_OPTION_CACHE_ADMISSION, /**< Decision cache admission policy: {@link #pep_cache_admission_t} (default {@link #PEP_CACHE_ADMISSION_ALWAYS}) */
+    PEP_OPTION_CACHE_UNCACHEABLE_OBLIGATION, /**< Obligation id which makes a decision uncacheable, can be set several times: string */
+    PEP_OPTION_CACHE_FILTER, /**< Set the optional cache filter callback function pointer (default @c NULL) */
+    PEP_OPTION_SESSION_POOL_SIZE, /**< Maximum number of concurrent pep_authorize() calls on a shared handle, @c 0 for a single-threaded handle: int (default 0) */
+    PEP_OPTION_BATCH_ENDPOINT_URL, /**< PEP daemon endpoint URL accepting a list of requests, used by pep_authorize_batch() (default @c NULL) */
+    PEP_OPTION_HEDGE_DELAY, /**< Delay in milliseconds before pep_authorize() sends a duplicate request to a second endpoint, @c 0 to disable hedging: int (default 0) */
+    PEP_OPTION_HEDGE_ADAPTIVE, /**< Use the observed 95th percentile latency of the endpoint as hedge delay, when lower than {@link #PEP_OPTION_HEDGE_DELAY}: 0 or 1 (default 0) */
+    PEP_OPTION_HTTP_VERSION, /**< HTTP protocol version to use with the PEP daemon: {@link #pep_http_version_t} (default {@link #PEP_HTTP_VERSION_DEFAULT}) */
+    PEP_OPTION_SHARE, /**< Share object to resume TLS sessions, reuse resolved names and connections of other PEP handles: {@link #pep_share_t} pointer (default @c NULL) */
+    PEP_OPTION_TCP_NODELAY, /**< Disable the Nagle algorithm on the connections (TCP_NODELAY): 0 or 1 (default 1) */
+    PEP_OPTION_TCP_KEEPALIVE, /**< Idle time and interval in seconds of the TCP keepalive probes, @c 0 to disable: int (default 0) */
+    PEP_OPTION_TCP_FASTOPEN, /**< Enable TCP Fast Open (libcurl >= 7.49, Linux >= 4.11): 0 or 1 (default 0) */
+    PEP_OPTION_WIRE_ENCODING, /**< Encoding of the Hessian requests and responses on the wire: {@link #pep_wire_encoding_t} (default {@link #PEP_WIRE_ENCODING_BASE64}) */
+    PEP_OPTION_COMPRESSION, /**< Accept compressed responses (Accept-Encoding) and gzip the request bodies larger than {@link #PEP_OPTION_COMPRESSION_THRESHOLD}: 0 or 1 (default 0) */
+    PEP_OPTION_COMPRESSION_THRESHOLD, /**< Minimum size in bytes of a request body to compress: int (default 1024) */
+    PEP_OPTION_ENDPOINT_CONNECT_TIMEOUT_MS, /**< Timeout in milliseconds to connect to an endpoint, @c 0 for the libcurl default (300s): int (default 0) */
+    PEP_OPTION_ENDPOINT_TRANSFER_TIMEOUT_MS, /**< Timeout in milliseconds of a whole transfer to an endpoint, connection included, overrides {@link #PEP_OPTION_ENDPOINT_TIMEOUT} if not @c 0: int (default 0) */
+    PEP_OPTION_CIRCUIT_BREAKER_THRESHOLD, /**< Number of consecutive failures opening the circuit breaker of an endpoint, @c 0 to disable: int (default 0) */
+    PEP_OPTION_CIRCUIT_BREAKER_OPEN_TIME, /**< Time in milliseconds an endpoint circuit stays open before probe requests are sent: int (default 5000) */
+    PEP_OPTION_SINGLE_FLIGHT, /**< Coalesce the identical concurrent pep_authorize() requests: only one is sent, the others receive a copy of its response: 0 or 1 (default 0) */
+    PEP_OPTION_SHM_CACHE, /**< Name of the POSIX shared memory decision cache shared by the processes of the user, @c NULL to disable: string (default @c NULL) */
+    PEP_OPTION_SHM_CACHE_SIZE, /**< Size in bytes of the shared memory decision cache when it is created, set before {@link #PEP_OPTION_SHM_CACHE}: long (default 16MB) */
+    PEP_OPTION_SIDECAR_SOCKET, /**< Unix domain socket path of the local argus-pep-sidecar daemon sending the requests to the PEP daemon, @c NULL to send them directly: string (default @c NULL) */
+    PEP_OPTION_CREDENTIALS, /**< Credentials object replacing the SSL certificate, key and CA options, @c NULL to use the options again: {@link #pep_credentials_t} pointer (default @c NULL) */
+    PEP_OPTION_TRACER /**< Tracer callbacks called around each phase of the authorizations, copied by the PEP client, @c NULL to disable: {@link #pep_tracer_t} pointer (default @c NULL) */
 } pep_option_t;
 
+/**
+ * HTTP protocol versions.
+ *
+ * @see pep_setoption(pep,PEP_OPTION_HTTP_VERSION, ...)
+ */
+typedef enum pep_http_version {
+    PEP_HTTP_VERSION_DEFAULT= 0, /**< libcurl default version */
+    PEP_HTTP_VERSION_1_1, /**< HTTP/1.1 only */
+    PEP_HTTP_VERSION_2, /**< HTTP/2 negotiated over TLS (ALPN), HTTP/1.1 otherwise (libcurl >= 7.33) */
+    PEP_HTTP_VERSION_2_PRIOR_KNOWLEDGE /**< HTTP/2 without negotiation, also for @c http:// endpoints (libcurl >= 7.49) */
+} pep_http_version_t;
+
+/**
+ * Wire encodings of the Hessian requests and responses.
+ *
+ * @see pep_setoption(pep,PEP_OPTION_WIRE_ENCODING, ...)
+ */
+typedef enum pep_wire_encoding {
+    PEP_WIRE_ENCODING_BASE64= 0, /**< base64 encoded Hessian (text/plain), as expected by the PEP daemon */
+    PEP_WIRE_ENCODING_BINARY /**< raw Hessian bytes (application/x-hessian), for a PEP daemon supporting it */
+} pep_wire_encoding_t;
+
+/**
+ * Decision cache admission policies.
+ *
+ * @see pep_setoption(pep,PEP_OPTION_CACHE_ADMISSION, ...)
+ */
+typedef enum pep_cache_admission {
+    PEP_CACHE_ADMISSION_ALWAYS= 0, /**< Every cacheable decision is stored in the cache */
+    PEP_CACHE_ADMISSION_SECOND_HIT /**< A cacheable decision is only stored when the same request is sent a second time */
+} pep_cache_admission_t;
+
+/**
+ * Optional decision cache filter callback prototype.
+ *
+ * The callback is called twice for each authorization: before the cache lookup with
+ * a @c NULL @a response, and before storing the decision received from the PEP daemon in
+ * the cache. The @a request is the request sent to the PEP daemon, after the PIPs processing.
+ *
+ * @param request the XACML request.
+ * @param response the XACML response or @c NULL.
+ * @return int 1 if the request (and its response) can be cached, 0 otherwise.
+ *
+ * @see pep_setoption(pep,PEP_OPTION_CACHE_FILTER, ...)
+ */
+typedef int pep_cache_filter_callback(const xacml_request_t * request, const xacml_response_t * response);
+
+/**
+ * Decision cache statistics.
+ *
+ * @see pep_getcachestats(pep,stats)
+ */
+typedef struct pep_cache_stats {
+    unsigned long hits; /**< Number of requests answered from the cache */
+    unsigned long misses; /**< Number of requests not found (or expired) in the cache */
+    unsigned long insertions; /**< Number of decisions stored in the cache */
+    unsigned long evictions; /**< Number of decisions evicted to respect the memory bound */
+    unsigned long expirations; /**< Number of expired decisions removed from the cache */
+    unsigned long rejections; /**< Number of cacheable decisions not admitted in the cache */
+    unsigned long entries; /**< Current number of decisions in the cache */
+    unsigned long size; /**< Current memory used by the cached decisions in bytes */
+} pep_cache_stats_t;
+
+/**
+ * Phases of an authorization timed by the PEP client statistics.
+ *
+ * @see pep_stats_t
+ */
+typedef enum pep_stats_phase {
+    PEP_PHASE_PIP= 0, /**< PIPs processing */
+    PEP_PHASE_MARSHAL, /**< XACML request Hessian marshalling */
+    PEP_PHASE_ENCODE, /**< Request body base64 encoding and compression, while it is sent */
+    PEP_PHASE_DNS, /**< Endpoint name resolution, new connections only */
+    PEP_PHASE_CONNECT, /**< TCP connection to the endpoint, new connections only */
+    PEP_PHASE_TLS, /**< TLS handshake with the endpoint, new connections only */
+    PEP_PHASE_SERVER, /**< Request upload and PEP daemon processing, until the first response byte */
+    PEP_PHASE_DOWNLOAD, /**< Response download, from the first to the last byte */
+    PEP_PHASE_DECODE, /**< Response body base64 decoding, while it is received */
+    PEP_PHASE_UNMARSHAL, /**< XACML response Hessian unmarshalling */
+    PEP_PHASE_OH, /**< Obligation handlers processing */
+    PEP_PHASE_COUNT /**< Number of phases */
+} pep_stats_phase_t;
+
+/**
+ * Timing of an authorization phase.
+ *
+ * @see pep_stats_t
+ */
+typedef struct pep_phase_stats {
+    uint64_t count; /**< Number of times the phase was run */
+    uint64_t total_us; /**< Cumulative duration of the phase in microseconds */
+    uint64_t last_us; /**< Duration of the phase in microseconds, the last time it was run */
+} pep_phase_stats_t;
+
+/**
+ * PEP client statistics: authorizations, errors by class, transfers and per phase timings.
+ * The counters are cumulative since the PEP client initialization.
+ *
+ * @see pep_getstats(pep,stats)
+ */
+typedef struct pep_stats {
+    uint64_t authorizations; /**< Number of authorizations ended, successful or not */
+    uint64_t errors; /**< Number of authorizations failed, sum of the errors by class below */
+    uint64_t errors_network; /**< Authorizations failed by a transfer error (PEP_ERR_CURL + CURLcode) */
+    uint64_t errors_http; /**< Authorizations failed by an HTTP error status or an invalid response (PEP_ERR_AUTHZ_REQUEST) */
+    uint64_t errors_timeout; /**< Authorizations failed by their deadline (PEP_ERR_TIMEOUT) */
+    uint64_t errors_circuit; /**< Authorizations not sent, all the endpoint circuits open (PEP_ERR_CIRCUIT_OPEN) */
+    uint64_t errors_sidecar; /**< Authorizations failed by the sidecar transport (PEP_ERR_SIDECAR) */
+    uint64_t errors_marshalling; /**< Authorizations failed by the (un)marshalling of the request or response */
+    uint64_t errors_pip; /**< Authorizations failed by a PIP (PEP_ERR_PIP_PROCESS) */
+    uint64_t errors_oh; /**< Authorizations failed by an obligation handler (PEP_ERR_OH_PROCESS) */
+    uint64_t errors_other; /**< Authorizations failed by another error, or cancelled */
+    uint64_t transfers; /**< Number of HTTP transfers to the endpoints, including the failed over ones */
+    uint64_t transfers_failed; /**< Number of HTTP transfers without valid response */
+    uint64_t connections; /**< Number of transfers on a new connection */
+    uint64_t connections_reused; /**< Number of transfers on a reused connection */
+    uint64_t bytes_sent; /**< Request body bytes sent */
+    uint64_t bytes_received; /**< Response body bytes received */
+    pep_phase_stats_t phases[PEP_PHASE_COUNT]; /**< Timings of the phases, indexed by {@link #pep_stats_phase_t} */
+} pep_stats_t;
+
+/**
+ * Asynchronous authorization completion callback prototype.
+ *
+ * The callback is called exactly once for each request successfully submitted with
+ * pep_authorize_async(), from within pep_async_poll(), pep_async_cancel() or pep_async_drain().
+ * The callback owns the @a request and the @a response, and must delete them.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param request the @b effective XACML request, as processed by the PEPd.
+ * @param response the XACML response received, or @c NULL if the authorization failed before.
+ * @param rc {@link #pep_error_t} PEP_OK on success, PEP_ERR_CANCELLED if the request was cancelled,
+ *        or the error code of the authorization.
+ * @param userdata the user data pointer given to pep_authorize_async().
+ *
+ * @see pep_authorize_async(pep,request,callback,userdata)
+ */
+typedef void pep_authorize_callback(PEP * pep, xacml_request_t * request, xacml_response_t * response, pep_error_t rc, void * userdata);
+
+/**
+ * Phases of an authorization traced by the tracer callbacks. The authorization span is the
+ * parent of the spans of its phases.
+ *
+ * @see pep_tracer_t
+ */
+typedef enum pep_trace_phase {
+    PEP_TRACE_AUTHORIZE= 0, /**< Whole pep_authorize(), pep_authorize_batch() or asynchronous authorization */
+    PEP_TRACE_PIP, /**< PIPs processing */
+    PEP_TRACE_MARSHAL, /**< XACML request Hessian marshalling */
+    PEP_TRACE_TRANSFER, /**< HTTP transfer to an endpoint, or exchange with the sidecar daemon, once per endpoint tried */
+    PEP_TRACE_UNMARSHAL, /**< XACML response Hessian unmarshalling */
+    PEP_TRACE_OH /**< Obligation handlers processing */
+} pep_trace_phase_t;
+
+/**
+ * Attributes of an ended span. The transfer attributes are only set for the
+ * {@link #PEP_TRACE_TRANSFER} spans.
+ *
+ * @see pep_trace_end_callback
+ */
+typedef struct pep_trace_attributes {
+    pep_error_t rc; /**< PEP_OK, or the error code which ended the phase */
+    const char * endpoint; /**< Endpoint url, or sidecar socket path (transfer) */
+    uint64_t bytes_sent; /**< Request body bytes sent (HTTP transfer) */
+    uint64_t bytes_received; /**< Response body bytes received (HTTP transfer) */
+    int curl_code; /**< CURLcode of the transfer, 0 on success (transfer) */
+    long http_status; /**< HTTP status code received, 0 if none (HTTP transfer) */
+} pep_trace_attributes_t;
+
+/**
+ * Span start callback prototype: called when a phase of an authorization starts.
+ *
+ * @param pep_id the id of the PEP client, see pep_getid(pep).
+ * @param phase the {@link #pep_trace_phase_t} starting.
+ * @param parent the span of the authorization, or @c NULL for a {@link #PEP_TRACE_AUTHORIZE} span.
+ * @param userdata the tracer user data.
+ * @return the span, passed to the end callback and as parent of the phases spans, or @c NULL
+ *         to not trace the span: its end callback is not called, and the phases of a
+ *         @c NULL authorization span are not traced (sampling).
+ */
+typedef void * pep_trace_start_callback(int pep_id, pep_trace_phase_t phase, void * parent, void * userdata);
+
+/**
+ * Span end callback prototype: called when a traced phase ends, on the thread which started
+ * it except for the asynchronous authorizations (see pep_async_poll()).
+ *
+ * @param span the span returned by the start callback.
+ * @param phase the {@link #pep_trace_phase_t} ended.
+ * @param attributes the attributes of the span, valid during the call only.
+ * @param userdata the tracer user data.
+ */
+typedef void pep_trace_end_callback(void * span, pep_trace_phase_t phase, const pep_trace_attributes_t * attributes, void * userdata);
+
+/**
+ * Tracer, to record the authorizations in a distributed tracing system.
+ *
+ * @see pep_setoption(pep,PEP_OPTION_TRACER, ...)
+ */
+typedef struct pep_tracer {
+    pep_trace_start_callback * start; /**< Span start callback */
+    pep_trace_end_callback * end; /**< Span end callback */
+    void * userdata; /**< User data passed to the callbacks */
+} pep_tracer_t;
+
 /**
  * Returns a human readable string with the version number of the PEP client API and some of its important components (like libcurl version).
  * @return a null terminated string. e.g. "argus-pep-api-c/2.0.0 (libcurl/7.21.7 ...)"
@@ -280,6 +540,23 @@ pep_error_t pep_addobligationhandler(PEP * pep, const pep_obligationhandler_t *
  *   // set the PEP daemon endpoint URL
  *   pep_setoption(pep,PEP_OPTION_ENDPOINT_URL, (const char *)"https://pepd.switch.ch:8154/authz");
  * @endcode
+ * Setting the option several times adds more PEP daemon endpoints. Each request is sent
+ * to the endpoint with the lowest moving average latency and error rate, and is resent
+ * to the next endpoints if it fails. A failed endpoint is avoided for a growing delay
+ * (1s up to 30s), unless all the other endpoints failed too:
+ * @code
+ *   // two PEP daemons, failover and latency-aware selection
+ *   pep_setoption(pep,PEP_OPTION_ENDPOINT_URL, (const char *)"https://pepd1.example.org:8154/authz");
+ *   pep_setoption(pep,PEP_OPTION_ENDPOINT_URL, (const char *)"https://pepd2.example.org:8154/authz");
+ * @endcode
+ * A PEP daemon, or a local proxy, running on the same host can be reached over a Unix
+ * domain socket with a @c unix://<socket>[:<path>] URL (libcurl 7.40 or later), the HTTP
+ * path defaults to @c /authz. Like @c http:// URLs, the requests skip TLS and the SSL
+ * options are ignored:
+ * @code
+ *   // co-located PEP daemon listening on a Unix domain socket, HTTP path /authz
+ *   pep_setoption(pep,PEP_OPTION_ENDPOINT_URL, (const char *)"unix:///var/run/argus-pepd.sock:/authz");
+ * @endcode
  * Option {@link #PEP_OPTION_ENDPOINT_SERVER_CAPATH} @c const @c char * argument:
  * @code
  *   // set the PEP daemon server CA directory for SSL/TLS validation
@@ -320,6 +597,131 @@ pep_error_t pep_addobligationhandler(PEP * pep, const pep_obligationhandler_t *
  *   // already enabled by default, only for example purpose
  *   pep_setoption(pep,PEP_OPTION_ENABLE_OBLIGATIONHANDLERS, (int)1);
  * @endcode
+ * Option {@link #PEP_OPTION_CACHE_ENABLED} @c int (@a FALSE or @a TRUE) argument:
+ * @code
+ *   // enable the decision cache, decisions are cached for 5 minutes
+ *   pep_setoption(pep,PEP_OPTION_CACHE_ENABLED, (int)1);
+ *   pep_setoption(pep,PEP_OPTION_CACHE_TTL, (int)300);
+ * @endcode
+ * Option {@link #PEP_OPTION_CACHE_MAX_SIZE} @c long argument:
+ * @code
+ *   // limit the decision cache memory to 16MB
+ *   pep_setoption(pep,PEP_OPTION_CACHE_MAX_SIZE, (long)16*1024*1024);
+ * @endcode
+ * Option {@link #PEP_OPTION_CACHE_ADMISSION} {@link #pep_cache_admission_t} argument:
+ * @code
+ *   // only cache the decisions of requests sent at least twice
+ *   pep_setoption(pep,PEP_OPTION_CACHE_ADMISSION, PEP_CACHE_ADMISSION_SECOND_HIT);
+ * @endcode
+ * Option {@link #PEP_OPTION_CACHE_UNCACHEABLE_OBLIGATION} @c const @c char @c * argument:
+ * @code
+ *   // never cache decisions carrying a one-time obligation
+ *   pep_setoption(pep,PEP_OPTION_CACHE_UNCACHEABLE_OBLIGATION, (const char *)"http://example.org/obligation/one-time");
+ * @endcode
+ * Option {@link #PEP_OPTION_CACHE_FILTER} {@link #pep_cache_filter_callback} @c * argument:
+ * @code
+ *   // decide which requests and decisions can be cached
+ *   pep_setoption(pep,PEP_OPTION_CACHE_FILTER, (pep_cache_filter_callback *)my_cache_filter);
+ * @endcode
+ * Option {@link #PEP_OPTION_SESSION_POOL_SIZE} @c int argument:
+ * @code
+ *   // share the PEP handle among up to 16 worker threads
+ *   pep_setoption(pep,PEP_OPTION_SESSION_POOL_SIZE, (int)16);
+ * @endcode
+ * Option {@link #PEP_OPTION_BATCH_ENDPOINT_URL} @c const @c char @c * argument:
+ * @code
+ *   // send the batches of requests in one exchange
+ *   pep_setoption(pep,PEP_OPTION_BATCH_ENDPOINT_URL, (const char *)"https://pepd.example.org:8154/authz/batch");
+ * @endcode
+ * Option {@link #PEP_OPTION_HTTP_VERSION} {@link #pep_http_version_t} argument:
+ * @code
+ *   // negotiate HTTP/2 with the PEP daemon: the concurrent pep_authorize_async()
+ *   // requests are multiplexed over one TLS connection
+ *   pep_setoption(pep,PEP_OPTION_HTTP_VERSION, PEP_HTTP_VERSION_2);
+ * @endcode
+ * Option {@link #PEP_OPTION_SHARE} {@link #pep_share_t} @c * argument:
+ * @code
+ *   // the PEP handles created by the plugin resume the same TLS session
+ *   static pep_share_t * share= NULL;
+ *   if (share == NULL) share= pep_share_create();
+ *   pep_setoption(pep,PEP_OPTION_SHARE, share);
+ * @endcode
+ * Option {@link #PEP_OPTION_CREDENTIALS} {@link #pep_credentials_t} @c * argument:
+ * @code
+ *   // the PEP handles created by the plugin don't read the PEM files and the CA
+ *   // directory for each connection, the files are checked for changes every 5 minutes
+ *   static pep_credentials_t * credentials= NULL;
+ *   if (credentials == NULL) credentials= pep_credentials_create("/etc/grid-security/hostcert.pem",
+ *           "/etc/grid-security/hostkey.pem", NULL, NULL, "/etc/grid-security/certificates", 300);
+ *   pep_setoption(pep,PEP_OPTION_CREDENTIALS, credentials);
+ * @endcode
+ * Option {@link #PEP_OPTION_TRACER} {@link #pep_tracer_t} @c * argument:
+ * @code
+ *   // my_span_start() creates a child span of the current request trace for
+ *   // PEP_TRACE_AUTHORIZE, or of the parent span, and my_span_end() ends it
+ *   pep_tracer_t tracer= { my_span_start, my_span_end, my_tracing_context };
+ *   pep_setoption(pep,PEP_OPTION_TRACER, &tracer);
+ * @endcode
+ * Option {@link #PEP_OPTION_TCP_KEEPALIVE} @c int argument:
+ * @code
+ *   // probe the idle connections every 60 seconds, firewalls don't drop them
+ *   pep_setoption(pep,PEP_OPTION_TCP_KEEPALIVE, (int)60);
+ * @endcode
+ * Option {@link #PEP_OPTION_HEDGE_DELAY} @c int argument:
+ * @code
+ *   // with several endpoints: if the first endpoint did not answer within 200 ms,
+ *   // send the request again to a second endpoint, the first response wins
+ *   pep_setoption(pep,PEP_OPTION_HEDGE_DELAY, (int)200);
+ *   // or hedge sooner, after the 95th percentile latency of the first endpoint
+ *   pep_setoption(pep,PEP_OPTION_HEDGE_ADAPTIVE, (int)1);
+ * @endcode
+ * Option {@link #PEP_OPTION_WIRE_ENCODING} {@link #pep_wire_encoding_t} argument:
+ * @code
+ *   // send and receive raw Hessian bytes, a third smaller than base64
+ *   pep_setoption(pep,PEP_OPTION_WIRE_ENCODING, PEP_WIRE_ENCODING_BINARY);
+ * @endcode
+ * Option {@link #PEP_OPTION_COMPRESSION} @c int argument:
+ * @code
+ *   // over a WAN link: compressed responses, and gzip the requests larger than 2KB
+ *   // (e.g. with a certificate chain), the PEP daemon must accept Content-Encoding: gzip
+ *   pep_setoption(pep,PEP_OPTION_COMPRESSION, (int)1);
+ *   pep_setoption(pep,PEP_OPTION_COMPRESSION_THRESHOLD, (int)2048);
+ * @endcode
+ * Option {@link #PEP_OPTION_ENDPOINT_CONNECT_TIMEOUT_MS} @c int argument:
+ * @code
+ *   // failover quickly from an unreachable endpoint, but let a busy PEP daemon answer
+ *   pep_setoption(pep,PEP_OPTION_ENDPOINT_CONNECT_TIMEOUT_MS, (int)250);
+ *   pep_setoption(pep,PEP_OPTION_ENDPOINT_TRANSFER_TIMEOUT_MS, (int)5000);
+ * @endcode
+ * Option {@link #PEP_OPTION_CIRCUIT_BREAKER_THRESHOLD} @c int argument:
+ * @code
+ *   // after 5 consecutive failures, don't send requests to the endpoint for 10 seconds:
+ *   // if all endpoints are down, pep_authorize() fails at once with PEP_ERR_CIRCUIT_OPEN
+ *   pep_setoption(pep,PEP_OPTION_CIRCUIT_BREAKER_THRESHOLD, (int)5);
+ *   pep_setoption(pep,PEP_OPTION_CIRCUIT_BREAKER_OPEN_TIME, (int)10000);
+ * @endcode
+ * Option {@link #PEP_OPTION_SINGLE_FLIGHT} @c int (@a FALSE or @a TRUE) argument:
+ * @code
+ *   // threads of a shared handle authorizing the same request at the same time
+ *   // wait for the first one, only one request is sent to the PEP daemon
+ *   pep_setoption(pep,PEP_OPTION_SESSION_POOL_SIZE, (int)16);
+ *   pep_setoption(pep,PEP_OPTION_SINGLE_FLIGHT, (int)1);
+ * @endcode
+ * Option {@link #PEP_OPTION_SHM_CACHE} @c const @c char @c * argument:
+ * @code
+ *   // short-lived processes of the same user share the decisions for 2 minutes,
+ *   // in a 64MB segment (/dev/shm/argus-pep-cache on Linux)
+ *   pep_setoption(pep,PEP_OPTION_CACHE_TTL, (int)120);
+ *   pep_setoption(pep,PEP_OPTION_SHM_CACHE_SIZE, (long)64*1024*1024);
+ *   pep_setoption(pep,PEP_OPTION_SHM_CACHE, (const char *)"/argus-pep-cache");
+ * @endcode
+ * Option {@link #PEP_OPTION_SIDECAR_SOCKET} @c const @c char @c * argument:
+ * @code
+ *   // send the requests to the local sidecar daemon, which keeps warm TLS connections
+ *   // to the PEP daemon; fall back to the endpoint if the sidecar is not running
+ *   pep_setoption(pep,PEP_OPTION_SIDECAR_SOCKET, (const char *)"/var/run/argus-pep-sidecar.sock");
+ *   pep_setoption(pep,PEP_OPTION_ENDPOINT_URL, (const char *)"https://pepd.example.org:8154/authz");
+ * @endcode
  *
  */
 pep_error_t pep_setoption(PEP * pep, pep_option_t option, ... );
@@ -334,6 +736,29 @@ pep_error_t pep_setoption(PEP * pep, pep_option_t option, ... );
  *
  * After the call, the @c request parameter is the @b effective XACML request, as processed by the PEPd.
  *
+ * If the decision cache is enabled and a valid decision for the same request (after the PIPs
+ * processing) is cached, the PEPd is not contacted and the cached response is returned. The
+ * ObligationHandlers are always applied. The shared memory decision cache
+ * ({@link #PEP_OPTION_SHM_CACHE}) is looked up after the in-process one.
+ *
+ * If hedging is enabled ({@link #PEP_OPTION_HEDGE_DELAY}) and several endpoints are set,
+ * a request not answered within the hedge delay is sent again to a second endpoint. The
+ * first valid response is returned and the other transfer is cancelled.
+ *
+ * If the circuit breaker is enabled ({@link #PEP_OPTION_CIRCUIT_BREAKER_THRESHOLD}) and the
+ * circuit of all the endpoints is open, the request is not sent and the call fails at once
+ * with {@link #PEP_ERR_CIRCUIT_OPEN}.
+ *
+ * If single-flight is enabled ({@link #PEP_OPTION_SINGLE_FLIGHT}) and an identical request
+ * (after the PIPs processing) is being sent by another thread, the request is not sent:
+ * the call waits for the other one and unmarshals its own copy of the response, or
+ * returns its error code. The ObligationHandlers are always applied.
+ *
+ * If a sidecar daemon is set ({@link #PEP_OPTION_SIDECAR_SOCKET}), the marshalled request
+ * is sent to it over its Unix domain socket instead of HTTPS, the PIPs and ObligationHandlers
+ * are still applied by the caller. If the sidecar can't be reached, the request is sent to
+ * the endpoints if any is set, otherwise the call fails with {@link #PEP_ERR_SIDECAR}.
+ *
  * @param pep pointer to the @b handle of the PEP client.
  * @param request address of the pointer to the {@link #xacml_request_t} to send.
  * @param response address of pointer to the {@link #xacml_response_t} received.
@@ -342,8 +767,242 @@ pep_error_t pep_setoption(PEP * pep, pep_option_t option, ... );
  */
 pep_error_t pep_authorize(PEP * pep, xacml_request_t ** request, xacml_response_t ** response);
 
+/**
+ * Sends the XACML request to the PEP daemon and returns the XACML response, as
+ * pep_authorize(), within a deadline.
+ *
+ * The deadline covers the whole call: the PIPs, the connections, the transfers (failover
+ * and hedged requests included), the response decoding and the ObligationHandlers. The
+ * transfer timeouts are lowered to the time left, and the call fails with
+ * {@link #PEP_ERR_TIMEOUT} if the deadline passes. The PIPs and ObligationHandlers are
+ * not interrupted, the deadline is checked after the PIPs and before the ObligationHandlers.
+ * A decision received in time is stored in the decision cache, even if the deadline
+ * passes before the ObligationHandlers.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param request address of the pointer to the {@link #xacml_request_t} to send.
+ * @param response address of pointer to the {@link #xacml_response_t} received.
+ * @param timeout_ms the call deadline in milliseconds from now, @c 0 for none (as pep_authorize()).
+ *
+ * @return {@link #pep_error_t} PEP_OK on success, PEP_ERR_TIMEOUT if the deadline passed, or an error code.
+ */
+pep_error_t pep_authorize_ex(PEP * pep, xacml_request_t ** request, xacml_response_t ** response, int timeout_ms);
+
+/**
+ * Sends the XACML requests to the PEP daemon and returns their XACML responses.
+ *
+ * Each request is processed as with pep_authorize(): PIPs, decision cache lookup,
+ * ObligationHandlers, and is replaced by its @b effective request. If the option 
+ * {@link #PEP_OPTION_BATCH_ENDPOINT_URL} is set, the requests not found in the decision
+ * cache are sent in one Hessian list to the batch endpoint, which returns the Hessian
+ * list of the responses, in the same order. Otherwise the requests are sent one by one.
+ *
+ * On error, the @a responses array can be partially filled, and the non-@c NULL responses
+ * must be deleted by the caller.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param requests array of the n pointers to the {@link #xacml_request_t} to send.
+ * @param n the number of requests.
+ * @param responses array of n pointers to the {@link #xacml_response_t} received, in the
+ *        requests order.
+ *
+ * @return {@link #pep_error_t} PEP_OK if all the requests are authorized or an error code.
+ */
+pep_error_t pep_authorize_batch(PEP * pep, xacml_request_t ** requests, size_t n, xacml_response_t ** responses);
+
+/**
+ * Submits the XACML request to the PEP daemon without blocking. The completion callback is
+ * called with the XACML response when the transfer completes.
+ *
+ * The PIPs are applied, and the request is marshalled, when the request is submitted. The
+ * response is unmarshalled, and the ObligationHandlers are applied, when the transfer completes.
+ * The transfers are performed by pep_async_poll(), which must be called regularly
+ * by the application event loop.
+ *
+ * On success the PEP client owns the request until the callback is called. On error, the
+ * callback is not called, and the request still belongs to the caller.
+ *
+ * The asynchronous functions are not thread-safe: they must not be called simultaneously
+ * on the same handle from several threads.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param request pointer to the {@link #xacml_request_t} to send.
+ * @param callback the completion callback.
+ * @param userdata user data pointer passed to the callback.
+ *
+ * @return {@link #pep_error_t} PEP_OK if the request is submitted or an error code.
+ */
+pep_error_t pep_authorize_async(PEP * pep, xacml_request_t * request, pep_authorize_callback * callback, void * userdata);
+
+/**
+ * Performs the pending asynchronous authorizations, and calls the completion callbacks of
+ * the completed ones.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param timeout_ms maximum time in milliseconds to wait for network activity, @c 0 to not wait.
+ * @param running if not @c NULL, set to the number of pending authorizations.
+ *
+ * @return {@link #pep_error_t} PEP_OK on success or an error code.
+ */
+pep_error_t pep_async_poll(PEP * pep, int timeout_ms, int * running);
+
+/**
+ * Cancels a pending asynchronous authorization. The completion callback is called with
+ * the error code PEP_ERR_CANCELLED before returning.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param request the request pointer submitted with pep_authorize_async().
+ *
+ * @return {@link #pep_error_t} PEP_OK on success or PEP_ERR_NULL_POINTER if the request is not pending.
+ */
+pep_error_t pep_async_cancel(PEP * pep, const xacml_request_t * request);
+
+/**
+ * Waits for the completion of all the pending asynchronous authorizations, calling their
+ * completion callbacks, and cancels the ones still pending after timeout_ms milliseconds.
+ * On return, no authorization is pending. The callbacks must not submit new requests
+ * while the pending authorizations are drained.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param timeout_ms maximum time in milliseconds to wait, @c 0 to cancel all the pending
+ *        authorizations, or a negative value to wait without limit.
+ *
+ * @return {@link #pep_error_t} PEP_OK on success or an error code.
+ */
+pep_error_t pep_async_drain(PEP * pep, int timeout_ms);
+
+/**
+ * Gets the decision cache statistics of the PEP client.
+ *
+ * The statistics are all zero if the decision cache is not enabled.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param stats pointer to the {@link #pep_cache_stats_t} to fill.
+ *
+ * @return {@link #pep_error_t} PEP_OK on success or an error code.
+ * @see pep_setoption(pep,PEP_OPTION_CACHE_ENABLED, ...)
+ */
+pep_error_t pep_getcachestats(PEP * pep, pep_cache_stats_t * stats);
+
+/**
+ * Gets the statistics of the PEP client: authorizations and errors by class, transfers,
+ * connection reuse, bytes sent and received, and the cumulative and last timings of each
+ * authorization phase. The phases not run by an authorization (cache hit, reused connection,
+ * binary wire encoding) are not counted. A slow authorization can be told from the PIPs,
+ * the network or the PEP daemon.
+ *
+ * The counters are updated without lock, and can be read while the PEP client is used by
+ * other threads: each counter is consistent, but not the statistics as a whole.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param stats pointer to the {@link #pep_stats_t} to fill.
+ *
+ * @return {@link #pep_error_t} PEP_OK on success or an error code.
+ */
+pep_error_t pep_getstats(PEP * pep, pep_stats_t * stats);
+
+/**
+ * Writes the metrics of the PEP client in the Prometheus text exposition format (version
+ * 0.0.4), to be served to a metrics scraper:
+ * - @c argus_pep_authorizations_total, @c argus_pep_decisions_total by @c decision, and
+ *   @c argus_pep_errors_total by @c code and @c error (the {@link #pep_error_t} and its
+ *   description), only for the errors which occurred.
+ * - @c argus_pep_transfers_total, @c argus_pep_transfers_failed_total, @c argus_pep_connections_total
+ *   by @c reused, @c argus_pep_sent_bytes_total and @c argus_pep_received_bytes_total.
+ * - @c argus_pep_phase_duration_seconds histograms by @c phase (see {@link #pep_stats_phase_t}),
+ *   @c argus_pep_endpoint_duration_seconds histograms and @c argus_pep_endpoint_failures_total
+ *   by @c endpoint url. The transfers to the batch endpoint are not counted by endpoint.
+ * - the @c argus_pep_cache_* decision cache statistics, if the cache is enabled.
+ *
+ * The histograms are log-linear: 4 buckets per decade (1, 2.5, 5 and 7.5), from 10 microseconds
+ * to 10 seconds. The metrics of one PEP client are written, a process with several PEP clients
+ * must expose them separately. Use open_memstream(3) to write the metrics into a string.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param out the output stream.
+ *
+ * @return {@link #pep_error_t} PEP_OK on success, or PEP_ERR_MARSHALLING_IO if writing failed.
+ * @see pep_getstats(pep,stats)
+ */
+pep_error_t pep_metrics_write(PEP * pep, FILE * out);
+
+/**
+ * Opens the connections to the PEP daemon endpoints before the first authorization: resolves
+ * the endpoint names, connects and completes the TLS handshakes. A @c HEAD request is sent to
+ * each endpoint, on @a nconns sessions of a shared handle (one session for a single-threaded
+ * handle). The connections are kept open and used by the following authorizations.
+ *
+ * The function must be called after the PEP handle configuration, and not concurrently with
+ * pep_authorize() on a shared handle. The endpoints which can't be reached are avoided by the
+ * first authorizations, see {@link #PEP_OPTION_ENDPOINT_URL}.
+ *
+ * @param pep pointer to the @b handle of the PEP client.
+ * @param nconns number of sessions to warm up, @c 0 or less for all the sessions of the pool.
+ *
+ * @return {@link #pep_error_t} PEP_OK if at least one connection is open, or the error code
+ *         of the last failed connection.
+ */
+pep_error_t pep_warmup(PEP * pep, int nconns);
+
+/**
+ * Creates a share object. The PEP handles using the same share object resume the TLS sessions
+ * (no new handshake with client authentication), reuse the resolved names and, with libcurl
+ * >= 7.57, the open connections of each other. The share object is thread-safe.
+ *
+ * @return the share object or @c NULL on error.
+ * @see pep_setoption(pep,PEP_OPTION_SHARE, ...)
+ */
+pep_share_t * pep_share_create(void);
+
+/**
+ * Destroys the share object. All the PEP handles using it must have been destroyed before,
+ * otherwise an error is logged and the share object is not destroyed.
+ *
+ * @param share pointer to the share object.
+ */
+void pep_share_destroy(pep_share_t * share);
+
+/**
+ * Creates a credentials object: the client certificate, the client key and the CA certificates
+ * of the CA file and of the CA directory (hashed filenames) are read once, and kept in memory.
+ * The PEP handles using the credentials object don't read nor scan the files for each new
+ * connection. Requires libcurl >= 7.77. The credentials object is thread-safe.
+ *
+ * @param client_cert the client certificate file (PEM format), or @c NULL.
+ * @param client_key the client private key file (PEM format), or @c NULL.
+ * @param client_keypassword the client private key password, or @c NULL.
+ * @param server_cert the CA certificates file (PEM format) to verify the PEP daemon, or @c NULL.
+ * @param server_capath the directory of CA certificates (hashed filenames) to verify the PEP daemon, or @c NULL.
+ * @param reload_interval the interval in seconds the files are checked for changes, and reloaded
+ *        if they changed, @c 0 to never check them.
+ *
+ * @return the credentials object or @c NULL on error.
+ * @see pep_setoption(pep,PEP_OPTION_CREDENTIALS, ...)
+ */
+pep_credentials_t * pep_credentials_create(const char * client_cert, const char * client_key, const char * client_keypassword, const char * server_cert, const char * server_capath, int reload_interval);
+
+/**
+ * Reloads the credential files now if they changed, for instance after a certificate
+ * renewal. The new TLS handshakes of the PEP handles use the new credentials. If a file
+ * can't be loaded, the previous credentials are kept.
+ *
+ * @param credentials pointer to the credentials object.
+ *
+ * @return PEP_OK or PEP_ERR_OPTION_INVALID if a file can't be loaded.
+ */
+pep_error_t pep_credentials_reload(pep_credentials_t * credentials);
+
+/**
+ * Destroys the credentials object. All the PEP handles using it must have been destroyed before,
+ * otherwise an error is logged and the credentials object is not destroyed.
+ *
+ * @param credentials pointer to the credentials object.
+ */
+void pep_credentials_destroy(pep_credentials_t * credentials);
+
 /**
  * Cleanups and destroys the PEP client. Any uses of the @b handle after this function has been called are illegal. 
+ * The pending asynchronous authorizations are cancelled.
  *
  * @param pep pointer to the @b handle of the PEP client.
  *
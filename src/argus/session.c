@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+/* pthread and semaphore with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <curl/curl.h>
+
+/* from ../util */
+#include "buffer.h"
+#include "clock.h"
+#include "log.h"
+
+#include "session.h"
+#include "sidecar.h"
+
+/*
+ * Pool slot, the session must be the first member: a leased session
+ * pointer is also its slot pointer.
+ */
+typedef struct pep_session_slot {
+    pep_session_t session;
+    pthread_mutex_t lock; /* held while the session is leased */
+} pep_session_slot_t;
+
+/*
+ * The semaphore counts the free slots and bounds the number of leased
+ * sessions. A thread which passed the semaphore is guaranteed to find a
+ * free slot, it tries the slot locks round-robin starting at a rotating
+ * hint, so no lock is shared by all the threads.
+ */
+struct pep_session_pool {
+    int size;
+    sem_t available;
+    volatile unsigned int hint;
+    pep_session_slot_t * slots;
+};
+
+/** serializes the duplications of the template easy handles */
+static pthread_mutex_t session_template_lock= PTHREAD_MUTEX_INITIALIZER;
+
+/** initial sizes of the session buffers */
+#define SESSION_OUTPUT_SIZE 512
+#define SESSION_INPUT_SIZE 1024
+/** a buffer larger than this factor times its moving average length is deleted */
+#define SESSION_BUFFER_SHRINK 4
+
+/* moving average of the buffer lengths, with a weight of 1/4 for the last one */
+static size_t session_hint(size_t hint, size_t length) {
+    if (hint == 0) return length;
+    return (3 * hint + length) / 4;
+}
+
+static pep_buffer_t * session_buffer(pep_buffer_t * buffer, size_t hint, size_t size) {
+    if (buffer != NULL) {
+        pep_buffer_clear(buffer);
+        return buffer;
+    }
+    /* some room above the average length to avoid a realloc */
+    if (hint + hint / 2 > size) {
+        size= hint + hint / 2;
+    }
+    return pep_buffer_create(size);
+}
+
+long pep_session_remaining(const pep_session_t * session) {
+    uint64_t now;
+    if (session == NULL || session->deadline == 0) return -1;
+    now= pep_clock_ms();
+    if (now >= session->deadline) return 0;
+    return (long)(session->deadline - now);
+}
+
+int pep_session_getbuffers(pep_session_t * session) {
+    if (session == NULL) return -1;
+    session->output= session_buffer(session->output,session->output_hint,SESSION_OUTPUT_SIZE);
+    session->input= session_buffer(session->input,session->input_hint,SESSION_INPUT_SIZE);
+    if (session->output == NULL || session->input == NULL) {
+        pep_log_error("pep_session_getbuffers: can't create session buffers.");
+        pep_session_deletebuffers(session);
+        return -1;
+    }
+    return 0;
+}
+
+void pep_session_releasebuffers(pep_session_t * session) {
+    size_t length;
+    if (session == NULL) return;
+    if (session->output != NULL) {
+        pep_buffer_rewind(session->output);
+        length= pep_buffer_length(session->output);
+        session->output_hint= session_hint(session->output_hint,length);
+        if (pep_buffer_size(session->output) > SESSION_BUFFER_SHRINK * session->output_hint
+            && pep_buffer_size(session->output) > SESSION_OUTPUT_SIZE) {
+            pep_buffer_delete(session->output);
+            session->output= NULL;
+        }
+    }
+    if (session->input != NULL) {
+        pep_buffer_rewind(session->input);
+        length= pep_buffer_length(session->input);
+        session->input_hint= session_hint(session->input_hint,length);
+        if (pep_buffer_size(session->input) > SESSION_BUFFER_SHRINK * session->input_hint
+            && pep_buffer_size(session->input) > SESSION_INPUT_SIZE) {
+            pep_buffer_delete(session->input);
+            session->input= NULL;
+        }
+    }
+    if (session->compressed != NULL
+        && pep_buffer_size(session->compressed) > SESSION_BUFFER_SHRINK * session->output_hint) {
+        pep_buffer_delete(session->compressed);
+        session->compressed= NULL;
+    }
+}
+
+void pep_session_deletebuffers(pep_session_t * session) {
+    if (session == NULL) return;
+    pep_buffer_delete(session->output);
+    session->output= NULL;
+    pep_buffer_delete(session->input);
+    session->input= NULL;
+    pep_buffer_delete(session->compressed);
+    session->compressed= NULL;
+}
+
+CURL * pep_session_duphandle(CURL * template) {
+    CURL * curl;
+    pthread_mutex_lock(&session_template_lock);
+    curl= curl_easy_duphandle(template);
+    pthread_mutex_unlock(&session_template_lock);
+    return curl;
+}
+
+pep_session_t * pep_session_gethedge(pep_session_t * session, CURL * template, unsigned long generation) {
+    pep_session_t * hedge;
+    if (session == NULL || template == NULL) {
+        pep_log_error("pep_session_gethedge: NULL session or template pointer.");
+        return NULL;
+    }
+    if (session->multi == NULL) {
+        session->multi= curl_multi_init();
+        if (session->multi == NULL) {
+            pep_log_error("pep_session_gethedge: can't create CURL multi handle.");
+            return NULL;
+        }
+    }
+    if (session->hedge == NULL) {
+        session->hedge= calloc(1,sizeof(pep_session_t));
+        if (session->hedge == NULL) {
+            pep_log_error("pep_session_gethedge: can't allocate hedge pep_session_t.");
+            return NULL;
+        }
+        session->hedge->owned= TRUE;
+    }
+    hedge= session->hedge;
+    /* (re)create the easy handle if needed */
+    if (hedge->curl == NULL || hedge->generation != generation) {
+        if (hedge->curl != NULL) {
+            curl_easy_cleanup(hedge->curl);
+        }
+        hedge->curl= pep_session_duphandle(template);
+        hedge->generation= generation;
+        hedge->configured= FALSE;
+        hedge->credentials_generation= 0;
+        if (hedge->curl == NULL) {
+            pep_log_error("pep_session_gethedge: can't duplicate CURL session handle.");
+            return NULL;
+        }
+    }
+    return hedge;
+}
+
+void pep_session_deletehedge(pep_session_t * session) {
+    if (session == NULL) return;
+    if (session->hedge != NULL) {
+        pep_session_deletebuffers(session->hedge);
+        if (session->hedge->curl != NULL) {
+            curl_easy_cleanup(session->hedge->curl);
+        }
+        free(session->hedge);
+        session->hedge= NULL;
+    }
+    if (session->multi != NULL) {
+        curl_multi_cleanup(session->multi);
+        session->multi= NULL;
+    }
+}
+
+pep_session_pool_t * pep_session_pool_create(int size) {
+    int i;
+    pep_session_pool_t * pool;
+    if (size < 1) {
+        pep_log_error("pep_session_pool_create: invalid pool size: %d.",size);
+        return NULL;
+    }
+    pool= calloc(1,sizeof(struct pep_session_pool));
+    if (pool == NULL) {
+        pep_log_error("pep_session_pool_create: can't allocate pep_session_pool_t.");
+        return NULL;
+    }
+    pool->slots= calloc(size,sizeof(pep_session_slot_t));
+    if (pool->slots == NULL) {
+        pep_log_error("pep_session_pool_create: can't allocate %d session slots.",size);
+        free(pool);
+        return NULL;
+    }
+    if (sem_init(&(pool->available),0,(unsigned int)size) != 0) {
+        pep_log_error("pep_session_pool_create: sem_init(%d) failed: %d.",size,errno);
+        free(pool->slots);
+        free(pool);
+        return NULL;
+    }
+    for (i= 0; i < size; i++) {
+        pthread_mutex_init(&(pool->slots[i].lock),NULL);
+        pool->slots[i].session.owned= TRUE;
+    }
+    pool->size= size;
+    pool->hint= 0;
+    return pool;
+}
+
+int pep_session_pool_size(const pep_session_pool_t * pool) {
+    if (pool == NULL) return 0;
+    return pool->size;
+}
+
+pep_session_t * pep_session_pool_lease(pep_session_pool_t * pool, CURL * template, unsigned long generation) {
+    pep_session_slot_t * slot= NULL;
+    unsigned int start;
+    int i;
+    if (pool == NULL || template == NULL) {
+        pep_log_error("pep_session_pool_lease: NULL pool or template pointer.");
+        return NULL;
+    }
+    while (sem_wait(&(pool->available)) != 0) {
+        if (errno != EINTR) {
+            pep_log_error("pep_session_pool_lease: sem_wait failed: %d.",errno);
+            return NULL;
+        }
+    }
+    start= __sync_fetch_and_add(&(pool->hint),1);
+    for (i= 0; slot == NULL; i++) {
+        pep_session_slot_t * candidate= &(pool->slots[(start + i) % pool->size]);
+        if (pthread_mutex_trylock(&(candidate->lock)) == 0) {
+            slot= candidate;
+        }
+    }
+    /* (re)create the easy handle if needed */
+    if (slot->session.curl == NULL || slot->session.generation != generation) {
+        if (slot->session.curl != NULL) {
+            curl_easy_cleanup(slot->session.curl);
+        }
+        slot->session.curl= pep_session_duphandle(template);
+        slot->session.generation= generation;
+        slot->session.configured= FALSE;
+        slot->session.credentials_generation= 0;
+        if (slot->session.curl == NULL) {
+            pep_log_error("pep_session_pool_lease: can't duplicate CURL session handle.");
+            pep_session_pool_release(pool,&(slot->session));
+            return NULL;
+        }
+    }
+    return &(slot->session);
+}
+
+void pep_session_pool_release(pep_session_pool_t * pool, pep_session_t * session) {
+    pep_session_slot_t * slot= (pep_session_slot_t *)session;
+    if (pool == NULL || session == NULL) return;
+    pthread_mutex_unlock(&(slot->lock));
+    sem_post(&(pool->available));
+}
+
+void pep_session_pool_delete(pep_session_pool_t * pool) {
+    int i;
+    if (pool == NULL) return;
+    for (i= 0; i < pool->size; i++) {
+        pep_session_slot_t * slot= &(pool->slots[i]);
+        pep_sidecar_disconnect(&(slot->session));
+        pep_session_deletehedge(&(slot->session));
+        pep_session_deletebuffers(&(slot->session));
+        if (slot->session.curl != NULL) {
+            curl_easy_cleanup(slot->session.curl);
+            slot->session.curl= NULL;
+        }
+        pthread_mutex_destroy(&(slot->lock));
+    }
+    sem_destroy(&(pool->available));
+    free(pool->slots);
+    free(pool);
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: authorization sessions and session pool
+ *
+ * $Id$
+ */
+#ifndef _PEP_SESSION_H_
+#define _PEP_SESSION_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h> /* uint64_t */
+#include <curl/curl.h>
+
+#include "buffer.h" /* ../util/buffer.h */
+#include "base64.h" /* ../util/base64.h */
+
+/**
+ * Authorization session: the per call state of pep_authorize(). A session
+ * is used by only one thread at a time.
+ */
+typedef struct pep_session {
+    CURL * curl; /* easy handle, duplicated from the PEP handle template */
+    unsigned long generation; /* template generation of the easy handle */
+    int owned; /* TRUE if the easy handle must be released with the session */
+    int endpoint; /* index of the endpoint of the current transfer */
+    unsigned long tried; /* bitmask of the endpoints already tried */
+    uint64_t sent; /* start time (us) of the current transfer */
+    uint64_t deadline; /* time (ms) the current authorization must end by, 0 if none */
+    int configured; /* TRUE if the transfer callbacks are set on the easy handle */
+    unsigned long credentials_generation; /* generation of the in-memory credentials set on the easy handle, 0 if none */
+    /* buffers for pep_authorize, kept across calls */
+    pep_buffer_t * output;
+    pep_base64_encoder_t b64output; /* streams output base64 encoded */
+    pep_buffer_t * input;
+    pep_base64_decoder_t b64input; /* decodes the response into input */
+    uint64_t encode_us; /* base64 encoding time of the current transfer */
+    uint64_t decode_us; /* base64 decoding time of the current transfer */
+    uint64_t received_first; /* time (us) the first response byte of the current transfer was written, 0 if none */
+    uint64_t received_last; /* time (us) the last response byte was written */
+    void * trace; /* tracer span of the current authorization, NULL if not traced */
+    void * trace_transfer; /* tracer span of the current transfer, NULL if not traced */
+    pep_buffer_t * compressed; /* compressed request body, created on demand */
+    size_t output_hint; /* moving average of the output length */
+    size_t input_hint; /* moving average of the input length */
+    /* hedged requests */
+    struct pep_session * hedge; /* session of the duplicate request, created on demand */
+    CURLM * multi; /* multi handle running the request and its duplicate */
+    /* sidecar daemon transport */
+    int sidecar_fd; /* socket connected to the sidecar daemon */
+    int sidecar_connected; /* TRUE if sidecar_fd is open */
+} pep_session_t;
+
+/**
+ * Returns the milliseconds left before the session deadline.
+ *
+ * @return the time left, 0 if the deadline passed, or -1 if the session has no deadline.
+ */
+long pep_session_remaining(const pep_session_t * session);
+
+/**
+ * Returns the output and input buffers of the session emptied, and creates them
+ * if needed. The new buffers are sized from the recent output and input lengths.
+ *
+ * @return 0 on success or -1 if a buffer can't be created.
+ */
+int pep_session_getbuffers(pep_session_t * session);
+
+/**
+ * Releases the buffers of the session after an authorization, they are kept for the
+ * next one. A buffer grown much larger than the recent lengths is deleted.
+ */
+void pep_session_releasebuffers(pep_session_t * session);
+
+/**
+ * Deletes the buffers of the session, if any.
+ */
+void pep_session_deletebuffers(pep_session_t * session);
+
+/**
+ * Duplicates the template easy handle. The duplications are serialized: the template
+ * handle of a shared PEP handle is duplicated by the threads leasing, hedging and
+ * sending asynchronously, and an easy handle can't be used by several threads at once.
+ *
+ * @return the new easy handle or NULL if an error occurs.
+ */
+CURL * pep_session_duphandle(CURL * template);
+
+/**
+ * Returns the hedge session of the session, and creates the session multi handle
+ * if needed. The hedge easy handle is (re)duplicated from template if its generation
+ * is older than the given template generation.
+ *
+ * @return the hedge session or NULL if an error occurs.
+ */
+pep_session_t * pep_session_gethedge(pep_session_t * session, CURL * template, unsigned long generation);
+
+/**
+ * Deletes the hedge session and the multi handle of the session, if any.
+ */
+void pep_session_deletehedge(pep_session_t * session);
+
+/**
+ * ADT bounded session pool type.
+ */
+typedef struct pep_session_pool pep_session_pool_t;
+
+/**
+ * Creates a session pool of at most size sessions. The sessions easy handles
+ * are lazily duplicated from the template easy handle.
+ *
+ * @param size the maximum number of concurrent sessions.
+ *
+ * @return a pointer to the new pool or NULL if an error occurs.
+ */
+pep_session_pool_t * pep_session_pool_create(int size);
+
+/**
+ * Returns the maximum number of sessions of the pool.
+ */
+int pep_session_pool_size(const pep_session_pool_t * pool);
+
+/**
+ * Leases a session from the pool, blocks until one is available. The session
+ * easy handle is (re)duplicated from template if its generation is older than
+ * the given template generation.
+ *
+ * @param pool pointer to the pool.
+ * @param template the template easy handle.
+ * @param generation the current generation of the template.
+ *
+ * @return the leased session or NULL if an error occurs.
+ */
+pep_session_t * pep_session_pool_lease(pep_session_pool_t * pool, CURL * template, unsigned long generation);
+
+/**
+ * Returns the leased session to the pool.
+ */
+void pep_session_pool_release(pep_session_pool_t * pool, pep_session_t * session);
+
+/**
+ * Deletes the pool and releases all its sessions. No session must be leased.
+ */
+void pep_session_pool_delete(pep_session_pool_t * pool);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
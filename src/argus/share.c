@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+/* pthread with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <curl/curl.h>
+
+/* from ../util */
+#include "log.h"
+
+#include "share.h"
+
+/*
+ * One lock per shared data, so resolving a name doesn't wait for a TLS session
+ * lookup. CURL_LOCK_DATA_LAST bounds the curl_lock_data values.
+ */
+struct pep_share {
+    CURLSH * curlsh;
+    pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+};
+
+static void share_lock(CURL * curl, curl_lock_data data, curl_lock_access access, void * userdata) {
+    pep_share_t * share= (pep_share_t *)userdata;
+    if (data >= 0 && data < CURL_LOCK_DATA_LAST) {
+        pthread_mutex_lock(&(share->locks[data]));
+    }
+}
+
+static void share_unlock(CURL * curl, curl_lock_data data, void * userdata) {
+    pep_share_t * share= (pep_share_t *)userdata;
+    if (data >= 0 && data < CURL_LOCK_DATA_LAST) {
+        pthread_mutex_unlock(&(share->locks[data]));
+    }
+}
+
+static int share_data(pep_share_t * share, curl_lock_data data, const char * name) {
+    CURLSHcode curlsh_rc= curl_share_setopt(share->curlsh,CURLSHOPT_SHARE,data);
+    if (curlsh_rc != CURLSHE_OK) {
+        pep_log_warn("pep_share_create: curl_share_setopt(curlsh,CURLSHOPT_SHARE,%s) failed: %s.",name,curl_share_strerror(curlsh_rc));
+        return -1;
+    }
+    return 0;
+}
+
+pep_share_t * pep_share_create(void) {
+    int i;
+    pep_share_t * share= calloc(1,sizeof(struct pep_share));
+    if (share == NULL) {
+        pep_log_error("pep_share_create: can't allocate pep_share_t.");
+        return NULL;
+    }
+    share->curlsh= curl_share_init();
+    if (share->curlsh == NULL) {
+        pep_log_error("pep_share_create: can't create CURL share handle.");
+        free(share);
+        return NULL;
+    }
+    for (i= 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&(share->locks[i]),NULL);
+    }
+    curl_share_setopt(share->curlsh,CURLSHOPT_LOCKFUNC,share_lock);
+    curl_share_setopt(share->curlsh,CURLSHOPT_UNLOCKFUNC,share_unlock);
+    curl_share_setopt(share->curlsh,CURLSHOPT_USERDATA,share);
+    /* an older libcurl shares less, but the share is still usable */
+    share_data(share,CURL_LOCK_DATA_DNS,"CURL_LOCK_DATA_DNS");
+    share_data(share,CURL_LOCK_DATA_SSL_SESSION,"CURL_LOCK_DATA_SSL_SESSION");
+#if LIBCURL_VERSION_NUM >= 0x073900
+    /* connection cache sharing requires libcurl >= 7.57 */
+    share_data(share,CURL_LOCK_DATA_CONNECT,"CURL_LOCK_DATA_CONNECT");
+#endif
+    return share;
+}
+
+CURLSH * pep_share_getcurlsh(const pep_share_t * share) {
+    if (share == NULL) return NULL;
+    return share->curlsh;
+}
+
+void pep_share_destroy(pep_share_t * share) {
+    CURLSHcode curlsh_rc;
+    int i;
+    if (share == NULL) return;
+    curlsh_rc= curl_share_cleanup(share->curlsh);
+    if (curlsh_rc != CURLSHE_OK) {
+        /* still used by a PEP handle: releasing the locks would crash it */
+        pep_log_error("pep_share_destroy: curl_share_cleanup(curlsh) failed: %s.",curl_share_strerror(curlsh_rc));
+        return;
+    }
+    for (i= 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&(share->locks[i]));
+    }
+    free(share);
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: data shared among PEP handles
+ *
+ * $Id$
+ */
+#ifndef _PEP_SHARE_H_
+#define _PEP_SHARE_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <curl/curl.h>
+
+#include "pep.h"
+
+/**
+ * Returns the CURL share handle of the share object, or NULL.
+ */
+CURLSH * pep_share_getcurlsh(const pep_share_t * share);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+/* shm_open, mmap and ftruncate with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* from ../util */
+#include "buffer.h"
+#include "log.h"
+
+#include "shmcache.h"
+
+/** segment layout identification */
+#define SHMCACHE_MAGIC   0x50455043 /* "PEPC" */
+#define SHMCACHE_VERSION 1
+/** header size, the slots are cache line aligned */
+#define SHMCACHE_HEADER_SIZE 64
+/** slot size: slot header, key and value */
+#define SHMCACHE_SLOT_SIZE 4096
+/** number of slots probed for a key */
+#define SHMCACHE_PROBES 8
+/** attempts to read a slot being written */
+#define SHMCACHE_READ_RETRIES 4
+/** times a process opening the segment waits 1ms for its creator to size it */
+#define SHMCACHE_OPEN_RETRIES 100
+
+/* segment header, written once by the first process */
+typedef struct shmcache_header {
+    volatile uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t slots_l;
+} shmcache_header_t;
+
+/* slot, the sequence is odd while the slot is written */
+typedef struct shmcache_slot {
+    volatile uint32_t seq;
+    uint32_t key_l;
+    uint32_t value_l;
+    uint32_t reserved;
+    uint64_t hash;
+    int64_t expires; /* time after which the entry is stale, 0 if the slot is empty */
+    unsigned char data[]; /* key and value bytes */
+} shmcache_slot_t;
+
+#define SHMCACHE_SLOT_DATA (SHMCACHE_SLOT_SIZE - sizeof(shmcache_slot_t))
+
+struct pep_shmcache {
+    unsigned char * map;
+    size_t map_l;
+    uint32_t slots_l;
+};
+
+static shmcache_slot_t * shmcache_slot(const pep_shmcache_t * cache, uint64_t hash, int probe) {
+    size_t i= (size_t)((hash + (uint64_t)probe) % cache->slots_l);
+    return (shmcache_slot_t *)(cache->map + SHMCACHE_HEADER_SIZE + i * SHMCACHE_SLOT_SIZE);
+}
+
+pep_shmcache_t * pep_shmcache_open(const char * name, size_t size) {
+    pep_shmcache_t * cache;
+    shmcache_header_t * header;
+    struct stat st;
+    uint32_t slots_l;
+    void * map;
+    int fd, created, retry;
+    struct timespec delay= { 0, 1000000L };
+    if (name == NULL) {
+        pep_log_error("pep_shmcache_open: NULL name.");
+        return NULL;
+    }
+    /* only the creator sizes the segment, the other processes use its size */
+    created= 1;
+    fd= shm_open(name,O_RDWR | O_CREAT | O_EXCL,S_IRUSR | S_IWUSR);
+    if (fd < 0 && errno == EEXIST) {
+        created= 0;
+        fd= shm_open(name,O_RDWR,S_IRUSR | S_IWUSR);
+    }
+    if (fd < 0) {
+        pep_log_error("pep_shmcache_open: shm_open(%s) failed: %d.",name,errno);
+        return NULL;
+    }
+    if (fstat(fd,&st) != 0) {
+        pep_log_error("pep_shmcache_open: fstat(%s) failed: %d.",name,errno);
+        close(fd);
+        return NULL;
+    }
+    /* a segment created by another user could hold injected decisions */
+    if (st.st_uid != geteuid() || (st.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+        pep_log_error("pep_shmcache_open: %s is not private to the user %d, not used.",name,(int)geteuid());
+        close(fd);
+        return NULL;
+    }
+    if (created && ftruncate(fd,(off_t)size) != 0) {
+        pep_log_error("pep_shmcache_open: ftruncate(%s,%d) failed: %d.",name,(int)size,errno);
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    /* the creator may not have sized the segment yet */
+    for (retry= 0; retry <= SHMCACHE_OPEN_RETRIES; retry++) {
+        if (fstat(fd,&st) != 0) {
+            pep_log_error("pep_shmcache_open: fstat(%s) failed: %d.",name,errno);
+            close(fd);
+            return NULL;
+        }
+        if (st.st_size != 0 || created) break;
+        nanosleep(&delay,NULL);
+    }
+    size= (size_t)st.st_size;
+    if (size < SHMCACHE_HEADER_SIZE + SHMCACHE_PROBES * SHMCACHE_SLOT_SIZE) {
+        pep_log_error("pep_shmcache_open: %s size %d too small.",name,(int)size);
+        close(fd);
+        return NULL;
+    }
+    slots_l= (uint32_t)((size - SHMCACHE_HEADER_SIZE) / SHMCACHE_SLOT_SIZE);
+    map= mmap(NULL,size,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        pep_log_error("pep_shmcache_open: mmap(%s,%d) failed: %d.",name,(int)size,errno);
+        return NULL;
+    }
+    /* the new segment is zero filled: an empty table once the header is written */
+    header= (shmcache_header_t *)map;
+    if (header->magic == 0) {
+        header->version= SHMCACHE_VERSION;
+        header->slot_size= SHMCACHE_SLOT_SIZE;
+        header->slots_l= slots_l;
+        __sync_synchronize();
+        __sync_bool_compare_and_swap(&(header->magic),0,SHMCACHE_MAGIC);
+    }
+    if (header->magic != SHMCACHE_MAGIC || header->version != SHMCACHE_VERSION
+        || header->slot_size != SHMCACHE_SLOT_SIZE || header->slots_l != slots_l) {
+        pep_log_error("pep_shmcache_open: %s is not a compatible decision cache segment.",name);
+        munmap(map,size);
+        return NULL;
+    }
+    cache= calloc(1,sizeof(struct pep_shmcache));
+    if (cache == NULL) {
+        pep_log_error("pep_shmcache_open: can't allocate pep_shmcache_t.");
+        munmap(map,size);
+        return NULL;
+    }
+    cache->map= map;
+    cache->map_l= size;
+    cache->slots_l= slots_l;
+    pep_log_debug("pep_shmcache_open: %s mapped: %d slots.",name,(int)slots_l);
+    return cache;
+}
+
+int pep_shmcache_lookup(pep_shmcache_t * cache, const void * key, size_t key_l, pep_buffer_t * value) {
+    unsigned char copy[SHMCACHE_SLOT_DATA];
+    uint64_t hash;
+    int64_t now;
+    int i, retry;
+    if (cache == NULL || key == NULL || value == NULL) {
+        pep_log_error("pep_shmcache_lookup: NULL cache, key or value pointer.");
+        return PEP_CACHE_ERROR;
+    }
+    if (key_l > SHMCACHE_SLOT_DATA) {
+        return PEP_CACHE_MISS;
+    }
+    hash= pep_cache_hash(key,key_l);
+    now= (int64_t)time(NULL);
+    for (i= 0; i < SHMCACHE_PROBES; i++) {
+        shmcache_slot_t * slot= shmcache_slot(cache,hash,i);
+        for (retry= 0; retry < SHMCACHE_READ_RETRIES; retry++) {
+            uint32_t seq= slot->seq, value_l;
+            int64_t expires;
+            int match;
+            __sync_synchronize();
+            if (seq & 1) continue;
+            expires= slot->expires;
+            value_l= slot->value_l;
+            match= slot->hash == hash && slot->key_l == key_l && expires > now
+                   && value_l <= SHMCACHE_SLOT_DATA - key_l
+                   && memcmp(slot->data,key,key_l) == 0;
+            if (match) {
+                memcpy(copy,slot->data + key_l,value_l);
+            }
+            __sync_synchronize();
+            if (slot->seq != seq) continue;
+            /* consistent read */
+            if (match) {
+                if (pep_buffer_write(copy,sizeof(char),value_l,value) != value_l) {
+                    pep_log_error("pep_shmcache_lookup: can't copy %d bytes value.",(int)value_l);
+                    return PEP_CACHE_ERROR;
+                }
+                return PEP_CACHE_HIT;
+            }
+            /* never written: the key is not in the next slots */
+            if (expires == 0 && seq == 0) {
+                return PEP_CACHE_MISS;
+            }
+            break;
+        }
+    }
+    return PEP_CACHE_MISS;
+}
+
+int pep_shmcache_store(pep_shmcache_t * cache, const void * key, size_t key_l, const void * value, size_t value_l, long ttl) {
+    shmcache_slot_t * slot, * victim= NULL;
+    uint32_t seq, victim_seq= 0;
+    int64_t now, victim_expires= 0;
+    uint64_t hash;
+    int i;
+    if (cache == NULL || key == NULL || value == NULL) {
+        pep_log_error("pep_shmcache_store: NULL cache, key or value pointer.");
+        return PEP_CACHE_ERROR;
+    }
+    if (key_l + value_l > SHMCACHE_SLOT_DATA) {
+        pep_log_debug("pep_shmcache_store: entry of %d bytes too large for a slot.",(int)(key_l + value_l));
+        return PEP_CACHE_ERROR;
+    }
+    hash= pep_cache_hash(key,key_l);
+    now= (int64_t)time(NULL);
+    /* the slot of the same key, else the first stale one, else the oldest one */
+    for (i= 0; i < SHMCACHE_PROBES; i++) {
+        slot= shmcache_slot(cache,hash,i);
+        seq= slot->seq;
+        if (seq & 1) continue;
+        if (slot->hash == hash && slot->key_l == key_l && memcmp(slot->data,key,key_l) == 0) {
+            victim= slot;
+            victim_seq= seq;
+            break;
+        }
+        if (victim == NULL || (victim_expires > now && slot->expires < victim_expires)) {
+            victim= slot;
+            victim_seq= seq;
+            victim_expires= slot->expires;
+        }
+    }
+    /* all the slots are being written */
+    if (victim == NULL || !__sync_bool_compare_and_swap(&(victim->seq),victim_seq,victim_seq + 1)) {
+        pep_log_debug("pep_shmcache_store: slots busy, entry not stored.");
+        return PEP_CACHE_ERROR;
+    }
+    __sync_synchronize();
+    victim->hash= hash;
+    victim->key_l= (uint32_t)key_l;
+    victim->value_l= (uint32_t)value_l;
+    victim->expires= now + (int64_t)ttl;
+    memcpy(victim->data,key,key_l);
+    memcpy(victim->data + key_l,value,value_l);
+    __sync_synchronize();
+    victim->seq= victim_seq + 2;
+    return PEP_CACHE_OK;
+}
+
+void pep_shmcache_close(pep_shmcache_t * cache) {
+    if (cache == NULL) return;
+    munmap(cache->map,cache->map_l);
+    free(cache);
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: decision cache shared by processes in a shared memory segment
+ *
+ * $Id$
+ */
+#ifndef _PEP_SHMCACHE_H_
+#define _PEP_SHMCACHE_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* size_t */
+
+#include "cache.h" /* PEP_CACHE_* return codes */
+#include "buffer.h" /* ../util/buffer.h */
+
+/**
+ * ADT shared memory decision cache type.
+ *
+ * The cache maps the serialized Hessian request (key) to the serialized Hessian
+ * response (value), as the in-process decision cache, in a POSIX shared memory
+ * segment mapped by all the processes of the user. The segment is an open
+ * addressing table of fixed size slots, each protected by a sequence lock: the
+ * lookups don't lock, and a store skips a slot being written by another process.
+ * An entry which doesn't fit in a slot is not cached, an expired or the oldest
+ * entry of the probed slots is replaced.
+ *
+ * The segment is created with mode 0600 and is only used if it is owned by the
+ * effective user: processes of other users can't read or inject decisions.
+ */
+typedef struct pep_shmcache pep_shmcache_t;
+
+/**
+ * Opens the shared memory cache segment, and creates it if needed.
+ *
+ * @param name the POSIX shared memory object name (e.g. "/argus-pep-cache").
+ * @param size the size in bytes of the segment if it is created.
+ *
+ * @return a pointer to the mapped cache or NULL if an error occurs.
+ */
+pep_shmcache_t * pep_shmcache_open(const char * name, size_t size);
+
+/**
+ * Looks up the key and, on hit, writes a copy of the cached value into the
+ * value buffer.
+ *
+ * @return PEP_CACHE_HIT, PEP_CACHE_MISS or PEP_CACHE_ERROR if an error occurs.
+ */
+int pep_shmcache_lookup(pep_shmcache_t * cache, const void * key, size_t key_l, pep_buffer_t * value);
+
+/**
+ * Stores a copy of the key and value bytes for ttl seconds.
+ *
+ * @return PEP_CACHE_OK, or PEP_CACHE_ERROR if the entry is too large or all its slots
+ *         are being written.
+ */
+int pep_shmcache_store(pep_shmcache_t * cache, const void * key, size_t key_l, const void * value, size_t value_l, long ttl);
+
+/**
+ * Unmaps the segment, which is kept for the other and next processes.
+ */
+void pep_shmcache_close(pep_shmcache_t * cache);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+/* sockets, poll and MSG_NOSIGNAL with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* from ../util */
+#include "buffer.h"
+#include "clock.h"
+#include "log.h"
+
+#include "sidecar.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/** frame header length: code and payload length */
+#define SIDECAR_HEADER_SIZE 8
+
+/** payload read chunk */
+#define SIDECAR_CHUNK_SIZE 4096
+
+static int sidecar_address(const char * path, struct sockaddr_un * address) {
+    if (path == NULL || strlen(path) >= sizeof(address->sun_path)) {
+        pep_log_error("pep_sidecar: invalid socket path: %s.",(path == NULL) ? "NULL" : path);
+        return -1;
+    }
+    memset(address,0,sizeof(struct sockaddr_un));
+    address->sun_family= AF_UNIX;
+    strcpy(address->sun_path,path);
+    return 0;
+}
+
+/* waits for the socket to be readable or writable, until the deadline */
+static int sidecar_poll(int fd, short events, uint64_t deadline) {
+    struct pollfd pfd;
+    int timeout= -1, rc;
+    uint64_t now;
+    pfd.fd= fd;
+    pfd.events= events;
+    do {
+        if (deadline != 0) {
+            now= pep_clock_ms();
+            if (now >= deadline) {
+                return -1;
+            }
+            timeout= (int)(deadline - now);
+        }
+        pfd.revents= 0;
+        rc= poll(&pfd,1,timeout);
+    } while (rc < 0 && errno == EINTR);
+    return (rc > 0) ? 0 : -1;
+}
+
+static int sidecar_writeall(int fd, const unsigned char * data, size_t length, uint64_t deadline) {
+    ssize_t n;
+    while (length > 0) {
+        n= send(fd,data,length,MSG_NOSIGNAL);
+        if (n > 0) {
+            data += n;
+            length -= (size_t)n;
+        }
+        else if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (sidecar_poll(fd,POLLOUT,deadline) != 0) {
+                return -1;
+            }
+        }
+        else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* reads exactly length bytes, returns 1 on end of stream before the first byte */
+static int sidecar_readall(int fd, unsigned char * data, size_t length, uint64_t deadline) {
+    size_t read_l= 0;
+    ssize_t n;
+    while (read_l < length) {
+        n= recv(fd,data + read_l,length - read_l,0);
+        if (n > 0) {
+            read_l += (size_t)n;
+        }
+        else if (n == 0) {
+            return (read_l == 0) ? 1 : -1;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (sidecar_poll(fd,POLLIN,deadline) != 0) {
+                return -1;
+            }
+        }
+        else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int pep_sidecar_listen(const char * path, int backlog) {
+    struct sockaddr_un address;
+    struct stat st;
+    int fd;
+    if (sidecar_address(path,&address) != 0) {
+        return -1;
+    }
+    /* only remove a stale socket, never a regular file */
+    if (lstat(path,&st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path);
+    }
+    fd= socket(AF_UNIX,SOCK_STREAM,0);
+    if (fd < 0) {
+        pep_log_error("pep_sidecar_listen: socket(AF_UNIX) failed: %s.",strerror(errno));
+        return -1;
+    }
+    if (bind(fd,(struct sockaddr *)&address,sizeof(struct sockaddr_un)) != 0) {
+        pep_log_error("pep_sidecar_listen: bind(%s) failed: %s.",path,strerror(errno));
+        close(fd);
+        return -1;
+    }
+    if (listen(fd,backlog) != 0) {
+        pep_log_error("pep_sidecar_listen: listen(%s,%d) failed: %s.",path,backlog,strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int pep_sidecar_connect(const char * path) {
+    struct sockaddr_un address;
+    int fd, flags;
+    if (sidecar_address(path,&address) != 0) {
+        return -1;
+    }
+    fd= socket(AF_UNIX,SOCK_STREAM,0);
+    if (fd < 0) {
+        pep_log_error("pep_sidecar_connect: socket(AF_UNIX) failed: %s.",strerror(errno));
+        return -1;
+    }
+    if (connect(fd,(struct sockaddr *)&address,sizeof(struct sockaddr_un)) != 0) {
+        pep_log_warn("pep_sidecar_connect: connect(%s) failed: %s.",path,strerror(errno));
+        close(fd);
+        return -1;
+    }
+    flags= fcntl(fd,F_GETFL,0);
+    if (flags < 0 || fcntl(fd,F_SETFL,flags | O_NONBLOCK) != 0) {
+        pep_log_error("pep_sidecar_connect: fcntl(O_NONBLOCK) failed: %s.",strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fcntl(fd,F_SETFD,FD_CLOEXEC);
+    return fd;
+}
+
+int pep_sidecar_write(int fd, int code, const unsigned char * payload, size_t length, uint64_t deadline) {
+    unsigned char header[SIDECAR_HEADER_SIZE];
+    uint32_t ucode= (uint32_t)code;
+    if (length > PEP_SIDECAR_MAX_FRAME || (length > 0 && payload == NULL)) {
+        pep_log_error("pep_sidecar_write: invalid payload of %d bytes.",(int)length);
+        return -1;
+    }
+    header[0]= (unsigned char)((ucode >> 24) & 0xFF);
+    header[1]= (unsigned char)((ucode >> 16) & 0xFF);
+    header[2]= (unsigned char)((ucode >> 8) & 0xFF);
+    header[3]= (unsigned char)(ucode & 0xFF);
+    header[4]= (unsigned char)((length >> 24) & 0xFF);
+    header[5]= (unsigned char)((length >> 16) & 0xFF);
+    header[6]= (unsigned char)((length >> 8) & 0xFF);
+    header[7]= (unsigned char)(length & 0xFF);
+    if (sidecar_writeall(fd,header,SIDECAR_HEADER_SIZE,deadline) != 0
+        || sidecar_writeall(fd,payload,length,deadline) != 0) {
+        pep_log_debug("pep_sidecar_write: can't write frame of %d bytes: %s.",(int)length,strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int pep_sidecar_read(int fd, int * code, pep_buffer_t * buffer, uint64_t deadline) {
+    unsigned char header[SIDECAR_HEADER_SIZE];
+    unsigned char chunk[SIDECAR_CHUNK_SIZE];
+    size_t length, chunk_l;
+    int rc;
+    rc= sidecar_readall(fd,header,SIDECAR_HEADER_SIZE,deadline);
+    if (rc != 0) {
+        return rc;
+    }
+    *code= (int)(((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) | ((uint32_t)header[2] << 8) | (uint32_t)header[3]);
+    length= ((size_t)header[4] << 24) | ((size_t)header[5] << 16) | ((size_t)header[6] << 8) | (size_t)header[7];
+    if (length > PEP_SIDECAR_MAX_FRAME) {
+        pep_log_error("pep_sidecar_read: frame of %lu bytes too large.",(unsigned long)length);
+        return -1;
+    }
+    while (length > 0) {
+        chunk_l= (length > SIDECAR_CHUNK_SIZE) ? SIDECAR_CHUNK_SIZE : length;
+        if (sidecar_readall(fd,chunk,chunk_l,deadline) != 0) {
+            return -1;
+        }
+        if (pep_buffer_write(chunk,1,chunk_l,buffer) != chunk_l) {
+            return -1;
+        }
+        length -= chunk_l;
+    }
+    return 0;
+}
+
+pep_error_t pep_sidecar_send(pep_session_t * session, const char * path, uint64_t deadline) {
+    int reused, code= PEP_ERR_SIDECAR, rc= -1;
+    uint64_t now;
+    do {
+        /* the request code is the time left */
+        int remaining= 0;
+        if (deadline != 0) {
+            now= pep_clock_ms();
+            if (now >= deadline) break;
+            remaining= (int)(deadline - now);
+        }
+        reused= session->sidecar_connected;
+        if (!session->sidecar_connected) {
+            session->sidecar_fd= pep_sidecar_connect(path);
+            if (session->sidecar_fd < 0) {
+                return PEP_ERR_SIDECAR;
+            }
+            session->sidecar_connected= 1;
+        }
+        pep_buffer_clear(session->input);
+        rc= pep_sidecar_write(session->sidecar_fd,remaining,pep_buffer_data(session->output),pep_buffer_length(session->output),deadline);
+        if (rc == 0) {
+            rc= pep_sidecar_read(session->sidecar_fd,&code,session->input,deadline);
+        }
+        if (rc != 0) {
+            pep_sidecar_disconnect(session);
+        }
+        /* a kept connection closed by the daemon is retried once on a new one */
+    } while (rc != 0 && reused);
+    if (rc != 0) {
+        pep_log_error("pep_sidecar_send: no response from the sidecar daemon %s.",path);
+        return PEP_ERR_SIDECAR;
+    }
+    return (pep_error_t)code;
+}
+
+void pep_sidecar_disconnect(pep_session_t * session) {
+    if (session == NULL || !session->sidecar_connected) return;
+    close(session->sidecar_fd);
+    session->sidecar_fd= -1;
+    session->sidecar_connected= 0;
+}
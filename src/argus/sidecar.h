@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: local sidecar daemon transport
+ *
+ * $Id$
+ */
+#ifndef _PEP_SIDECAR_H_
+#define _PEP_SIDECAR_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+#include "pep.h"
+#include "session.h"
+#include "buffer.h" /* ../util/buffer.h */
+
+/*
+ * The clients and the sidecar daemon exchange frames over a Unix domain stream
+ * socket. A frame is a 8 bytes header, a code (big-endian signed 32 bits) and a
+ * payload length (big-endian unsigned 32 bits), followed by the payload.
+ *
+ * A request frame has the marshalled Hessian request as payload, and as code the
+ * milliseconds left before the client deadline, 0 if none. The response frame has the pep_error_t code of the
+ * authorization, and the Hessian response as payload if the code is PEP_OK.
+ * A connection carries any number of request and response frames, in turn.
+ */
+
+/** maximum payload length of a frame */
+#define PEP_SIDECAR_MAX_FRAME (16 * 1024 * 1024)
+
+/**
+ * Creates the listening socket of the sidecar daemon. A stale socket file left
+ * at path is removed.
+ *
+ * @return the socket or -1 if an error occurs.
+ */
+int pep_sidecar_listen(const char * path, int backlog);
+
+/**
+ * Connects to the sidecar daemon listening at path. The socket is non-blocking.
+ *
+ * @return the socket or -1 if an error occurs.
+ */
+int pep_sidecar_connect(const char * path);
+
+/**
+ * Writes a frame on the non-blocking socket fd.
+ *
+ * @param deadline the time (ms) the frame must be written by, 0 if none.
+ *
+ * @return 0 on success or -1 if an error occurs or the deadline passed.
+ */
+int pep_sidecar_write(int fd, int code, const unsigned char * payload, size_t length, uint64_t deadline);
+
+/**
+ * Reads a frame from the non-blocking socket fd, its payload is appended to buffer.
+ *
+ * @param deadline the time (ms) the frame must be read by, 0 if none.
+ *
+ * @return 0 on success, 1 if the peer closed the connection before the frame, or
+ *         -1 if an error occurs or the deadline passed.
+ */
+int pep_sidecar_read(int fd, int * code, pep_buffer_t * buffer, uint64_t deadline);
+
+/**
+ * Sends the marshalled request (session->output) to the sidecar daemon and writes
+ * its Hessian response into session->input. The session keeps the connection
+ * open for its next requests, and reconnects once if a kept connection was closed
+ * by the daemon.
+ *
+ * @param deadline the time (ms) the response must be received by, 0 if none. The
+ *        sidecar authorization is bounded by the time left.
+ *
+ * @return PEP_OK, the error code of the authorization done by the sidecar, or
+ *         PEP_ERR_SIDECAR if the sidecar can't be reached or answered no response.
+ */
+pep_error_t pep_sidecar_send(pep_session_t * session, const char * path, uint64_t deadline);
+
+/**
+ * Closes the session connection to the sidecar daemon, if any.
+ */
+void pep_sidecar_disconnect(pep_session_t * session);
+
+/**
+ * Authorizes a marshalled Hessian request on behalf of a sidecar client, and writes
+ * the Hessian response into response. The decision caches and the single-flight
+ * of the handle are used, the PIPs and OHs are not applied (the client does).
+ * Implemented in pep.c.
+ *
+ * @param timeout_ms the authorization deadline in milliseconds, 0 if none.
+ *
+ * @return PEP_OK or an error code.
+ */
+pep_error_t pep_sidecar_authorize(PEP * pep, pep_buffer_t * request, pep_buffer_t * response, int timeout_ms);
+
+/**
+ * Authorizes n marshalled Hessian requests in one batch request to the batch
+ * endpoint (see PEP_OPTION_BATCH_ENDPOINT_URL), the requests found in the decision
+ * caches are not sent. Without batch endpoint, the requests are authorized one by one.
+ * The Hessian responses are written into responses and the error codes into rcs.
+ * Implemented in pep.c.
+ *
+ * @return PEP_OK if all the requests are authorized, or the first error code.
+ */
+pep_error_t pep_sidecar_authorize_batch(PEP * pep, pep_buffer_t ** requests, pep_buffer_t ** responses, pep_error_t * rcs, size_t n, int timeout_ms);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,395 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* $Id$ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <curl/curl.h>
+
+#include "stats.h"
+
+/* the counters are shared by the threads of a shared handle: atomic updates, no lock */
+#define STATS_ADD(counter,value) __sync_fetch_and_add(&(counter),(uint64_t)(value))
+#define STATS_SET(counter,value) __sync_lock_test_and_set(&(counter),(uint64_t)(value))
+#define STATS_GET(counter) __sync_fetch_and_add(&(counter),0)
+
+/* libcurl >= 7.61 has the times in microseconds (CURLINFO_*_TIME_T) */
+#if LIBCURL_VERSION_NUM >= 0x073D00
+static uint64_t stats_time(CURL * curl, CURLINFO info) {
+    curl_off_t us= 0;
+    if (curl_easy_getinfo(curl,info,&us) != CURLE_OK || us < 0) {
+        return 0;
+    }
+    return (uint64_t)us;
+}
+#define STATS_NAMELOOKUP CURLINFO_NAMELOOKUP_TIME_T
+#define STATS_CONNECT CURLINFO_CONNECT_TIME_T
+#define STATS_APPCONNECT CURLINFO_APPCONNECT_TIME_T
+#define STATS_PRETRANSFER CURLINFO_PRETRANSFER_TIME_T
+#else
+static uint64_t stats_time(CURL * curl, CURLINFO info) {
+    double seconds= 0;
+    if (curl_easy_getinfo(curl,info,&seconds) != CURLE_OK || seconds < 0) {
+        return 0;
+    }
+    return (uint64_t)(seconds * 1000000.0);
+}
+#define STATS_NAMELOOKUP CURLINFO_NAMELOOKUP_TIME
+#define STATS_CONNECT CURLINFO_CONNECT_TIME
+#define STATS_APPCONNECT CURLINFO_APPCONNECT_TIME
+#define STATS_PRETRANSFER CURLINFO_PRETRANSFER_TIME
+#endif
+
+uint64_t pep_stats_bytes(CURL * curl, int upload) {
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t bytes= 0;
+    if (curl_easy_getinfo(curl,upload ? CURLINFO_SIZE_UPLOAD_T : CURLINFO_SIZE_DOWNLOAD_T,&bytes) != CURLE_OK || bytes < 0) {
+        return 0;
+    }
+    return (uint64_t)bytes;
+#else
+    double bytes= 0;
+    if (curl_easy_getinfo(curl,upload ? CURLINFO_SIZE_UPLOAD : CURLINFO_SIZE_DOWNLOAD,&bytes) != CURLE_OK || bytes < 0) {
+        return 0;
+    }
+    return (uint64_t)bytes;
+#endif
+}
+
+/* the time between two cumulative curl times, 0 if the later one is not reached */
+static uint64_t stats_elapsed(uint64_t from, uint64_t to) {
+    return (to > from) ? to - from : 0;
+}
+
+/* histogram upper bounds (us): 10, 25, 50, 75 us, ... 5, 7.5, 10 s */
+static const uint64_t histogram_bounds[PEP_HISTOGRAM_BOUNDS]= {
+    10, 25, 50, 75,
+    100, 250, 500, 750,
+    1000, 2500, 5000, 7500,
+    10000, 25000, 50000, 75000,
+    100000, 250000, 500000, 750000,
+    1000000, 2500000, 5000000, 7500000,
+    10000000
+};
+
+/* the label values of the phases, indexed by pep_stats_phase_t */
+static const char * phase_names[PEP_PHASE_COUNT]= {
+    "pip", "marshal", "encode", "dns", "connect", "tls", "server", "download", "decode", "unmarshal", "oh"
+};
+
+/* the label values of the decisions, indexed by xacml_decision_t */
+static const char * decision_names[XACML_DECISION_NOT_APPLICABLE + 1]= {
+    "deny", "permit", "indeterminate", "not_applicable"
+};
+
+static void histogram_add(pep_histogram_t * histogram, uint64_t us) {
+    int i= 0;
+    while (i < PEP_HISTOGRAM_BOUNDS && us > histogram_bounds[i]) {
+        i++;
+    }
+    STATS_ADD(histogram->buckets[i],1);
+    STATS_ADD(histogram->sum_us,us);
+}
+
+void pep_stats_phase(pep_metrics_t * metrics, pep_stats_phase_t phase, uint64_t us) {
+    pep_phase_stats_t * phase_stats;
+    if (metrics == NULL || phase < 0 || phase >= PEP_PHASE_COUNT) return;
+    phase_stats= &(metrics->stats.phases[phase]);
+    STATS_ADD(phase_stats->count,1);
+    STATS_ADD(phase_stats->total_us,us);
+    STATS_SET(phase_stats->last_us,us);
+    histogram_add(&(metrics->phases[phase]),us);
+}
+
+void pep_stats_transfer(pep_metrics_t * metrics, pep_session_t * session, pep_error_t rc) {
+    uint64_t namelookup, connect, appconnect, pretransfer;
+    long connects= 0;
+    CURL * curl= session->curl;
+    pep_stats_t * stats;
+    if (metrics == NULL || curl == NULL) return;
+    stats= &(metrics->stats);
+    STATS_ADD(stats->transfers,1);
+    if (rc != PEP_OK) {
+        STATS_ADD(stats->transfers_failed,1);
+    }
+    STATS_ADD(stats->bytes_sent,pep_stats_bytes(curl,1));
+    STATS_ADD(stats->bytes_received,pep_stats_bytes(curl,0));
+    if (session->encode_us > 0) {
+        pep_stats_phase(metrics,PEP_PHASE_ENCODE,session->encode_us);
+    }
+    if (session->decode_us > 0) {
+        pep_stats_phase(metrics,PEP_PHASE_DECODE,session->decode_us);
+    }
+
+    namelookup= stats_time(curl,STATS_NAMELOOKUP);
+    connect= stats_time(curl,STATS_CONNECT);
+    appconnect= stats_time(curl,STATS_APPCONNECT);
+    pretransfer= stats_time(curl,STATS_PRETRANSFER);
+
+    /* the connection phases only for a new connection */
+    curl_easy_getinfo(curl,CURLINFO_NUM_CONNECTS,&connects);
+    if (connects > 0) {
+        STATS_ADD(stats->connections,1);
+        pep_stats_phase(metrics,PEP_PHASE_DNS,namelookup);
+        if (connect > 0) {
+            pep_stats_phase(metrics,PEP_PHASE_CONNECT,stats_elapsed(namelookup,connect));
+        }
+        if (appconnect > 0) {
+            pep_stats_phase(metrics,PEP_PHASE_TLS,stats_elapsed(connect,appconnect));
+        }
+    }
+    else {
+        STATS_ADD(stats->connections_reused,1);
+    }
+
+    /*
+     * CURLINFO_STARTTRANSFER_TIME is the upload start for a body sent by the read
+     * function: the first and last response bytes are timed by the write functions.
+     */
+    if (session->received_first > 0) {
+        pep_stats_phase(metrics,PEP_PHASE_SERVER,stats_elapsed(session->sent + pretransfer,session->received_first));
+        pep_stats_phase(metrics,PEP_PHASE_DOWNLOAD,stats_elapsed(session->received_first,session->received_last));
+    }
+
+    session->encode_us= 0;
+    session->decode_us= 0;
+    session->received_first= 0;
+    session->received_last= 0;
+}
+
+void pep_stats_endpoint(pep_metrics_t * metrics, int i, uint64_t us, pep_error_t rc) {
+    if (metrics == NULL || i < 0 || i >= PEP_ENDPOINTS_MAX) return;
+    histogram_add(&(metrics->endpoints[i]),us);
+    if (rc != PEP_OK) {
+        STATS_ADD(metrics->endpoints_failed[i],1);
+    }
+}
+
+void pep_stats_result(pep_metrics_t * metrics, pep_error_t rc, const xacml_response_t * response) {
+    pep_stats_t * stats;
+    int i, results_l;
+    xacml_decision_t decision;
+    if (metrics == NULL) return;
+    stats= &(metrics->stats);
+    STATS_ADD(stats->authorizations,1);
+    if (rc == PEP_OK) {
+        results_l= (response != NULL) ? (int)xacml_response_results_length(response) : 0;
+        for (i= 0; i < results_l; i++) {
+            decision= xacml_result_getdecision(xacml_response_getresult(response,i));
+            if (decision >= XACML_DECISION_DENY && decision <= XACML_DECISION_NOT_APPLICABLE) {
+                STATS_ADD(metrics->decisions[decision],1);
+            }
+        }
+        return;
+    }
+    STATS_ADD(stats->errors,1);
+    if (rc >= PEP_ERR_CURL) {
+        if (rc - PEP_ERR_CURL < CURL_LAST) {
+            STATS_ADD(metrics->errors_curl[rc - PEP_ERR_CURL],1);
+        }
+        STATS_ADD(stats->errors_network,1);
+        return;
+    }
+    if (rc > PEP_OK && rc < PEP_STATS_ERRORS) {
+        STATS_ADD(metrics->errors[rc],1);
+    }
+    switch (rc) {
+    case PEP_ERR_AUTHZ_REQUEST:
+        STATS_ADD(stats->errors_http,1);
+        break;
+    case PEP_ERR_TIMEOUT:
+        STATS_ADD(stats->errors_timeout,1);
+        break;
+    case PEP_ERR_CIRCUIT_OPEN:
+        STATS_ADD(stats->errors_circuit,1);
+        break;
+    case PEP_ERR_SIDECAR:
+        STATS_ADD(stats->errors_sidecar,1);
+        break;
+    case PEP_ERR_MARSHALLING_HESSIAN:
+    case PEP_ERR_MARSHALLING_IO:
+    case PEP_ERR_UNMARSHALLING_HESSIAN:
+    case PEP_ERR_UNMARSHALLING_IO:
+        STATS_ADD(stats->errors_marshalling,1);
+        break;
+    case PEP_ERR_PIP_PROCESS:
+        STATS_ADD(stats->errors_pip,1);
+        break;
+    case PEP_ERR_OH_PROCESS:
+        STATS_ADD(stats->errors_oh,1);
+        break;
+    default:
+        STATS_ADD(stats->errors_other,1);
+        break;
+    }
+}
+
+void pep_stats_copy(pep_metrics_t * metrics, pep_stats_t * copy) {
+    pep_stats_t * stats= &(metrics->stats);
+    int i;
+    copy->authorizations= STATS_GET(stats->authorizations);
+    copy->errors= STATS_GET(stats->errors);
+    copy->errors_network= STATS_GET(stats->errors_network);
+    copy->errors_http= STATS_GET(stats->errors_http);
+    copy->errors_timeout= STATS_GET(stats->errors_timeout);
+    copy->errors_circuit= STATS_GET(stats->errors_circuit);
+    copy->errors_sidecar= STATS_GET(stats->errors_sidecar);
+    copy->errors_marshalling= STATS_GET(stats->errors_marshalling);
+    copy->errors_pip= STATS_GET(stats->errors_pip);
+    copy->errors_oh= STATS_GET(stats->errors_oh);
+    copy->errors_other= STATS_GET(stats->errors_other);
+    copy->transfers= STATS_GET(stats->transfers);
+    copy->transfers_failed= STATS_GET(stats->transfers_failed);
+    copy->connections= STATS_GET(stats->connections);
+    copy->connections_reused= STATS_GET(stats->connections_reused);
+    copy->bytes_sent= STATS_GET(stats->bytes_sent);
+    copy->bytes_received= STATS_GET(stats->bytes_received);
+    for (i= 0; i < PEP_PHASE_COUNT; i++) {
+        copy->phases[i].count= STATS_GET(stats->phases[i].count);
+        copy->phases[i].total_us= STATS_GET(stats->phases[i].total_us);
+        copy->phases[i].last_us= STATS_GET(stats->phases[i].last_us);
+    }
+}
+
+/* writes the label value, with the backslash, double-quote and line feed escaped */
+static void write_label(FILE * out, const char * value) {
+    for (; *value != '\0'; value++) {
+        if (*value == '\\' || *value == '"') {
+            fputc('\\',out);
+            fputc(*value,out);
+        }
+        else if (*value == '\n') {
+            fputs("\\n",out);
+        }
+        else {
+            fputc(*value,out);
+        }
+    }
+}
+
+/* writes the microseconds in seconds, without rounding */
+static void write_seconds(FILE * out, uint64_t us) {
+    fprintf(out,"%lu.%06lu",(unsigned long)(us / 1000000),(unsigned long)(us % 1000000));
+}
+
+static void write_header(FILE * out, const char * name, const char * type, const char * help) {
+    fprintf(out,"# HELP %s %s\n# TYPE %s %s\n",name,help,name,type);
+}
+
+static void write_counter(FILE * out, const char * name, const char * help, uint64_t value) {
+    write_header(out,name,"counter",help);
+    fprintf(out,"%s %lu\n",name,(unsigned long)value);
+}
+
+/* writes the cumulative buckets, the sum and the count of the labelled histogram */
+static void write_histogram(FILE * out, const char * name, const char * label, const char * value, pep_histogram_t * histogram) {
+    uint64_t count= 0;
+    int i;
+    for (i= 0; i <= PEP_HISTOGRAM_BOUNDS; i++) {
+        count += STATS_GET(histogram->buckets[i]);
+        fprintf(out,"%s_bucket{%s=\"",name,label);
+        write_label(out,value);
+        fputs("\",le=\"",out);
+        if (i < PEP_HISTOGRAM_BOUNDS) {
+            write_seconds(out,histogram_bounds[i]);
+        }
+        else {
+            fputs("+Inf",out);
+        }
+        fprintf(out,"\"} %lu\n",(unsigned long)count);
+    }
+    fprintf(out,"%s_sum{%s=\"",name,label);
+    write_label(out,value);
+    fputs("\"} ",out);
+    write_seconds(out,STATS_GET(histogram->sum_us));
+    fprintf(out,"\n%s_count{%s=\"",name,label);
+    write_label(out,value);
+    fprintf(out,"\"} %lu\n",(unsigned long)count);
+}
+
+int pep_stats_write(pep_metrics_t * metrics, const pep_endpoints_t * endpoints, const pep_cache_stats_t * cache_stats, FILE * out) {
+    pep_stats_t stats;
+    uint64_t value;
+    int i, endpoints_l;
+    pep_stats_copy(metrics,&stats);
+
+    write_counter(out,"argus_pep_authorizations_total","Authorizations ended, successful or not.",stats.authorizations);
+
+    write_header(out,"argus_pep_decisions_total","counter","Decisions received, by XACML decision.");
+    for (i= XACML_DECISION_DENY; i <= XACML_DECISION_NOT_APPLICABLE; i++) {
+        fprintf(out,"argus_pep_decisions_total{decision=\"%s\"} %lu\n",decision_names[i],(unsigned long)STATS_GET(metrics->decisions[i]));
+    }
+
+    /* only the errors which occurred, the pep_error_t codes are many */
+    write_header(out,"argus_pep_errors_total","counter","Authorizations failed, by PEP error code.");
+    for (i= PEP_OK + 1; i < PEP_STATS_ERRORS; i++) {
+        value= STATS_GET(metrics->errors[i]);
+        if (value == 0) continue;
+        fprintf(out,"argus_pep_errors_total{code=\"%d\",error=\"",i);
+        write_label(out,pep_strerror((pep_error_t)i));
+        fprintf(out,"\"} %lu\n",(unsigned long)value);
+    }
+    for (i= 0; i < CURL_LAST; i++) {
+        value= STATS_GET(metrics->errors_curl[i]);
+        if (value == 0) continue;
+        fprintf(out,"argus_pep_errors_total{code=\"%d\",error=\"",PEP_ERR_CURL + i);
+        write_label(out,curl_easy_strerror((CURLcode)i));
+        fprintf(out,"\"} %lu\n",(unsigned long)value);
+    }
+
+    write_counter(out,"argus_pep_transfers_total","HTTP transfers to the endpoints, failed over ones included.",stats.transfers);
+    write_counter(out,"argus_pep_transfers_failed_total","HTTP transfers without valid response.",stats.transfers_failed);
+    write_header(out,"argus_pep_connections_total","counter","HTTP transfers, by new or reused connection.");
+    fprintf(out,"argus_pep_connections_total{reused=\"false\"} %lu\n",(unsigned long)stats.connections);
+    fprintf(out,"argus_pep_connections_total{reused=\"true\"} %lu\n",(unsigned long)stats.connections_reused);
+    write_counter(out,"argus_pep_sent_bytes_total","Request body bytes sent.",stats.bytes_sent);
+    write_counter(out,"argus_pep_received_bytes_total","Response body bytes received.",stats.bytes_received);
+
+    write_header(out,"argus_pep_phase_duration_seconds","histogram","Duration of the authorization phases.");
+    for (i= 0; i < PEP_PHASE_COUNT; i++) {
+        write_histogram(out,"argus_pep_phase_duration_seconds","phase",phase_names[i],&(metrics->phases[i]));
+    }
+
+    endpoints_l= (int)pep_endpoints_length(endpoints);
+    if (endpoints_l > 0) {
+        write_header(out,"argus_pep_endpoint_duration_seconds","histogram","Duration of the HTTP transfers, by endpoint.");
+        for (i= 0; i < endpoints_l; i++) {
+            write_histogram(out,"argus_pep_endpoint_duration_seconds","endpoint",pep_endpoints_geturl(endpoints,i),&(metrics->endpoints[i]));
+        }
+        write_header(out,"argus_pep_endpoint_failures_total","counter","HTTP transfers without valid response, by endpoint.");
+        for (i= 0; i < endpoints_l; i++) {
+            fputs("argus_pep_endpoint_failures_total{endpoint=\"",out);
+            write_label(out,pep_endpoints_geturl(endpoints,i));
+            fprintf(out,"\"} %lu\n",(unsigned long)STATS_GET(metrics->endpoints_failed[i]));
+        }
+    }
+
+    if (cache_stats != NULL) {
+        write_counter(out,"argus_pep_cache_hits_total","Requests answered from the decision cache.",cache_stats->hits);
+        write_counter(out,"argus_pep_cache_misses_total","Requests not found, or expired, in the decision cache.",cache_stats->misses);
+        write_counter(out,"argus_pep_cache_insertions_total","Decisions stored in the decision cache.",cache_stats->insertions);
+        write_counter(out,"argus_pep_cache_evictions_total","Decisions evicted to respect the decision cache memory bound.",cache_stats->evictions);
+        write_counter(out,"argus_pep_cache_expirations_total","Expired decisions removed from the decision cache.",cache_stats->expirations);
+        write_counter(out,"argus_pep_cache_rejections_total","Cacheable decisions not admitted in the decision cache.",cache_stats->rejections);
+        write_header(out,"argus_pep_cache_entries","gauge","Decisions in the decision cache.");
+        fprintf(out,"argus_pep_cache_entries %lu\n",cache_stats->entries);
+        write_header(out,"argus_pep_cache_bytes","gauge","Memory used by the decisions in the decision cache.");
+        fprintf(out,"argus_pep_cache_bytes %lu\n",cache_stats->size);
+    }
+    return ferror(out) ? -1 : 0;
+}
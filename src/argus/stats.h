@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Argus PEP client API: lock-free statistics counters and metrics exposition
+ *
+ * $Id$
+ */
+#ifndef _PEP_STATS_H_
+#define _PEP_STATS_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h> /* FILE */
+#include <stdint.h> /* uint64_t */
+#include <curl/curl.h>
+
+#include "pep.h"
+#include "session.h"
+#include "endpoint.h"
+
+/** number of upper bounds of the latency histograms, see stats.c */
+#define PEP_HISTOGRAM_BOUNDS 25
+
+/** number of pep_error_t codes counted before PEP_ERR_CURL */
+#define PEP_STATS_ERRORS (PEP_ERR_SIDECAR + 1)
+
+/**
+ * Log-linear latency histogram: 4 buckets per decade, from 10us to 10s, and the overflow.
+ */
+typedef struct pep_histogram {
+    uint64_t buckets[PEP_HISTOGRAM_BOUNDS + 1];
+    uint64_t sum_us;
+} pep_histogram_t;
+
+/**
+ * Counters of a PEP handle: the public statistics (see pep_getstats) and the histograms
+ * and detailed counts of the metrics exposition (see pep_metrics_write).
+ */
+typedef struct pep_metrics {
+    pep_stats_t stats;
+    pep_histogram_t phases[PEP_PHASE_COUNT];
+    pep_histogram_t endpoints[PEP_ENDPOINTS_MAX]; /* transfer latencies, by endpoint index */
+    uint64_t endpoints_failed[PEP_ENDPOINTS_MAX];
+    uint64_t decisions[XACML_DECISION_NOT_APPLICABLE + 1];
+    uint64_t errors[PEP_STATS_ERRORS]; /* by pep_error_t */
+    uint64_t errors_curl[CURL_LAST]; /* by CURLcode of PEP_ERR_CURL + CURLcode */
+} pep_metrics_t;
+
+/**
+ * Adds a run of the phase, which lasted us microseconds.
+ */
+void pep_stats_phase(pep_metrics_t * metrics, pep_stats_phase_t phase, uint64_t us);
+
+/**
+ * Adds the ended transfer of the session: connection reuse, bytes, the connection
+ * phases timings (CURLINFO_*_TIME), the server and download times from the response
+ * bytes written, and the base64 encoding and decoding time spent in the transfer
+ * callbacks. The transfer accounting of the session is reset.
+ *
+ * @param rc PEP_OK if the transfer received a valid response, or an error code.
+ */
+void pep_stats_transfer(pep_metrics_t * metrics, pep_session_t * session, pep_error_t rc);
+
+/**
+ * Adds the ended transfer to the endpoint i, which lasted us microseconds.
+ */
+void pep_stats_endpoint(pep_metrics_t * metrics, int i, uint64_t us, pep_error_t rc);
+
+/**
+ * Adds an ended authorization, counts its error by class and code, or the decisions of
+ * its response.
+ *
+ * @param response the response of a successful authorization, or NULL.
+ */
+void pep_stats_result(pep_metrics_t * metrics, pep_error_t rc, const xacml_response_t * response);
+
+/**
+ * Returns the request (upload 1) or response (upload 0) body bytes of the last transfer
+ * of the easy handle.
+ */
+uint64_t pep_stats_bytes(CURL * curl, int upload);
+
+/**
+ * Copies the statistics, each counter atomically read.
+ */
+void pep_stats_copy(pep_metrics_t * metrics, pep_stats_t * copy);
+
+/**
+ * Writes the metrics in the Prometheus text exposition format.
+ *
+ * @param endpoints the endpoints labelling the endpoint histograms.
+ * @param cache_stats the decision cache statistics, or NULL if the cache is disabled.
+ *
+ * @return 0 on success or -1 on write error.
+ */
+int pep_stats_write(pep_metrics_t * metrics, const pep_endpoints_t * endpoints, const pep_cache_stats_t * cache_stats, FILE * out);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
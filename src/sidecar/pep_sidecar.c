@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*************
+ * Argus PEP sidecar daemon
+ *
+ * Listens on a Unix domain socket for the marshalled requests of the local PEP
+ * clients (see PEP_OPTION_SIDECAR_SOCKET), and sends them to the PEP daemon on
+ * warm, pooled TLS connections. Identical concurrent requests are coalesced, and
+ * with a batch endpoint the requests received while a batch is in flight are sent
+ * together in the next one. The requests are bounded by the -t deadline and by the
+ * client deadline, a batch by the earliest deadline of its requests.
+ *
+ * argus-pep-sidecar -s /var/run/argus-pep-sidecar.sock -e https://pepd.example.org:8154/authz \
+ *     -c /etc/grid-security/hostcert.pem -k /etc/grid-security/hostkey.pem \
+ *     -C /etc/grid-security/certificates
+ *
+ * $Id$
+ ************/
+
+/* pthread, sockets and getopt with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "pep.h" /* ../argus/pep.h */
+#include "sidecar.h" /* ../argus/sidecar.h */
+#include "buffer.h" /* ../util/buffer.h */
+#include "clock.h" /* ../util/clock.h */
+
+#define SIDECAR_DEFAULT_POOL_SIZE 16
+#define SIDECAR_DEFAULT_MAX_BATCH 64
+#define SIDECAR_DEFAULT_MODE 0660
+#define SIDECAR_BACKLOG 128
+
+/** request of a client connection, queued for the batchers */
+typedef struct sidecar_job {
+    pep_buffer_t * request;
+    pep_buffer_t * response;
+    pep_error_t rc;
+    uint64_t deadline; /* pep_clock_ms() deadline of the client, 0 if none */
+    int done;
+    struct sidecar_job * next;
+} sidecar_job_t;
+
+/** queue of the requests waiting for a batch */
+typedef struct sidecar_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t ready; /* signaled when a job is queued */
+    pthread_cond_t done; /* broadcast when a batch is done */
+    sidecar_job_t * head;
+    sidecar_job_t * tail;
+} sidecar_queue_t;
+
+static PEP * pep= NULL;
+static const char * socket_path= NULL;
+static int timeout_ms= 0;
+static int max_batch= SIDECAR_DEFAULT_MAX_BATCH;
+static int batching= 0;
+static sidecar_queue_t queue;
+
+static void usage(const char * program) {
+    fprintf(stderr,"Usage: %s -s SOCKET -e URL [-e URL]... [OPTIONS]\n",program);
+    fprintf(stderr,"  -s SOCKET  Unix domain socket path to listen on\n");
+    fprintf(stderr,"  -e URL     PEP daemon endpoint URL, can be repeated for failover\n");
+    fprintf(stderr,"  -b URL     PEP daemon batch endpoint URL, enables the batching\n");
+    fprintf(stderr,"  -c FILE    client certificate (PEM)\n");
+    fprintf(stderr,"  -k FILE    client private key (PEM)\n");
+    fprintf(stderr,"  -K PASS    client private key password\n");
+    fprintf(stderr,"  -C DIR     CA certificates directory\n");
+    fprintf(stderr,"  -S FILE    PEP daemon server certificate (PEM)\n");
+    fprintf(stderr,"  -n SIZE    number of pooled sessions and connections (default %d)\n",SIDECAR_DEFAULT_POOL_SIZE);
+    fprintf(stderr,"  -B SIZE    maximum number of requests in a batch (default %d)\n",SIDECAR_DEFAULT_MAX_BATCH);
+    fprintf(stderr,"  -t MSEC    authorization deadline in milliseconds (default none)\n");
+    fprintf(stderr,"  -T SEC     decision cache time-to-live, enables the cache\n");
+    fprintf(stderr,"  -m MODE    socket file mode, in octal (default %o)\n",SIDECAR_DEFAULT_MODE);
+    fprintf(stderr,"  -v         log to stderr, repeat for more details\n");
+}
+
+/*
+ * Authorizes the request of a client connection: directly within the client
+ * deadline (client_ms, 0 if none), or queued for the next batch.
+ */
+static pep_error_t sidecar_authorize(pep_buffer_t * request, pep_buffer_t * response, int client_ms) {
+    sidecar_job_t job;
+    if (!batching) {
+        if (client_ms > 0 && (timeout_ms == 0 || client_ms < timeout_ms)) {
+            return pep_sidecar_authorize(pep,request,response,client_ms);
+        }
+        return pep_sidecar_authorize(pep,request,response,timeout_ms);
+    }
+    job.request= request;
+    job.response= response;
+    job.rc= PEP_OK;
+    job.deadline= (client_ms > 0) ? pep_clock_ms() + (uint64_t)client_ms : 0;
+    job.done= 0;
+    job.next= NULL;
+    pthread_mutex_lock(&(queue.lock));
+    if (queue.tail != NULL) {
+        queue.tail->next= &job;
+    }
+    else {
+        queue.head= &job;
+    }
+    queue.tail= &job;
+    pthread_cond_signal(&(queue.ready));
+    while (!job.done) {
+        pthread_cond_wait(&(queue.done),&(queue.lock));
+    }
+    pthread_mutex_unlock(&(queue.lock));
+    return job.rc;
+}
+
+/*
+ * Batcher thread: takes the queued requests, coalesces the identical ones, and
+ * authorizes them in one batch request, within the -t deadline and the earliest
+ * remaining client deadline. The requests whose client deadline passed in the
+ * queue are not sent.
+ */
+static void * sidecar_batcher(void * arg) {
+    sidecar_job_t ** jobs= calloc(max_batch,sizeof(sidecar_job_t *));
+    pep_buffer_t ** requests= calloc(max_batch,sizeof(pep_buffer_t *));
+    pep_buffer_t ** responses= calloc(max_batch,sizeof(pep_buffer_t *));
+    pep_error_t * rcs= calloc(max_batch,sizeof(pep_error_t));
+    int * unique= calloc(max_batch,sizeof(int));
+    int jobs_l, unique_l, batch_ms, i, j;
+    uint64_t now;
+    if (jobs == NULL || requests == NULL || responses == NULL || rcs == NULL || unique == NULL) {
+        fprintf(stderr,"argus-pep-sidecar: can't allocate batcher arrays\n");
+        exit(1);
+    }
+    for (;;) {
+        pthread_mutex_lock(&(queue.lock));
+        while (queue.head == NULL) {
+            pthread_cond_wait(&(queue.ready),&(queue.lock));
+        }
+        for (jobs_l= 0; jobs_l < max_batch && queue.head != NULL; jobs_l++) {
+            jobs[jobs_l]= queue.head;
+            queue.head= queue.head->next;
+        }
+        if (queue.head == NULL) {
+            queue.tail= NULL;
+        }
+        pthread_mutex_unlock(&(queue.lock));
+
+        /* identical requests are sent once */
+        unique_l= 0;
+        batch_ms= timeout_ms;
+        now= pep_clock_ms();
+        for (i= 0; i < jobs_l; i++) {
+            size_t length= pep_buffer_length(jobs[i]->request);
+            if (jobs[i]->deadline > 0) {
+                if (jobs[i]->deadline <= now) {
+                    unique[i]= -1;
+                    continue;
+                }
+                if (batch_ms == 0 || jobs[i]->deadline - now < (uint64_t)batch_ms) {
+                    batch_ms= (int)(jobs[i]->deadline - now);
+                }
+            }
+            for (j= 0; j < unique_l; j++) {
+                if (pep_buffer_length(requests[j]) == length
+                    && memcmp(pep_buffer_data(requests[j]),pep_buffer_data(jobs[i]->request),length) == 0) {
+                    break;
+                }
+            }
+            if (j == unique_l) {
+                requests[unique_l]= jobs[i]->request;
+                responses[unique_l]= jobs[i]->response;
+                unique_l++;
+            }
+            unique[i]= j;
+        }
+        if (unique_l > 0) {
+            pep_sidecar_authorize_batch(pep,requests,responses,rcs,unique_l,batch_ms);
+        }
+        for (i= 0; i < jobs_l; i++) {
+            j= unique[i];
+            if (j < 0) {
+                jobs[i]->rc= PEP_ERR_TIMEOUT;
+                continue;
+            }
+            jobs[i]->rc= rcs[j];
+            if (rcs[j] == PEP_OK && jobs[i]->response != responses[j]) {
+                pep_buffer_write(pep_buffer_data(responses[j]),1,pep_buffer_length(responses[j]),jobs[i]->response);
+            }
+        }
+
+        pthread_mutex_lock(&(queue.lock));
+        for (i= 0; i < jobs_l; i++) {
+            jobs[i]->done= 1;
+        }
+        pthread_cond_broadcast(&(queue.done));
+        pthread_mutex_unlock(&(queue.lock));
+    }
+    return arg;
+}
+
+/*
+ * Client connection thread: answers the requests of the connection until the
+ * client closes it.
+ */
+static void * sidecar_connection(void * arg) {
+    int fd= *((int *)arg);
+    pep_buffer_t * request= pep_buffer_create(1024);
+    pep_buffer_t * response= pep_buffer_create(1024);
+    pep_error_t rc;
+    uint64_t deadline;
+    int code;
+    free(arg);
+    while (request != NULL && response != NULL) {
+        pep_buffer_clear(request);
+        pep_buffer_clear(response);
+        if (pep_sidecar_read(fd,&code,request,0) != 0) {
+            break;
+        }
+        if (code < 0) {
+            fprintf(stderr,"argus-pep-sidecar: invalid request frame code %d, closing connection\n",code);
+            break;
+        }
+        rc= sidecar_authorize(request,response,code);
+        /* don't wait forever for a client not reading its response */
+        deadline= pep_clock_ms() + 30000;
+        if (rc == PEP_OK) {
+            if (pep_sidecar_write(fd,rc,pep_buffer_data(response),pep_buffer_length(response),deadline) != 0) break;
+        }
+        else {
+            if (pep_sidecar_write(fd,rc,NULL,0,deadline) != 0) break;
+        }
+    }
+    pep_buffer_delete(request);
+    pep_buffer_delete(response);
+    close(fd);
+    return NULL;
+}
+
+/* removes the socket file on SIGINT or SIGTERM */
+static void * sidecar_signals(void * arg) {
+    sigset_t * signals= (sigset_t *)arg;
+    int signal_number= 0;
+    sigwait(signals,&signal_number);
+    unlink(socket_path);
+    exit(0);
+    return NULL;
+}
+
+int main(int argc, char ** argv) {
+    pthread_attr_t attr;
+    pthread_t thread;
+    sigset_t signals;
+    int opt, i, fd, listen_fd, pool_size= SIDECAR_DEFAULT_POOL_SIZE, verbose= 0;
+    long mode= SIDECAR_DEFAULT_MODE;
+    int cache_ttl= 0;
+    const char * batch_url= NULL;
+    pep_error_t rc;
+
+    if (pep_global_init() != PEP_OK) {
+        fprintf(stderr,"argus-pep-sidecar: pep_global_init() failed\n");
+        return 1;
+    }
+    pep= pep_initialize();
+    if (pep == NULL) {
+        fprintf(stderr,"argus-pep-sidecar: pep_initialize() failed\n");
+        return 1;
+    }
+
+    rc= PEP_OK;
+    while (rc == PEP_OK && (opt= getopt(argc,argv,"s:e:b:c:k:K:C:S:n:B:t:T:m:vh")) != -1) {
+        switch (opt) {
+        case 's':
+            socket_path= optarg;
+            break;
+        case 'e':
+            rc= pep_setoption(pep,PEP_OPTION_ENDPOINT_URL,optarg);
+            break;
+        case 'b':
+            batch_url= optarg;
+            rc= pep_setoption(pep,PEP_OPTION_BATCH_ENDPOINT_URL,optarg);
+            break;
+        case 'c':
+            rc= pep_setoption(pep,PEP_OPTION_ENDPOINT_CLIENT_CERT,optarg);
+            break;
+        case 'k':
+            rc= pep_setoption(pep,PEP_OPTION_ENDPOINT_CLIENT_KEY,optarg);
+            break;
+        case 'K':
+            rc= pep_setoption(pep,PEP_OPTION_ENDPOINT_CLIENT_KEYPASSWORD,optarg);
+            break;
+        case 'C':
+            rc= pep_setoption(pep,PEP_OPTION_ENDPOINT_SERVER_CAPATH,optarg);
+            break;
+        case 'S':
+            rc= pep_setoption(pep,PEP_OPTION_ENDPOINT_SERVER_CERT,optarg);
+            break;
+        case 'n':
+            pool_size= atoi(optarg);
+            break;
+        case 'B':
+            max_batch= atoi(optarg);
+            break;
+        case 't':
+            timeout_ms= atoi(optarg);
+            break;
+        case 'T':
+            cache_ttl= atoi(optarg);
+            break;
+        case 'm':
+            mode= strtol(optarg,NULL,8);
+            break;
+        case 'v':
+            verbose++;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rc != PEP_OK) {
+        fprintf(stderr,"argus-pep-sidecar: option -%c: %s\n",(char)opt,pep_strerror(rc));
+        return 1;
+    }
+    if (socket_path == NULL || pool_size < 1 || max_batch < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    /* the clients apply their PIPs and OHs, the sessions are shared by the connections */
+    if (verbose > 0) {
+        pep_setoption(pep,PEP_OPTION_LOG_STDERR,stderr);
+        pep_setoption(pep,PEP_OPTION_LOG_LEVEL,(verbose > 1) ? PEP_LOGLEVEL_DEBUG : PEP_LOGLEVEL_INFO);
+    }
+    pep_setoption(pep,PEP_OPTION_ENABLE_PIPS,0);
+    pep_setoption(pep,PEP_OPTION_ENABLE_OBLIGATIONHANDLERS,0);
+    pep_setoption(pep,PEP_OPTION_TCP_KEEPALIVE,60);
+    pep_setoption(pep,PEP_OPTION_SINGLE_FLIGHT,1);
+    if (cache_ttl > 0) {
+        pep_setoption(pep,PEP_OPTION_CACHE_TTL,cache_ttl);
+        pep_setoption(pep,PEP_OPTION_CACHE_ENABLED,1);
+    }
+    rc= pep_setoption(pep,PEP_OPTION_SESSION_POOL_SIZE,pool_size);
+    if (rc != PEP_OK) {
+        fprintf(stderr,"argus-pep-sidecar: can't create a pool of %d sessions: %s\n",pool_size,pep_strerror(rc));
+        return 1;
+    }
+
+    /* open the TLS connections before the first client */
+    rc= pep_warmup(pep,0);
+    if (rc != PEP_OK) {
+        fprintf(stderr,"argus-pep-sidecar: warning: can't connect to the PEP daemon: %s\n",pep_strerror(rc));
+    }
+
+    listen_fd= pep_sidecar_listen(socket_path,SIDECAR_BACKLOG);
+    if (listen_fd < 0 || chmod(socket_path,(mode_t)mode) != 0) {
+        fprintf(stderr,"argus-pep-sidecar: can't listen on %s: %s\n",socket_path,strerror(errno));
+        return 1;
+    }
+
+    /* the signals are handled by a dedicated thread */
+    sigemptyset(&signals);
+    sigaddset(&signals,SIGINT);
+    sigaddset(&signals,SIGTERM);
+    pthread_sigmask(SIG_BLOCK,&signals,NULL);
+    signal(SIGPIPE,SIG_IGN);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr,PTHREAD_CREATE_DETACHED);
+    pthread_create(&thread,&attr,sidecar_signals,&signals);
+
+    /* one batcher per pooled session */
+    if (batch_url != NULL) {
+        batching= 1;
+        pthread_mutex_init(&(queue.lock),NULL);
+        pthread_cond_init(&(queue.ready),NULL);
+        pthread_cond_init(&(queue.done),NULL);
+        queue.head= NULL;
+        queue.tail= NULL;
+        for (i= 0; i < pool_size; i++) {
+            if (pthread_create(&thread,&attr,sidecar_batcher,NULL) != 0) {
+                fprintf(stderr,"argus-pep-sidecar: can't create batcher thread\n");
+                return 1;
+            }
+        }
+    }
+
+    fprintf(stderr,"argus-pep-sidecar: listening on %s (%d sessions%s)\n",socket_path,pool_size,batching ? ", batching" : "");
+    for (;;) {
+        int * arg;
+        fd= accept(listen_fd,NULL,NULL);
+        if (fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                fprintf(stderr,"argus-pep-sidecar: accept failed: %s\n",strerror(errno));
+            }
+            continue;
+        }
+        fcntl(fd,F_SETFL,fcntl(fd,F_GETFL,0) | O_NONBLOCK);
+        arg= malloc(sizeof(int));
+        if (arg == NULL) {
+            close(fd);
+            continue;
+        }
+        *arg= fd;
+        if (pthread_create(&thread,&attr,sidecar_connection,arg) != 0) {
+            fprintf(stderr,"argus-pep-sidecar: can't create connection thread\n");
+            free(arg);
+            close(fd);
+        }
+    }
+    return 0;
+}
@@ -79,6 +79,80 @@ void pep_base64_encode_buffer_l( pep_buffer_t * inbuf, pep_buffer_t * outbuf, in
     }
 }
 
+/**
+ * Initializes the streaming encoder on the unread data of the in buffer.
+ */
+void pep_base64_encoder_init( pep_base64_encoder_t * encoder, pep_buffer_t * inbuf, int linesize ) {
+    if (linesize < 4) {
+        linesize= BASE64_DEFAULT_LINE_SIZE;
+    }
+    encoder->in= pep_buffer_data( inbuf );
+    encoder->in_l= pep_buffer_length( inbuf );
+    encoder->linesize= linesize;
+    pep_base64_encoder_rewind( encoder );
+}
+
+/**
+ * Restarts the encoding at the beginning of the data.
+ */
+void pep_base64_encoder_rewind( pep_base64_encoder_t * encoder ) {
+    encoder->in_pos= 0;
+    encoder->line_l= 0;
+    encoder->pending_l= 0;
+    encoder->pending_pos= 0;
+}
+
+/**
+ * Returns the total encoded length: 4 chars per block of 3 bytes, and a CRLF
+ * after each full line and after the last one.
+ */
+size_t pep_base64_encoder_length( const pep_base64_encoder_t * encoder ) {
+    size_t blocks= (encoder->in_l + 2) / 3;
+    size_t line_blocks= (size_t)(encoder->linesize + 3) / 4;
+    size_t lines= (blocks + line_blocks - 1) / line_blocks;
+    return blocks * 4 + lines * 2;
+}
+
+/**
+ * Reads the base64 encoded data, one block of 3 bytes is encoded at a time.
+ */
+size_t pep_base64_encoder_read( void * dst, size_t size, size_t count, void * _encoder ) {
+    pep_base64_encoder_t * encoder= (pep_base64_encoder_t *)_encoder;
+    unsigned char * out= (unsigned char *)dst;
+    size_t out_l= size * count, b_out= 0;
+
+    while ( b_out < out_l ) {
+        size_t n;
+        if ( encoder->pending_pos >= encoder->pending_l ) {
+            unsigned char in[3]= { 0, 0, 0 };
+            int in_l;
+            if ( encoder->in_pos >= encoder->in_l ) break; /* all encoded */
+            in_l= (int)(encoder->in_l - encoder->in_pos);
+            if ( in_l > 3 ) in_l= 3;
+            memcpy( in, encoder->in + encoder->in_pos, in_l );
+            encoder->in_pos += in_l;
+            encodeblock3to4( in, in_l, encoder->pending );
+            encoder->pending_l= 4;
+            encoder->pending_pos= 0;
+            encoder->line_l += 4;
+            if ( encoder->line_l >= encoder->linesize || encoder->in_pos >= encoder->in_l ) {
+                encoder->pending[4]= '\r';
+                encoder->pending[5]= '\n';
+                encoder->pending_l= 6;
+                encoder->line_l= 0;
+            }
+        }
+        n= encoder->pending_l - encoder->pending_pos;
+        if ( n > out_l - b_out ) {
+            n= out_l - b_out;
+        }
+        memcpy( out + b_out, encoder->pending + encoder->pending_pos, n );
+        encoder->pending_pos += n;
+        b_out += n;
+    }
+    return b_out;
+}
+
 /**
  * Decodes 4 '6-bit' characters into 3 8-bit binary bytes.
  */
@@ -120,3 +194,74 @@ void pep_base64_decode_buffer( pep_buffer_t * inbuf, pep_buffer_t * outbuf ) {
     }
 }
 
+
+/**
+ * Returns the index of c in the base64 table, or -1 if c is not in table.
+ */
+static int base64_index( int c ) {
+    if ( c >= 'A' && c <= 'Z' ) return c - 'A';
+    if ( c >= 'a' && c <= 'z' ) return c - 'a' + 26;
+    if ( c >= '0' && c <= '9' ) return c - '0' + 52;
+    if ( c == '+' ) return 62;
+    if ( c == '/' ) return 63;
+    return -1;
+}
+
+/**
+ * Initializes the streaming decoder.
+ */
+void pep_base64_decoder_init( pep_base64_decoder_t * decoder, pep_buffer_t * outbuf ) {
+    decoder->out= outbuf;
+    pep_base64_decoder_reset( decoder );
+}
+
+/**
+ * Discards the undecoded block.
+ */
+void pep_base64_decoder_reset( pep_base64_decoder_t * decoder ) {
+    decoder->in[0] = decoder->in[1] = decoder->in[2] = decoder->in[3] = 0;
+    decoder->in_l= 0;
+}
+
+/**
+ * Base64 decodes the data as it arrives, the decoded blocks are written by chunks.
+ */
+size_t pep_base64_decoder_write( const void * src, size_t size, size_t count, void * _decoder ) {
+    pep_base64_decoder_t * decoder= (pep_base64_decoder_t *)_decoder;
+    const unsigned char * in= (const unsigned char *)src;
+    size_t in_l= size * count, i;
+    unsigned char out[768];
+    size_t out_l= 0;
+
+    for( i = 0; i < in_l; i++ ) {
+        int index= base64_index( in[i] );
+        /* drop every char not in table */
+        if ( index < 0 ) continue;
+        decoder->in[decoder->in_l++] = (unsigned char) index;
+        if ( decoder->in_l == 4 ) {
+            decodeblock4to3( decoder->in, out + out_l );
+            out_l += 3;
+            pep_base64_decoder_reset( decoder );
+            if ( out_l == sizeof(out) ) {
+                if ( pep_buffer_write( out, 1, out_l, decoder->out ) != out_l ) return BUFFER_ERROR;
+                out_l= 0;
+            }
+        }
+    }
+    if ( out_l > 0 && pep_buffer_write( out, 1, out_l, decoder->out ) != out_l ) {
+        return BUFFER_ERROR;
+    }
+    return in_l;
+}
+
+/**
+ * Decodes the last incomplete block: in_l chars give in_l - 1 bytes.
+ */
+void pep_base64_decoder_finish( pep_base64_decoder_t * decoder ) {
+    unsigned char out[3];
+    if ( decoder->in_l > 1 ) {
+        decodeblock4to3( decoder->in, out );
+        pep_buffer_write( out, 1, decoder->in_l - 1, decoder->out );
+    }
+    pep_base64_decoder_reset( decoder );
+}
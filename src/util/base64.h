@@ -22,6 +22,7 @@
 extern "C" {
 #endif
 
+#include <stddef.h> /* size_t */
 #include "buffer.h"
 
 /* PEM default line size (RFC???) */
@@ -55,6 +56,105 @@ void pep_base64_encode_buffer_l(pep_buffer_t * in, pep_buffer_t * out, int lines
  */
 void pep_base64_decode_buffer(pep_buffer_t * in, pep_buffer_t * out);
 
+/**
+ * Streaming base64 encoder state, see pep_base64_encoder_read(). The state
+ * can be embedded, it doesn't allocate memory.
+ */
+typedef struct pep_base64_encoder {
+    const unsigned char * in; /* data to encode, not owned */
+    size_t in_l;
+    size_t in_pos; /* next byte to encode */
+    int linesize; /* line length or 0 for no line break */
+    int line_l; /* length of the current line */
+    unsigned char pending[6]; /* encoded block not yet read */
+    int pending_l;
+    int pending_pos;
+} pep_base64_encoder_t;
+
+/**
+ * Initializes the streaming encoder to encode the unread data of the in buffer,
+ * with the same line breaks as pep_base64_encode_buffer_l(in,out,linesize).
+ * The in buffer must not be modified while the encoder is used.
+ *
+ * @param pep_base64_encoder_t * encoder pointer to the encoder.
+ * @param pep_buffer_t * in pointer to the in buffer.
+ * @param int linesize length of the line (min 4)
+ */
+void pep_base64_encoder_init(pep_base64_encoder_t * encoder, pep_buffer_t * in, int linesize);
+
+/**
+ * Restarts the encoding at the beginning of the data.
+ *
+ * @param pep_base64_encoder_t * encoder pointer to the encoder.
+ */
+void pep_base64_encoder_rewind(pep_base64_encoder_t * encoder);
+
+/**
+ * Returns the total length of the base64 encoded data of the encoder.
+ *
+ * @param pep_base64_encoder_t * encoder pointer to the encoder.
+ */
+size_t pep_base64_encoder_length(const pep_base64_encoder_t * encoder);
+
+/**
+ * Reads at most size * count base64 encoded bytes from the encoder into dst,
+ * encoding them on demand. The function can be used as CURLOPT_READFUNCTION.
+ *
+ * @param void * dst pointer to the destination memory.
+ * @param size_t size size of an element.
+ * @param size_t count number of elements.
+ * @param void * encoder pointer to the pep_base64_encoder_t.
+ *
+ * @return the number of bytes read, 0 when all the data is encoded.
+ */
+size_t pep_base64_encoder_read(void * dst, size_t size, size_t count, void * encoder);
+
+/**
+ * Streaming base64 decoder state, see pep_base64_decoder_write(). The state
+ * can be embedded, it doesn't allocate memory.
+ */
+typedef struct pep_base64_decoder {
+    pep_buffer_t * out; /* decoded data, not owned */
+    unsigned char in[4]; /* undecoded block */
+    int in_l;
+} pep_base64_decoder_t;
+
+/**
+ * Initializes the streaming decoder to decode into the out buffer.
+ *
+ * @param pep_base64_decoder_t * decoder pointer to the decoder.
+ * @param pep_buffer_t * out pointer to the out buffer.
+ */
+void pep_base64_decoder_init(pep_base64_decoder_t * decoder, pep_buffer_t * out);
+
+/**
+ * Discards the undecoded block, if any. The out buffer is not modified.
+ *
+ * @param pep_base64_decoder_t * decoder pointer to the decoder.
+ */
+void pep_base64_decoder_reset(pep_base64_decoder_t * decoder);
+
+/**
+ * Base64 decodes size * count bytes from src into the decoder out buffer. The
+ * chars not in the base64 table are dropped, as in pep_base64_decode_buffer().
+ * The function can be used as CURLOPT_WRITEFUNCTION.
+ *
+ * @param const void * src pointer to the base64 encoded data.
+ * @param size_t size size of an element.
+ * @param size_t count number of elements.
+ * @param void * decoder pointer to the pep_base64_decoder_t.
+ *
+ * @return size * count or BUFFER_ERROR if the decoded data can't be written.
+ */
+size_t pep_base64_decoder_write(const void * src, size_t size, size_t count, void * decoder);
+
+/**
+ * Decodes the last incomplete block, if any, once all the data was written.
+ *
+ * @param pep_base64_decoder_t * decoder pointer to the decoder.
+ */
+void pep_base64_decoder_finish(pep_base64_decoder_t * decoder);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -264,6 +264,16 @@ int pep_buffer_reset(pep_buffer_t * buffer) {
     return BUFFER_OK;
 }
 
+int pep_buffer_clear(pep_buffer_t * buffer) {
+    if (buffer == NULL) {
+        pep_log_error("pep_buffer_clear: buffer is a NULL pointer.");
+        return BUFFER_ERROR;
+    }
+    buffer->rpos= 0;
+    buffer->wpos= 0;
+    return BUFFER_OK;
+}
+
 size_t pep_buffer_length(pep_buffer_t * buffer) {
     if (buffer == NULL) {
         pep_log_error("pep_buffer_length: buffer is a NULL pointer.");
@@ -272,5 +282,19 @@ size_t pep_buffer_length(pep_buffer_t * buffer) {
     return buffer->wpos - buffer->rpos;
 }
 
+size_t pep_buffer_size(pep_buffer_t * buffer) {
+    if (buffer == NULL) {
+        pep_log_error("pep_buffer_size: buffer is a NULL pointer.");
+        return 0;
+    }
+    return buffer->size;
+}
 
+const unsigned char * pep_buffer_data(pep_buffer_t * buffer) {
+    if (buffer == NULL || buffer->data == NULL) {
+        pep_log_error("pep_buffer_data: buffer is a NULL pointer.");
+        return NULL;
+    }
+    return &(buffer->data[buffer->rpos]);
+}
 
@@ -168,6 +168,16 @@ int pep_buffer_rewind(pep_buffer_t * buffer);
  */
 int pep_buffer_reset(pep_buffer_t * buffer);
 
+/**
+ * Reset the buffer write and read position pointer, without zeroing the buffer
+ * content. The allocated memory is kept for reuse.
+ *
+ * @param pep_buffer_t * buffer pointer to the buffer.
+ *
+ * @return int BUFFER_OK or BUFFER_ERROR if an error occurs.
+ */
+int pep_buffer_clear(pep_buffer_t * buffer);
+
 /**
  * Returns the number of char available to read.
  *
@@ -177,6 +187,25 @@ int pep_buffer_reset(pep_buffer_t * buffer);
  */
 size_t pep_buffer_length(pep_buffer_t * buffer);
 
+/**
+ * Returns the allocated size of the buffer.
+ *
+ * @param pep_buffer_t * buffer pointer to the buffer.
+ *
+ * @return size_t allocated size in bytes or 0 if an error occurs.
+ */
+size_t pep_buffer_size(pep_buffer_t * buffer);
+
+/**
+ * Returns a pointer to the unread data of the buffer, see pep_buffer_length(buffer).
+ * The pointer is only valid until the next write into the buffer.
+ *
+ * @param pep_buffer_t * buffer pointer to the buffer.
+ *
+ * @return const unsigned char * pointer to the unread data or NULL if an error occurs.
+ */
+const unsigned char * pep_buffer_data(pep_buffer_t * buffer);
+
 #ifdef  __cplusplus
 }
 #endif
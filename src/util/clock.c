@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* clock_gettime with -ansi -std=c99 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <time.h>
+#include <sys/time.h>
+
+#include "clock.h"
+
+uint64_t pep_clock_us(void) {
+    struct timespec ts;
+    struct timeval tv;
+    if (clock_gettime(CLOCK_MONOTONIC,&ts) == 0) {
+        return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)(ts.tv_nsec / 1000);
+    }
+    /* no monotonic clock: wall clock time */
+    gettimeofday(&tv,NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
+}
+
+uint64_t pep_clock_ms(void) {
+    return pep_clock_us() / 1000;
+}
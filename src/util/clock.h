@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _PEP_CLOCK_H_
+#define _PEP_CLOCK_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h> /* uint64_t */
+
+/**
+ * Returns the monotonic clock time in milliseconds, from an unspecified starting point.
+ */
+uint64_t pep_clock_ms(void);
+
+/**
+ * Returns the monotonic clock time in microseconds, from an unspecified starting point.
+ */
+uint64_t pep_clock_us(void);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
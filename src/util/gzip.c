@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "gzip.h"
+#include "log.h"
+
+/* size of the chunks read and compressed */
+#define GZIP_CHUNK_SIZE 4096
+
+int pep_gzip_available(void) {
+#ifdef HAVE_ZLIB
+    return TRUE;
+#else
+    return FALSE;
+#endif
+}
+
+#ifdef HAVE_ZLIB
+int pep_gzip_compress(pep_gzip_reader * read, void * reader, pep_buffer_t * out) {
+    unsigned char in[GZIP_CHUNK_SIZE], compressed[GZIP_CHUNK_SIZE];
+    z_stream stream;
+    size_t in_l;
+    int flush, z_rc;
+    if (read == NULL || out == NULL) {
+        pep_log_error("pep_gzip_compress: NULL read or out pointer.");
+        return GZIP_ERROR;
+    }
+    stream.zalloc= Z_NULL;
+    stream.zfree= Z_NULL;
+    stream.opaque= Z_NULL;
+    /* window bits + 16: gzip header and trailer */
+    z_rc= deflateInit2(&stream,Z_DEFAULT_COMPRESSION,Z_DEFLATED,15 + 16,8,Z_DEFAULT_STRATEGY);
+    if (z_rc != Z_OK) {
+        pep_log_error("pep_gzip_compress: deflateInit2 failed: %d.",z_rc);
+        return GZIP_ERROR;
+    }
+    do {
+        in_l= read(in,1,sizeof(in),reader);
+        if (in_l > sizeof(in)) {
+            pep_log_error("pep_gzip_compress: read error.");
+            deflateEnd(&stream);
+            return GZIP_ERROR;
+        }
+        flush= (in_l == 0) ? Z_FINISH : Z_NO_FLUSH;
+        stream.next_in= in;
+        stream.avail_in= (uInt)in_l;
+        /* compress the chunk, the output can be larger than one chunk */
+        do {
+            size_t compressed_l;
+            stream.next_out= compressed;
+            stream.avail_out= sizeof(compressed);
+            z_rc= deflate(&stream,flush);
+            if (z_rc == Z_STREAM_ERROR) {
+                pep_log_error("pep_gzip_compress: deflate failed: %d.",z_rc);
+                deflateEnd(&stream);
+                return GZIP_ERROR;
+            }
+            compressed_l= sizeof(compressed) - stream.avail_out;
+            if (compressed_l > 0 && pep_buffer_write(compressed,1,compressed_l,out) != compressed_l) {
+                pep_log_error("pep_gzip_compress: can't write %d bytes into out buffer.",(int)compressed_l);
+                deflateEnd(&stream);
+                return GZIP_ERROR;
+            }
+        } while (stream.avail_out == 0);
+    } while (flush != Z_FINISH);
+    deflateEnd(&stream);
+    return GZIP_OK;
+}
+#else
+int pep_gzip_compress(pep_gzip_reader * read, void * reader, pep_buffer_t * out) {
+    pep_log_error("pep_gzip_compress: not available, library compiled without zlib.");
+    return GZIP_ERROR;
+}
+#endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2006-2010.
+ * See http://www.eu-egee.org/partners/ for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _PEP_GZIP_H_
+#define _PEP_GZIP_H_
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* size_t */
+#include "buffer.h"
+
+/** gzip return codes */
+#define GZIP_OK     0
+#define GZIP_ERROR -1
+
+/**
+ * Reader function prototype, as pep_buffer_read() or pep_base64_encoder_read():
+ * reads at most size * count bytes into dst, returns 0 at the end of the data.
+ */
+typedef size_t pep_gzip_reader(void * dst, size_t size, size_t count, void * reader);
+
+/**
+ * Returns TRUE if the gzip compression is available (library compiled with zlib).
+ */
+int pep_gzip_available(void);
+
+/**
+ * Compresses in gzip format (RFC 1952) the data read from reader into the out buffer.
+ *
+ * @param pep_gzip_reader * read the reader function.
+ * @param void * reader the reader data, passed to read.
+ * @param pep_buffer_t * out pointer to the out buffer.
+ *
+ * @return int GZIP_OK or GZIP_ERROR if an error occurs, or if zlib is not available.
+ */
+int pep_gzip_compress(pep_gzip_reader * read, void * reader, pep_buffer_t * out);
+
+#ifdef  __cplusplus
+}
+#endif
+
+#endif
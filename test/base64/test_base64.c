@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2008.
+ * See http://www.eu-egee.org/partners for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $Id$
+ */
+
+/*
+ * Round-trip test of the streaming base64 encoder (request body read function) and
+ * decoder (response write function): the data is encoded and decoded in chunks of odd
+ * sizes, splitting the 3 bytes groups, the 4 chars quanta and the CRLF line breaks,
+ * and compared with the one-shot pep_base64_encode_buffer_l and pep_base64_decode_buffer.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util/buffer.h"
+#include "util/base64.h"
+
+static const int lengths[]= { 0, 1, 2, 3, 4, 5, 6, 7, 47, 48, 49, 50, 95, 96, 97, 255, 1000, 4099 };
+static const int linesizes[]= { 4, 5, 7, 64, 76 };
+static const int chunks[]= { 1, 2, 3, 4, 5, 6, 7, 11, 13, 64, 65, 4096 };
+
+#define LENGTHS_L (int)(sizeof(lengths) / sizeof(lengths[0]))
+#define LINESIZES_L (int)(sizeof(linesizes) / sizeof(linesizes[0]))
+#define CHUNKS_L (int)(sizeof(chunks) / sizeof(chunks[0]))
+
+static int failures= 0;
+
+static void fail(const char * test, int length, int linesize, int chunk, const char * reason) {
+    printf("FAILED: %s length=%d linesize=%d chunk=%d: %s\n",test,length,linesize,chunk,reason);
+    failures++;
+}
+
+/* deterministic pseudo random bytes, all the 256 values occur */
+static void fill(unsigned char * data, int length, unsigned int seed) {
+    int i;
+    for (i= 0; i < length; i++) {
+        seed= seed * 1103515245 + 12345;
+        data[i]= (unsigned char)(seed >> 16);
+    }
+}
+
+/* the chunk sizes vary around chunk, so the boundaries fall everywhere */
+static size_t chunk_size(int chunk, int n) {
+    return (size_t)(chunk + (n % 3));
+}
+
+/*
+ * Reads the streaming encoder in chunks and compares with the one-shot encoding.
+ */
+static void test_encoder(const unsigned char * data, int length, int linesize, int chunk, pep_buffer_t * expected) {
+    pep_buffer_t * in= pep_buffer_create(length + 1);
+    pep_buffer_t * out= pep_buffer_create(1024);
+    pep_base64_encoder_t encoder;
+    unsigned char read[4200];
+    size_t n, total= 0;
+    int calls;
+    pep_buffer_write(data,1,length,in);
+    pep_base64_encoder_init(&encoder,in,linesize);
+    if (pep_base64_encoder_length(&encoder) != pep_buffer_length(expected)) {
+        fail("encoder length",length,linesize,chunk,"differs from the one-shot encoding");
+    }
+    /* twice: the rewind restarts the encoding */
+    for (calls= 0; calls < 2; calls++) {
+        pep_buffer_clear(out);
+        total= 0;
+        pep_base64_encoder_rewind(&encoder);
+        while ((n= pep_base64_encoder_read(read,1,chunk_size(chunk,(int)total),&encoder)) > 0) {
+            pep_buffer_write(read,1,n,out);
+            total += n;
+        }
+        if (pep_buffer_length(out) != pep_buffer_length(expected)
+            || memcmp(pep_buffer_data(out),pep_buffer_data(expected),pep_buffer_length(expected)) != 0) {
+            fail("encoder",length,linesize,chunk,"differs from the one-shot encoding");
+        }
+    }
+    pep_buffer_delete(in);
+    pep_buffer_delete(out);
+}
+
+/*
+ * Writes the encoded data into the streaming decoder in chunks, and compares with the data.
+ */
+static void test_decoder(const unsigned char * data, int length, int linesize, int chunk, pep_buffer_t * encoded) {
+    pep_buffer_t * out= pep_buffer_create(1024);
+    pep_base64_decoder_t decoder;
+    const unsigned char * src= pep_buffer_data(encoded);
+    size_t src_l= pep_buffer_length(encoded), pos= 0, n;
+    pep_base64_decoder_init(&decoder,out);
+    /* an aborted transfer leaves an undecoded block, discarded by the reset */
+    if (src_l > 2) {
+        pep_base64_decoder_write(src,1,2,&decoder);
+        pep_base64_decoder_reset(&decoder);
+        pep_buffer_clear(out);
+    }
+    while (pos < src_l) {
+        n= chunk_size(chunk,(int)pos);
+        if (n > src_l - pos) n= src_l - pos;
+        if (pep_base64_decoder_write(src + pos,1,n,&decoder) != n) {
+            fail("decoder",length,linesize,chunk,"write error");
+            break;
+        }
+        pos += n;
+    }
+    pep_base64_decoder_finish(&decoder);
+    if (pep_buffer_length(out) != (size_t)length || memcmp(pep_buffer_data(out),data,length) != 0) {
+        fail("decoder",length,linesize,chunk,"differs from the data");
+    }
+    pep_buffer_delete(out);
+}
+
+int main(void) {
+    unsigned char data[4200];
+    pep_buffer_t * in, * encoded, * decoded;
+    int l, s, c, tests= 0;
+    for (l= 0; l < LENGTHS_L; l++) {
+        int length= lengths[l];
+        fill(data,length,(unsigned int)length);
+        for (s= 0; s < LINESIZES_L; s++) {
+            int linesize= linesizes[s];
+            /* one-shot encoding and decoding */
+            in= pep_buffer_create(length + 1);
+            encoded= pep_buffer_create(1024);
+            decoded= pep_buffer_create(1024);
+            pep_buffer_write(data,1,length,in);
+            pep_base64_encode_buffer_l(in,encoded,linesize);
+            pep_base64_decode_buffer(encoded,decoded);
+            if (pep_buffer_length(decoded) != (size_t)length || memcmp(pep_buffer_data(decoded),data,length) != 0) {
+                fail("one-shot",length,linesize,0,"decoded differs from the data");
+            }
+            pep_buffer_rewind(encoded);
+            for (c= 0; c < CHUNKS_L; c++) {
+                test_encoder(data,length,linesize,chunks[c],encoded);
+                test_decoder(data,length,linesize,chunks[c],encoded);
+                tests += 2;
+            }
+            pep_buffer_delete(in);
+            pep_buffer_delete(encoded);
+            pep_buffer_delete(decoded);
+        }
+        /* the decoder also reads the encoding without line break */
+        in= pep_buffer_create(length + 1);
+        encoded= pep_buffer_create(1024);
+        pep_buffer_write(data,1,length,in);
+        pep_base64_encode_buffer(in,encoded);
+        for (c= 0; c < CHUNKS_L; c++) {
+            test_decoder(data,length,0,chunks[c],encoded);
+            tests++;
+        }
+        pep_buffer_delete(in);
+        pep_buffer_delete(encoded);
+    }
+    printf("%d tests, %d failures\n",tests,failures);
+    return (failures == 0) ? 0 : 1;
+}
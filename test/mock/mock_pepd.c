@@ -0,0 +1,667 @@
+/*
+ * Copyright (c) Members of the EGEE Collaboration. 2008.
+ * See http://www.eu-egee.org/partners for details on the copyright holders.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $Id$
+ */
+
+/*
+ * Mock PEP daemon: a minimal HTTP/1.1 server answering the base64 encoded Hessian
+ * XACML requests of the PEP client with a fixed decision. The effective request
+ * is the received request. A Hessian list of requests (batch) is answered with a
+ * Hessian list of responses, on any URL path (e.g. /authz/batch). Some responses
+ * can be delayed, to simulate the latency tail of a loaded PEP daemon. HEAD requests
+ * (connection warm up) are answered with an empty 200 response. A request with the
+ * "Content-Type: application/x-hessian" header (PEP_WIRE_ENCODING_BINARY) is read
+ * and answered with raw Hessian bytes, without base64 encoding. A gzip compressed
+ * request body (Content-Encoding: gzip) is inflated, and the response body is gzip
+ * compressed when the client accepts it (Accept-Encoding: gzip).
+ *
+ * For the benchmarks (see bench/), the responses can be delayed with a random jitter,
+ * a percentage of the requests can fail (HTTP 503 response or connection closed without
+ * response), and the server can listen with HTTPS (-C certificate -K key). A script file
+ * (-s) gives the decision and latency of the requests matching a pattern, one rule per line:
+ *
+ *   # pattern decision [latency_ms]
+ *   CN=slow  1  250
+ *   CN=bob   0
+ *
+ * The first rule whose pattern is found in the Hessian bytes of a request applies.
+ *
+ * usage: ./mock_pepd [-p port] [-u socket] [-d decision] [-l latency] [-r percent] [-j jitter]
+ *                    [-f percent] [-x percent] [-s script] [-C cert -K key] [-v]
+ */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <zlib.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "buffer.h"
+#include "base64.h"
+#include "gzip.h"
+#include "hessian.h"
+#include "argus/xacml.h"
+
+/* Hessian class names, see src/argus/io.h */
+static const char RESPONSE_CLASSNAME[]= "org.glite.authz.common.model.Response";
+static const char RESULT_CLASSNAME[]=  "org.glite.authz.common.model.Result";
+static const char STATUS_CLASSNAME[]= "org.glite.authz.common.model.Status";
+static const char STATUSCODE_CLASSNAME[]= "org.glite.authz.common.model.StatusCode";
+
+/* options */
+static int port= 8154;
+static const char * unix_path= NULL;
+static int decision= XACML_DECISION_PERMIT;
+static int verbose= 0;
+static int latency= 0; /* ms */
+static int latency_percent= 100;
+static int jitter= 0; /* ms */
+static int error_percent= 0; /* HTTP 503 responses */
+static int drop_percent= 0; /* connections closed without response */
+static const char * tls_cert= NULL;
+static const char * tls_key= NULL;
+static SSL_CTX * tls_ctx= NULL;
+
+#define RULES_MAX 64
+/* script rule: decision and latency of the requests containing the pattern */
+typedef struct rule {
+    char pattern[256];
+    int decision;
+    int latency; /* ms, -1 for the default latency */
+} rule_t;
+static rule_t rules[RULES_MAX];
+static int rules_l= 0;
+
+/* client connection, plain or TLS */
+typedef struct connection {
+    int fd;
+    SSL * ssl;
+} connection_t;
+
+#define HEADER_MAX 8192
+/* content type of the raw Hessian requests and responses */
+#define HESSIAN_CONTENT_TYPE "application/x-hessian"
+
+/*
+ * Logs an INFO message on stdout
+ */
+static void info(const char * format, ...) {
+    va_list args;
+    if (!verbose) return;
+    va_start(args,format);
+    fprintf(stdout,"mock_pepd: ");
+    vfprintf(stdout,format,args);
+    fprintf(stdout,"\n");
+    fflush(stdout);
+    va_end(args);
+}
+
+/*
+ * Adds the <key,value> pair to the Hessian map.
+ */
+static void map_put(hessian_object_t * map, const char * key, hessian_object_t * value) {
+    hessian_map_add(map,hessian_create(HESSIAN_STRING,key),value);
+}
+
+/*
+ * Serializes the Hessian XACML response with the decision for the Hessian request into
+ * the output buffer. The request object is only borrowed.
+ */
+static void serialize_response(const hessian_object_t * h_request, int decision, pep_buffer_t * output) {
+    hessian_object_t * h_key, * h_results, * h_result, * h_status, * h_statuscode;
+    size_t type_l= strlen(RESPONSE_CLASSNAME);
+    h_statuscode= hessian_create(HESSIAN_MAP,STATUSCODE_CLASSNAME);
+    map_put(h_statuscode,"code",hessian_create(HESSIAN_STRING,XACML_STATUSCODE_OK));
+    map_put(h_statuscode,"subCode",hessian_create(HESSIAN_NULL));
+    h_status= hessian_create(HESSIAN_MAP,STATUS_CLASSNAME);
+    map_put(h_status,"message",hessian_create(HESSIAN_STRING,"mock"));
+    map_put(h_status,"statusCode",h_statuscode);
+    h_result= hessian_create(HESSIAN_MAP,RESULT_CLASSNAME);
+    map_put(h_result,"decision",hessian_create(HESSIAN_INTEGER,(int32_t)decision));
+    map_put(h_result,"resourceId",hessian_create(HESSIAN_NULL));
+    map_put(h_result,"status",h_status);
+    map_put(h_result,"obligations",hessian_create(HESSIAN_LIST));
+    h_results= hessian_create(HESSIAN_LIST);
+    hessian_list_add(h_results,h_result);
+    /* Hessian 1.0 typed map: M t b16 b8 type (key value)* z */
+    pep_buffer_putc('M',output);
+    pep_buffer_putc('t',output);
+    pep_buffer_putc((int)(type_l >> 8),output);
+    pep_buffer_putc((int)(type_l & 0xFF),output);
+    pep_buffer_write(RESPONSE_CLASSNAME,1,type_l,output);
+    h_key= hessian_create(HESSIAN_STRING,"request");
+    hessian_serialize(h_key,output);
+    hessian_delete(h_key);
+    hessian_serialize(h_request,output);
+    h_key= hessian_create(HESSIAN_STRING,"results");
+    hessian_serialize(h_key,output);
+    hessian_delete(h_key);
+    hessian_serialize(h_results,output);
+    hessian_delete(h_results);
+    pep_buffer_putc('z',output);
+}
+
+/*
+ * Returns the first script rule whose pattern is found in the Hessian request, or NULL.
+ */
+static const rule_t * match_rule(const hessian_object_t * h_request) {
+    pep_buffer_t * bytes;
+    const char * data;
+    size_t data_l, pattern_l, i;
+    const rule_t * rule= NULL;
+    int r;
+    if (rules_l == 0) return NULL;
+    bytes= pep_buffer_create(1024);
+    hessian_serialize(h_request,bytes);
+    data= (const char *)pep_buffer_data(bytes);
+    data_l= pep_buffer_length(bytes);
+    for (r= 0; r < rules_l && rule == NULL; r++) {
+        pattern_l= strlen(rules[r].pattern);
+        for (i= 0; i + pattern_l <= data_l; i++) {
+            if (memcmp(data + i,rules[r].pattern,pattern_l) == 0) {
+                rule= &(rules[r]);
+                break;
+            }
+        }
+    }
+    pep_buffer_delete(bytes);
+    return rule;
+}
+
+/*
+ * Serializes the response of the request, with the decision of its script rule if any.
+ * The latency of the rule, if greater, is set in max_latency.
+ */
+static void serialize_scripted(const hessian_object_t * h_request, pep_buffer_t * output, int * max_latency) {
+    const rule_t * rule= match_rule(h_request);
+    if (rule == NULL) {
+        serialize_response(h_request,decision,output);
+        return;
+    }
+    info("script rule '%s': decision %d",rule->pattern,rule->decision);
+    if (rule->latency > *max_latency) *max_latency= rule->latency;
+    serialize_response(h_request,rule->decision,output);
+}
+
+/*
+ * Loads the script rules: pattern decision [latency_ms], # comments.
+ */
+static int load_script(const char * filename) {
+    char line[512];
+    FILE * file= fopen(filename,"r");
+    if (file == NULL) {
+        perror(filename);
+        return -1;
+    }
+    while (fgets(line,sizeof(line),file) != NULL && rules_l < RULES_MAX) {
+        rule_t * rule= &(rules[rules_l]);
+        int n;
+        if (line[0] == '#' || line[strspn(line," \t\r\n")] == '\0') continue;
+        rule->latency= -1;
+        n= sscanf(line,"%255s %d %d",rule->pattern,&(rule->decision),&(rule->latency));
+        if (n < 2) {
+            fprintf(stderr,"mock_pepd: invalid script rule: %s",line);
+            fclose(file);
+            return -1;
+        }
+        rules_l++;
+    }
+    fclose(file);
+    return 0;
+}
+
+/*
+ * Decodes the HTTP request body and encodes the HTTP response body, base64 encoded
+ * or raw Hessian bytes (binary). The latency of the matching script rules, if any, is
+ * set in rule_latency. Returns the HTTP status code.
+ */
+static int process(pep_buffer_t * body, pep_buffer_t * reply, int binary, int * rule_latency) {
+    pep_buffer_t * input, * output;
+    hessian_object_t * h_input;
+    int i, status= 200;
+    input= pep_buffer_create(pep_buffer_length(body));
+    output= pep_buffer_create(1024);
+    if (binary) {
+        pep_buffer_write(pep_buffer_data(body),1,pep_buffer_length(body),input);
+    }
+    else {
+        pep_base64_decode_buffer(body,input);
+    }
+    h_input= hessian_deserialize(input);
+    if (h_input == NULL) {
+        info("can't deserialize Hessian request");
+        status= 400;
+    }
+    else if (hessian_gettype(h_input) == HESSIAN_LIST) {
+        /* batch: Hessian 1.0 list: V l b32 b24 b16 b8 value* z */
+        size_t n= hessian_list_length(h_input);
+        info("batch of %d requests",(int)n);
+        pep_buffer_putc('V',output);
+        pep_buffer_putc('l',output);
+        pep_buffer_putc((int)((n >> 24) & 0xFF),output);
+        pep_buffer_putc((int)((n >> 16) & 0xFF),output);
+        pep_buffer_putc((int)((n >> 8) & 0xFF),output);
+        pep_buffer_putc((int)(n & 0xFF),output);
+        for (i= 0; i < n; i++) {
+            serialize_scripted(hessian_list_get(h_input,i),output,rule_latency);
+        }
+        pep_buffer_putc('z',output);
+    }
+    else {
+        serialize_scripted(h_input,output,rule_latency);
+    }
+    if (h_input != NULL) {
+        hessian_delete(h_input);
+        if (binary) {
+            pep_buffer_write(pep_buffer_data(output),1,pep_buffer_length(output),reply);
+        }
+        else {
+            pep_base64_encode_buffer_l(output,reply,BASE64_DEFAULT_LINE_SIZE);
+        }
+    }
+    pep_buffer_delete(input);
+    pep_buffer_delete(output);
+    return status;
+}
+
+/*
+ * Inflates the gzip compressed body into a new buffer. Returns NULL on error.
+ */
+static pep_buffer_t * gunzip(pep_buffer_t * body) {
+    unsigned char chunk[4096];
+    pep_buffer_t * inflated;
+    z_stream stream;
+    int z_rc;
+    memset(&stream,0,sizeof(stream));
+    /* window bits + 32: gzip or zlib header detection */
+    if (inflateInit2(&stream,15 + 32) != Z_OK) return NULL;
+    inflated= pep_buffer_create(4 * pep_buffer_length(body));
+    stream.next_in= (unsigned char *)pep_buffer_data(body);
+    stream.avail_in= (uInt)pep_buffer_length(body);
+    do {
+        stream.next_out= chunk;
+        stream.avail_out= sizeof(chunk);
+        z_rc= inflate(&stream,Z_NO_FLUSH);
+        if (z_rc != Z_OK && z_rc != Z_STREAM_END) {
+            info("can't inflate request body: %d",z_rc);
+            inflateEnd(&stream);
+            pep_buffer_delete(inflated);
+            return NULL;
+        }
+        pep_buffer_write(chunk,1,sizeof(chunk) - stream.avail_out,inflated);
+    } while (z_rc != Z_STREAM_END);
+    inflateEnd(&stream);
+    return inflated;
+}
+
+/*
+ * Returns TRUE if the header value (terminated by CR) contains the token.
+ */
+static int header_contains(const char * value, const char * token) {
+    const char * found;
+    if (value == NULL) return 0;
+    found= strstr(value,token);
+    return found != NULL && found < value + strcspn(value,"\r");
+}
+
+/*
+ * Reads from the connection, returns the number of bytes read, 0 on EOF or -1 on error.
+ */
+static ssize_t connection_read(connection_t * connection, void * data, size_t data_l) {
+    if (connection->ssl != NULL) {
+        int n= SSL_read(connection->ssl,data,(int)data_l);
+        return (n > 0) ? n : -1;
+    }
+    return read(connection->fd,data,data_l);
+}
+
+/*
+ * Writes to the connection, returns the number of bytes written or -1 on error.
+ */
+static ssize_t connection_write(connection_t * connection, const void * data, size_t data_l) {
+    if (connection->ssl != NULL) {
+        int n= SSL_write(connection->ssl,data,(int)data_l);
+        return (n > 0) ? n : -1;
+    }
+    return write(connection->fd,data,data_l);
+}
+
+/*
+ * Reads up to the end of the HTTP headers, returns the header length (including
+ * the empty line) or -1 on EOF or error. The bytes read after the headers are left
+ * in the buffer.
+ */
+static int read_headers(connection_t * connection, char * headers, size_t * headers_l) {
+    char * end;
+    ssize_t n;
+    while ((end= strstr(headers,"\r\n\r\n")) == NULL) {
+        if (*headers_l >= HEADER_MAX - 1) return -1;
+        n= connection_read(connection,headers + *headers_l,HEADER_MAX - 1 - *headers_l);
+        if (n <= 0) return -1;
+        *headers_l += n;
+        headers[*headers_l]= '\0';
+    }
+    return (int)(end - headers) + 4;
+}
+
+/*
+ * Returns the value of the header name, or NULL if not present. The value is
+ * terminated by CR.
+ */
+static const char * get_header(const char * headers, const char * name) {
+    size_t name_l= strlen(name);
+    const char * line= strstr(headers,"\r\n");
+    while (line != NULL && line[2] != '\r') {
+        line += 2;
+        if (strncasecmp(line,name,name_l) == 0 && line[name_l] == ':') {
+            const char * value= line + name_l + 1;
+            while (*value == ' ') value++;
+            return value;
+        }
+        line= strstr(line,"\r\n");
+    }
+    return NULL;
+}
+
+/*
+ * Writes all the bytes to the connection.
+ */
+static int write_all(connection_t * connection, const void * data, size_t data_l) {
+    const char * p= data;
+    while (data_l > 0) {
+        ssize_t n= connection_write(connection,p,data_l);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        data_l -= n;
+    }
+    return 0;
+}
+
+/*
+ * Connection thread: handles HTTP/1.1 keep-alive requests until the client closes.
+ */
+static void * connection_thread(void * arg) {
+    connection_t connection;
+    unsigned int seed;
+    char headers[HEADER_MAX];
+    size_t headers_l= 0;
+    headers[0]= '\0';
+    connection.fd= (int)(long)arg;
+    connection.ssl= NULL;
+    seed= (unsigned int)connection.fd ^ (unsigned int)time(NULL) ^ (unsigned int)(unsigned long)pthread_self();
+    if (tls_ctx != NULL) {
+        connection.ssl= SSL_new(tls_ctx);
+        if (connection.ssl == NULL || SSL_set_fd(connection.ssl,connection.fd) != 1 || SSL_accept(connection.ssl) != 1) {
+            info("TLS handshake failed");
+            if (connection.ssl != NULL) SSL_free(connection.ssl);
+            close(connection.fd);
+            return NULL;
+        }
+    }
+    for (;;) {
+        pep_buffer_t * body, * reply;
+        const char * value;
+        char status_line[256];
+        long content_l= 0;
+        int header_l, status, keep_alive, head, binary, gzipped, accept_gzip, delay_ms, rule_latency= -1;
+        size_t extra;
+        header_l= read_headers(&connection,headers,&headers_l);
+        if (header_l < 0) break;
+        head= strncmp(headers,"HEAD ",5) == 0;
+        value= get_header(headers,"Content-Type");
+        binary= value != NULL && strncasecmp(value,HESSIAN_CONTENT_TYPE,strlen(HESSIAN_CONTENT_TYPE)) == 0;
+        gzipped= header_contains(get_header(headers,"Content-Encoding"),"gzip");
+        accept_gzip= header_contains(get_header(headers,"Accept-Encoding"),"gzip");
+        value= get_header(headers,"Content-Length");
+        if (value != NULL) content_l= atol(value);
+        keep_alive= strncmp(headers + strcspn(headers,"\r") - 8,"HTTP/1.0",8) != 0;
+        value= get_header(headers,"Connection");
+        if (value != NULL && strncasecmp(value,"close",5) == 0) keep_alive= 0;
+        body= pep_buffer_create(content_l + 1);
+        /* body bytes already read with the headers */
+        extra= headers_l - header_l;
+        if (extra > content_l) extra= content_l;
+        pep_buffer_write(headers + header_l,1,extra,body);
+        while (pep_buffer_length(body) < content_l) {
+            char chunk[4096];
+            size_t want= content_l - pep_buffer_length(body);
+            ssize_t n= connection_read(&connection,chunk,want < sizeof(chunk) ? want : sizeof(chunk));
+            if (n <= 0) break;
+            pep_buffer_write(chunk,1,n,body);
+        }
+        /* keep pipelined bytes */
+        memmove(headers,headers + header_l + extra,headers_l - header_l - extra);
+        headers_l -= header_l + extra;
+        headers[headers_l]= '\0';
+        info("request: %d bytes%s%s",(int)content_l,binary ? " (binary)" : "",gzipped ? " (gzip)" : "");
+        reply= pep_buffer_create(1024);
+        if (head) {
+            /* connection warm up */
+            info("HEAD request");
+            snprintf(status_line,sizeof(status_line),"HTTP/1.1 200 OK\r\nContent-Length: 0\r\n%s\r\n",
+                     keep_alive ? "" : "Connection: close\r\n");
+            if (write_all(&connection,status_line,strlen(status_line)) != 0) keep_alive= 0;
+            pep_buffer_delete(body);
+            pep_buffer_delete(reply);
+            if (!keep_alive) break;
+            continue;
+        }
+        if (gzipped) {
+            pep_buffer_t * inflated= gunzip(body);
+            pep_buffer_delete(body);
+            body= inflated;
+        }
+        /* simulated failures */
+        if (drop_percent > 0 && (int)(rand_r(&seed) % 100) < drop_percent) {
+            info("closing connection without response");
+            pep_buffer_delete(body);
+            pep_buffer_delete(reply);
+            break;
+        }
+        if (error_percent > 0 && (int)(rand_r(&seed) % 100) < error_percent) {
+            info("failing request: HTTP 503");
+            status= 503;
+        }
+        else {
+            status= (body != NULL) ? process(body,reply,binary,&rule_latency) : 400;
+        }
+        if (accept_gzip && pep_buffer_length(reply) > 0) {
+            pep_buffer_t * compressed= pep_buffer_create(pep_buffer_length(reply));
+            pep_gzip_compress(pep_buffer_read,reply,compressed);
+            pep_buffer_delete(reply);
+            reply= compressed;
+        }
+        delay_ms= 0;
+        if (rule_latency >= 0) {
+            delay_ms= rule_latency;
+        }
+        else if (latency > 0 && (int)(rand_r(&seed) % 100) < latency_percent) {
+            delay_ms= latency;
+        }
+        if (jitter > 0) {
+            delay_ms += (int)(rand_r(&seed) % (jitter + 1));
+        }
+        if (delay_ms > 0) {
+            struct timespec delay;
+            delay.tv_sec= delay_ms / 1000;
+            delay.tv_nsec= (delay_ms % 1000) * 1000000L;
+            info("delaying response: %d ms",delay_ms);
+            nanosleep(&delay,NULL);
+        }
+        snprintf(status_line,sizeof(status_line),
+                 "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n%sContent-Length: %d\r\n%s\r\n",
+                 status, status == 200 ? "OK" : (status == 503 ? "Service Unavailable" : "Bad Request"), binary ? HESSIAN_CONTENT_TYPE : "text/plain",
+                 accept_gzip && pep_buffer_length(reply) > 0 ? "Content-Encoding: gzip\r\n" : "", (int)pep_buffer_length(reply),
+                 keep_alive ? "" : "Connection: close\r\n");
+        if (write_all(&connection,status_line,strlen(status_line)) != 0
+            || write_all(&connection,pep_buffer_data(reply),pep_buffer_length(reply)) != 0) {
+            keep_alive= 0;
+        }
+        pep_buffer_delete(body);
+        pep_buffer_delete(reply);
+        if (!keep_alive) break;
+    }
+    if (connection.ssl != NULL) {
+        SSL_shutdown(connection.ssl);
+        SSL_free(connection.ssl);
+    }
+    close(connection.fd);
+    return NULL;
+}
+
+/*
+ * Creates the TLS server context with the certificate and key PEM files.
+ */
+static SSL_CTX * create_tls_context(const char * cert, const char * key) {
+    SSL_CTX * ctx;
+    SSL_library_init();
+    SSL_load_error_strings();
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+    ctx= SSL_CTX_new(TLS_server_method());
+#else
+    ctx= SSL_CTX_new(SSLv23_server_method());
+#endif
+    if (ctx == NULL
+        || SSL_CTX_use_certificate_chain_file(ctx,cert) != 1
+        || SSL_CTX_use_PrivateKey_file(ctx,key,SSL_FILETYPE_PEM) != 1) {
+        ERR_print_errors_fp(stderr);
+        if (ctx != NULL) SSL_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static void usage(const char * name) {
+    fprintf(stderr,"usage: %s [-p port] [-u socket] [-d decision] [-l latency] [-r percent] [-j jitter]\n",name);
+    fprintf(stderr,"          [-f percent] [-x percent] [-s script] [-C cert -K key] [-v]\n");
+    fprintf(stderr,"  -p port      TCP port to listen on (default 8154)\n");
+    fprintf(stderr,"  -u socket    Unix domain socket to listen on instead of TCP\n");
+    fprintf(stderr,"  -d decision  decision to return: 0=Deny 1=Permit 2=Indeterminate 3=NotApplicable (default 1)\n");
+    fprintf(stderr,"  -l latency   delay of the responses in ms (default 0)\n");
+    fprintf(stderr,"  -r percent   percentage of the responses delayed (default 100)\n");
+    fprintf(stderr,"  -j jitter    random delay added to the responses, from 0 to jitter ms (default 0)\n");
+    fprintf(stderr,"  -f percent   percentage of the requests failed with HTTP 503 (default 0)\n");
+    fprintf(stderr,"  -x percent   percentage of the requests whose connection is closed without response (default 0)\n");
+    fprintf(stderr,"  -s script    script file of the decisions and latencies by request pattern\n");
+    fprintf(stderr,"  -C cert      certificate PEM file, listen with HTTPS\n");
+    fprintf(stderr,"  -K key       private key PEM file of the certificate\n");
+    fprintf(stderr,"  -v           verbose\n");
+}
+
+/*
+ * MAIN
+ */
+int main(int argc, char **argv) {
+    struct sockaddr_in addr;
+    struct sockaddr_un uaddr;
+    int opt, server_fd, on= 1;
+    while ((opt= getopt(argc,argv,"p:u:d:l:r:j:f:x:s:C:K:vh")) != -1) {
+        switch (opt) {
+        case 'p': port= atoi(optarg); break;
+        case 'u': unix_path= optarg; break;
+        case 'd': decision= atoi(optarg); break;
+        case 'l': latency= atoi(optarg); break;
+        case 'r': latency_percent= atoi(optarg); break;
+        case 'j': jitter= atoi(optarg); break;
+        case 'f': error_percent= atoi(optarg); break;
+        case 'x': drop_percent= atoi(optarg); break;
+        case 's': if (load_script(optarg) != 0) return 1; break;
+        case 'C': tls_cert= optarg; break;
+        case 'K': tls_key= optarg; break;
+        case 'v': verbose= 1; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if ((tls_cert == NULL) != (tls_key == NULL)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (tls_cert != NULL && (tls_ctx= create_tls_context(tls_cert,tls_key)) == NULL) {
+        fprintf(stderr,"mock_pepd: can't load the TLS certificate %s and key %s\n",tls_cert,tls_key);
+        return 1;
+    }
+    /* clients can close the connection before the response (cancelled requests) */
+    signal(SIGPIPE,SIG_IGN);
+    if (unix_path != NULL) {
+        server_fd= socket(AF_UNIX,SOCK_STREAM,0);
+        if (server_fd < 0 || strlen(unix_path) >= sizeof(uaddr.sun_path)) {
+            perror("socket");
+            return 1;
+        }
+        unlink(unix_path);
+        memset(&uaddr,0,sizeof(uaddr));
+        uaddr.sun_family= AF_UNIX;
+        strcpy(uaddr.sun_path,unix_path);
+        if (bind(server_fd,(struct sockaddr *)&uaddr,sizeof(uaddr)) != 0 || listen(server_fd,SOMAXCONN) != 0) {
+            perror("bind/listen");
+            return 1;
+        }
+        fprintf(stdout,"mock_pepd: listening on unix://%s:/authz\n",unix_path);
+        fflush(stdout);
+    }
+    else {
+        server_fd= socket(AF_INET,SOCK_STREAM,0);
+        if (server_fd < 0) {
+            perror("socket");
+            return 1;
+        }
+        setsockopt(server_fd,SOL_SOCKET,SO_REUSEADDR,&on,sizeof(on));
+        memset(&addr,0,sizeof(addr));
+        addr.sin_family= AF_INET;
+        addr.sin_addr.s_addr= htonl(INADDR_LOOPBACK);
+        addr.sin_port= htons(port);
+        if (bind(server_fd,(struct sockaddr *)&addr,sizeof(addr)) != 0 || listen(server_fd,SOMAXCONN) != 0) {
+            perror("bind/listen");
+            return 1;
+        }
+        fprintf(stdout,"mock_pepd: listening on %s://127.0.0.1:%d/authz\n",(tls_ctx != NULL) ? "https" : "http",port);
+        fflush(stdout);
+    }
+    for (;;) {
+        pthread_t thread;
+        int fd= accept(server_fd,NULL,NULL);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        if (unix_path == NULL) setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&on,sizeof(on));
+        if (pthread_create(&thread,NULL,connection_thread,(void *)(long)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    close(server_fd);
+    return 0;
+}